@@ -0,0 +1,226 @@
+/* aggregate.c
+
+   per-origin totals for originas --aggregate
+
+   Each input line is counted against the origin of its looked up field:
+   the number of lines, their bytes, the number of distinct addresses
+   and, optionally, the sum of a numeric column. Origins are kept in an
+   open addressed hash on the AS number (asindex.c), so memory grows
+   with the number of origins seen, not with the input.
+
+   Distinct addresses are counted either exactly, through one set of
+   (origin, address) pairs shared by all origins, or approximately with
+   a HyperLogLog sketch of 2^AGGR_HLL_BITS one byte registers per origin
+   (a standard error of about 1.04 / sqrt(2^AGGR_HLL_BITS), 2.3%).
+
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include "originas.h"
+
+#define AGGR_HLL_BITS 11
+#define AGGR_HLL_REGS (1 << AGGR_HLL_BITS)
+
+
+struct aggent {
+  struct originkey k ;
+  u_int64_t lines ;
+  u_int64_t bytes ;
+  u_int64_t distinct ;      /* exact count */
+  double sum ;
+  u_int8_t *hll ;
+  } ;
+
+/* an (origin, address) pair in the exact distinct set */
+
+struct aggaddr {
+  u_int128_t addr ;
+  u_int32_t origin ;
+  u_int8_t type ;           /* FIELD_ type, 0 for an empty slot */
+  } ;
+
+struct aggr {
+  int distinct ;
+  struct originhash oh ;    /* of struct aggent */
+  struct aggaddr *set ;
+  size_t nset ;
+  size_t setsize ;
+  } ;
+
+
+static u_int64_t
+addr_hash(u_int32_t origin, int type, u_int128_t addr)
+{
+  return(mix64((u_int64_t) addr ^ mix64((u_int64_t) (addr >> 64) ^ ((u_int64_t) origin << 8) ^ type))) ;
+}
+
+
+/*--------------------------------------------------
+ * aggr_new
+ * an empty set of totals, counting distinct addresses as AGGR_ method
+ * <distinct>
+ */
+
+struct aggr *
+aggr_new(int distinct)
+{
+  struct aggr *ag = (struct aggr *) calloc(1,sizeof *ag) ;
+
+  ag->distinct = distinct ;
+  originhash_init(&ag->oh,sizeof (struct aggent)) ;
+  if (distinct == AGGR_EXACT) {
+    ag->setsize = 1 << 16 ;
+    ag->set = (struct aggaddr *) calloc(ag->setsize,sizeof *ag->set) ;
+    }
+  return(ag) ;
+}
+
+void
+aggr_free(struct aggr *ag)
+{
+  size_t i ;
+
+  for (i = 0 ; i < ag->oh.size ; ++i) free(((struct aggent *) ORIGINHASH_ENT(&ag->oh,i))->hll) ;
+  originhash_free(&ag->oh) ;
+  free(ag->set) ;
+  free(ag) ;
+}
+
+
+/* the totals for <origin>, added if they are new */
+
+static struct aggent *
+aggr_entry(struct aggr *ag, u_int32_t origin)
+{
+  struct aggent *ae = (struct aggent *) originhash_entry(&ag->oh,origin) ;
+
+  if (ae && !ae->hll && (ag->distinct == AGGR_HLL))
+    ae->hll = (u_int8_t *) calloc(AGGR_HLL_REGS,1) ;
+  return(ae) ;
+}
+
+/* add an (origin, address) pair to the exact set, return 1 if it is new */
+
+static int
+aggr_set_add(struct aggr *ag, u_int32_t origin, int type, u_int128_t addr)
+{
+  struct aggaddr *old ;
+  size_t i, h, oldsize ;
+
+  if (2 * (ag->nset + 1) > ag->setsize) {
+    old = ag->set ;
+    oldsize = ag->setsize ;
+    ag->setsize *= 2 ;
+    ag->set = (struct aggaddr *) calloc(ag->setsize,sizeof *ag->set) ;
+    for (i = 0 ; i < oldsize ; ++i) {
+      if (!old[i].type) continue ;
+      h = addr_hash(old[i].origin,old[i].type,old[i].addr) & (ag->setsize - 1) ;
+      while (ag->set[h].type) h = (h + 1) & (ag->setsize - 1) ;
+      ag->set[h] = old[i] ;
+      }
+    free(old) ;
+    }
+
+  h = addr_hash(origin,type,addr) & (ag->setsize - 1) ;
+  while (ag->set[h].type) {
+    if ((ag->set[h].origin == origin) && (ag->set[h].type == type) && (ag->set[h].addr == addr)) return(0) ;
+    h = (h + 1) & (ag->setsize - 1) ;
+    }
+  ag->set[h].origin = origin ;
+  ag->set[h].type = (u_int8_t) type ;
+  ag->set[h].addr = addr ;
+  ++ag->nset ;
+  return(1) ;
+}
+
+
+/*--------------------------------------------------
+ * aggr_add
+ * count a line of <bytes> bytes against <origin>. <type> is the
+ * FIELD_ type of its field and <addr> the address (or AS) in it, for
+ * the distinct count - FIELD_NONE is not counted. <value> is added to
+ * the sum
+ */
+
+void
+aggr_add(struct aggr *ag, u_int32_t origin, size_t bytes, int type, u_int128_t addr, double value)
+{
+  struct aggent *ae ;
+  u_int64_t h ;
+  int rank ;
+
+  if (!(ae = aggr_entry(ag,origin))) return ;
+  ++ae->lines ;
+  ae->bytes += bytes ;
+  ae->sum += value ;
+  if (type == FIELD_NONE) return ;
+
+  if (ag->distinct == AGGR_EXACT) {
+    ae->distinct += aggr_set_add(ag,origin,type,addr) ;
+    }
+  else if (ag->distinct == AGGR_HLL) {
+    /* the top bits pick the register, the rest give the rank */
+    h = addr_hash(0,type,addr) ;
+    rank = ((h << AGGR_HLL_BITS) ? __builtin_clzll(h << AGGR_HLL_BITS) + 1 : 64 - AGGR_HLL_BITS + 1) ;
+    if (rank > ae->hll[h >> (64 - AGGR_HLL_BITS)]) ae->hll[h >> (64 - AGGR_HLL_BITS)] = (u_int8_t) rank ;
+    }
+}
+
+
+/* the HyperLogLog estimate, by linear counting while registers are
+   still empty and the estimate is small */
+
+static u_int64_t
+hll_count(const u_int8_t *reg)
+{
+  const double m = AGGR_HLL_REGS ;
+  double sum = 0.0 ;
+  double e ;
+  int zeros = 0 ;
+  int i ;
+
+  for (i = 0 ; i < AGGR_HLL_REGS ; ++i) {
+    sum += ldexp(1.0,-reg[i]) ;
+    if (!reg[i]) ++zeros ;
+    }
+  e = (0.7213 / (1.0 + (1.079 / m))) * m * m / sum ;
+  if ((e <= 2.5 * m) && zeros) e = m * log(m / zeros) ;
+  return((u_int64_t) (e + 0.5)) ;
+}
+
+
+/*--------------------------------------------------
+ * aggr_print
+ * write the totals, one line per origin in AS order:
+ *   origin,lines,bytes[,distinct][,sum]
+ * with the origin named from table <names> if it is not NULL
+ */
+
+void
+aggr_print(struct aggr *ag, FILE *fp, const oa_table *names, char delim, int sum)
+{
+  struct aggent *ae ;
+  const char *asname ;
+  void **v ;
+  size_t i ;
+
+  if (!(v = originhash_sorted(&ag->oh))) return ;
+  for (i = 0 ; i < ag->oh.nent ; ++i) {
+    ae = (struct aggent *) v[i] ;
+    if (names && (asname = oa_asname(names,ae->k.origin))) fprintf(fp,"%s",asname) ;
+    else if (names) fprintf(fp,"AS%u",ae->k.origin) ;
+    else fprintf(fp,"%u",ae->k.origin) ;
+    fprintf(fp,"%c%llu%c%llu",delim,(unsigned long long) ae->lines,delim,(unsigned long long) ae->bytes) ;
+    if (ag->distinct == AGGR_EXACT)
+      fprintf(fp,"%c%llu",delim,(unsigned long long) ae->distinct) ;
+    else if (ag->distinct == AGGR_HLL)
+      fprintf(fp,"%c%llu",delim,(unsigned long long) hll_count(ae->hll)) ;
+    if (sum) fprintf(fp,"%c%.15g",delim,ae->sum) ;
+    fprintf(fp,"\n") ;
+    }
+  free(v) ;
+}
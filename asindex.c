@@ -0,0 +1,346 @@
+/* asindex.c
+
+   the address space of each origin AS
+
+   Lookups go from address to origin. A table made with OA_KEEP_ORIGIN
+   also indexes the other way once the ranges are compiled: the range
+   indices are radix sorted on origin (stably, so each origin keeps its
+   ranges in address order) into one array, with a sorted dictionary of
+   the origins holding where each one's slice begins.
+
+     query    bisect the dictionary, then read the slice - each range
+              is written as the fewest CIDR blocks that cover it, so
+              the work done is in proportion to what is returned
+
+   The totals of every origin at once need no index: one pass over the
+   compiled ranges of any table adds each into an open addressed hash
+   on the AS number, with 128 bit sums for v6.
+
+*/
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include "originas.h"
+
+struct asref {
+  u_int32_t origin_as ;
+  u_int32_t idx ;
+  } ;
+
+struct spaceent {
+  struct originkey k ;
+  u_int128_t addrs6 ;
+  u_int64_t addrs4 ;
+  } ;
+
+
+/* sort the <n> references in <v> on origin and lay them out in <ai> */
+
+static void
+asindex_fill(struct asindex *ai, struct asref *v, size_t n)
+{
+  static const int keys[4] = { RADIX_KEY(offsetof(struct asref,origin_as),4,0),
+                               RADIX_KEY(offsetof(struct asref,origin_as),4,1),
+                               RADIX_KEY(offsetof(struct asref,origin_as),4,2),
+                               RADIX_KEY(offsetof(struct asref,origin_as),4,3) } ;
+  size_t i, k = 0 ;
+
+  oa_radixsort(v,n,sizeof *v,keys,4) ;
+  ai->asn = (u_int32_t *) malloc((n ? n : 1) * sizeof *ai->asn) ;
+  ai->off = (u_int32_t *) malloc((n + 1) * sizeof *ai->off) ;
+  ai->idx = (u_int32_t *) malloc((n ? n : 1) * sizeof *ai->idx) ;
+  for (i = 0 ; i < n ; ++i) {
+    if (!i || (v[i].origin_as != v[i - 1].origin_as)) {
+      ai->asn[k] = v[i].origin_as ;
+      ai->off[k++] = (u_int32_t) i ;
+      }
+    ai->idx[i] = v[i].idx ;
+    }
+  ai->off[k] = (u_int32_t) n ;
+  ai->n = k ;
+  if (k < n) ai->asn = (u_int32_t *) realloc(ai->asn,(k ? k : 1) * sizeof *ai->asn) ;
+}
+
+
+/*--------------------------------------------------
+ * asindex_build
+ * index the compiled ranges of a table on their origin. Ranges
+ * with no origin are left out
+ */
+
+void
+asindex_build(oa_table *t)
+{
+  struct asref *v ;
+  size_t i, n ;
+
+  n = ((t->n4 > t->n6) ? t->n4 : t->n6) ;
+  v = (struct asref *) malloc((n ? n : 1) * sizeof *v) ;
+  for (n = 0, i = 0 ; i < t->n4 ; ++i) {
+    if (!t->r4[i].origin_as) continue ;
+    v[n].origin_as = t->r4[i].origin_as ;
+    v[n++].idx = (u_int32_t) i ;
+    }
+  asindex_fill(&t->as4,v,n) ;
+  for (n = 0, i = 0 ; i < t->n6 ; ++i) {
+    if (!t->r6[i].origin_as) continue ;
+    v[n].origin_as = t->r6[i].origin_as ;
+    v[n++].idx = (u_int32_t) i ;
+    }
+  asindex_fill(&t->as6,v,n) ;
+  free(v) ;
+}
+
+void
+asindex_free(oa_table *t)
+{
+  free(t->as4.asn) ;
+  free(t->as4.off) ;
+  free(t->as4.idx) ;
+  free(t->as6.asn) ;
+  free(t->as6.off) ;
+  free(t->as6.idx) ;
+}
+
+
+/* the position of <asn> in the dictionary of <ai>, or -1 */
+
+static long
+asindex_find(const struct asindex *ai, u_int32_t asn)
+{
+  size_t lo = 0, hi = ai->n, mid ;
+
+  while (lo < hi) {
+    mid = (lo + hi) >> 1 ;
+    if (ai->asn[mid] < asn) lo = mid + 1 ;
+    else hi = mid ;
+    }
+  return(((lo < ai->n) && (ai->asn[lo] == asn)) ? (long) lo : -1) ;
+}
+
+
+/*--------------------------------------------------
+ * origin4, origin6
+ * add the CIDR blocks originated by <asn> to the <n> already in
+ * <out>, and their addresses to <count>. Ranges kept apart only by
+ * their as paths are joined again first. Return the new total
+ */
+
+static size_t
+origin4(const oa_table *t, u_int32_t asn, oa_prefix *out, size_t max, size_t n, u_int64_t *count)
+{
+  const struct asindex *ai = &t->as4 ;
+  u_int32_t s, e ;
+  size_t i, last ;
+  long k ;
+  int len ;
+
+  if ((k = asindex_find(ai,asn)) < 0) return(n) ;
+  last = ai->off[k + 1] ;
+  for (i = ai->off[k] ; i < last ; ++i) {
+    s = t->r4[ai->idx[i]].start ;
+    e = t->r4[ai->idx[i]].end ;
+    while ((i + 1 < last) && (t->r4[ai->idx[i + 1]].start == e + 1)) e = t->r4[ai->idx[++i]].end ;
+    *count += (u_int64_t) e - s + 1 ;
+    for (;;) {
+      len = cidr4(s,e) ;
+      if (n < max) prefix4_put(&out[n],s,len,asn) ;
+      ++n ;
+      if (!len || ((u_int64_t) s + ((u_int64_t) 1 << (32 - len)) > e)) break ;
+      s += (u_int32_t) 1 << (32 - len) ;
+      }
+    }
+  return(n) ;
+}
+
+static size_t
+origin6(const oa_table *t, u_int32_t asn, oa_prefix *out, size_t max, size_t n, u_int128_t *count)
+{
+  const struct asindex *ai = &t->as6 ;
+  u_int128_t s, e ;
+  size_t i, last ;
+  long k ;
+  int len ;
+
+  if ((k = asindex_find(ai,asn)) < 0) return(n) ;
+  last = ai->off[k + 1] ;
+  for (i = ai->off[k] ; i < last ; ++i) {
+    s = t->r6[ai->idx[i]].start ;
+    e = t->r6[ai->idx[i]].end ;
+    while ((i + 1 < last) && (t->r6[ai->idx[i + 1]].start == e + 1)) e = t->r6[ai->idx[++i]].end ;
+    *count += e - s + 1 ;
+    for (;;) {
+      len = cidr6(s,e) ;
+      if (n < max) prefix6_put(&out[n],s,len,asn) ;
+      ++n ;
+      if (!len || (s + (((u_int128_t) 1 << (128 - len)) - 1) >= e)) break ;
+      s += (u_int128_t) 1 << (128 - len) ;
+      }
+    }
+  return(n) ;
+}
+
+
+/*--------------------------------------------------
+ * oa_origin_prefixes
+ * the address space originated by <asn> as CIDR blocks, v4 and then
+ * v6, each in address order. Up to <max> are stored in <out>, and the
+ * number there are is returned. <addrs4> and <addrs6> (high word
+ * first) are set to the number of addresses if they are not null
+ */
+
+size_t
+oa_origin_prefixes(const oa_table *t, uint32_t asn, oa_prefix *out, size_t max,
+                   uint64_t *addrs4, uint64_t addrs6[2])
+{
+  u_int64_t c4 = 0 ;
+  u_int128_t c6 = 0 ;
+  size_t n = 0 ;
+
+  if ((t->flags & OA_KEEP_ORIGIN) && t->built && asn) {
+    n = origin4(t,asn,out,max,n,&c4) ;
+    n = origin6(t,asn,out,max,n,&c6) ;
+    }
+  if (addrs4) *addrs4 = c4 ;
+  if (addrs6) {
+    addrs6[0] = (uint64_t) (c6 >> 64) ;
+    addrs6[1] = (uint64_t) c6 ;
+    }
+  return(n) ;
+}
+
+
+/*--------------------------------------------------
+ * originhash_init, originhash_entry
+ * an empty hash of <width> byte entries, and the entry for <origin>,
+ * added zeroed if it is new - or 0 if there is no memory for it
+ */
+
+int
+originhash_init(struct originhash *oh, size_t width)
+{
+  oh->width = width ;
+  oh->nent = 0 ;
+  oh->size = 1024 ;
+  oh->ent = (char *) calloc(oh->size,width) ;
+  return(oh->ent != 0) ;
+}
+
+void *
+originhash_entry(struct originhash *oh, u_int32_t origin)
+{
+  struct originkey *ok ;
+  char *old ;
+  size_t i, h, oldsize ;
+
+  if (2 * (oh->nent + 1) > oh->size) {
+    old = oh->ent ;
+    oldsize = oh->size ;
+    if (!(oh->ent = (char *) calloc(2 * oldsize,oh->width))) {
+      oh->ent = old ;
+      return(0) ;
+      }
+    oh->size *= 2 ;
+    for (i = 0 ; i < oldsize ; ++i) {
+      ok = (struct originkey *) (old + i * oh->width) ;
+      if (!ok->used) continue ;
+      h = mix64(ok->origin) & (oh->size - 1) ;
+      while (ORIGINHASH_ENT(oh,h)->used) h = (h + 1) & (oh->size - 1) ;
+      memcpy(ORIGINHASH_ENT(oh,h),ok,oh->width) ;
+      }
+    free(old) ;
+    }
+
+  h = mix64(origin) & (oh->size - 1) ;
+  while ((ok = ORIGINHASH_ENT(oh,h))->used) {
+    if (ok->origin == origin) return(ok) ;
+    h = (h + 1) & (oh->size - 1) ;
+    }
+  ok->used = 1 ;
+  ok->origin = origin ;
+  ++oh->nent ;
+  return(ok) ;
+}
+
+static int
+originkey_cmp(const void *a, const void *b)
+{
+  const struct originkey *ka = *(const struct originkey *const *) a ;
+  const struct originkey *kb = *(const struct originkey *const *) b ;
+
+  return((ka->origin < kb->origin) ? -1 : (ka->origin > kb->origin)) ;
+}
+
+/*--------------------------------------------------
+ * originhash_sorted, originhash_free
+ * a malloc'd list of the nent entries in AS order, or 0, and release
+ * the hash
+ */
+
+void **
+originhash_sorted(const struct originhash *oh)
+{
+  void **v ;
+  size_t i, n = 0 ;
+
+  if (!(v = (void **) malloc((oh->nent + 1) * sizeof *v))) return(0) ;
+  for (i = 0 ; i < oh->size ; ++i) if (ORIGINHASH_ENT(oh,i)->used) v[n++] = ORIGINHASH_ENT(oh,i) ;
+  qsort(v,n,sizeof *v,originkey_cmp) ;
+  return(v) ;
+}
+
+void
+originhash_free(struct originhash *oh)
+{
+  free(oh->ent) ;
+  oh->ent = 0 ;
+}
+
+
+/*--------------------------------------------------
+ * oa_table_space
+ * the number of v4 and v6 addresses of every origin in one pass over
+ * the compiled ranges, in AS order. Up to <max> are stored in <out>,
+ * and the number of origins is returned
+ */
+
+size_t
+oa_table_space(const oa_table *t, oa_space *out, size_t max)
+{
+  struct originhash oh ;
+  struct spaceent *se ;
+  void **v ;
+  u_int32_t last = 0 ;
+  size_t i, n ;
+
+  if (!t->built || !originhash_init(&oh,sizeof *se)) return(0) ;
+
+  /* neighbouring ranges mostly share their origin */
+  for (se = 0, i = 0 ; i < t->n4 ; ++i) {
+    if (!t->r4[i].origin_as) continue ;
+    if (!se || (t->r4[i].origin_as != last)) se = (struct spaceent *) originhash_entry(&oh,last = t->r4[i].origin_as) ;
+    if (se) se->addrs4 += (u_int64_t) t->r4[i].end - t->r4[i].start + 1 ;
+    }
+  for (se = 0, i = 0 ; i < t->n6 ; ++i) {
+    if (!t->r6[i].origin_as) continue ;
+    if (!se || (t->r6[i].origin_as != last)) se = (struct spaceent *) originhash_entry(&oh,last = t->r6[i].origin_as) ;
+    if (se) se->addrs6 += t->r6[i].end - t->r6[i].start + 1 ;
+    }
+
+  n = oh.nent ;
+  if ((v = originhash_sorted(&oh))) {
+    for (i = 0 ; (i < n) && (i < max) ; ++i) {
+      se = (struct spaceent *) v[i] ;
+      out[i].origin = se->k.origin ;
+      out[i].addrs4 = se->addrs4 ;
+      out[i].addrs6[0] = (uint64_t) (se->addrs6 >> 64) ;
+      out[i].addrs6[1] = (uint64_t) se->addrs6 ;
+      }
+    free(v) ;
+    }
+  else n = 0 ;
+  originhash_free(&oh) ;
+  return(n) ;
+}
@@ -0,0 +1,402 @@
+/* aspath.c
+
+   as path store and path queries
+
+   Paths are interned as a tree of AS nodes grown from the origin end:
+   the root's children are origins, their children the neighbours of
+   those origins, and so on, so every path that ends in the same origin
+   and transit tail shares those nodes. A path is then one node index -
+   its first AS - and the neighbour AS, origin, length and membership
+   of an AS all come from walking up toward the origin.
+
+   Child nodes are found through an open addressed hash on
+   (parent, asn), and the text of the last path is kept so a run of
+   prefixes with the same path is not parsed again.
+
+   Path text is read by one tokenizer, for paths that are kept and for
+   the origins of those that are not, so both agree on where a path
+   ends.
+
+*/
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "originas.h"
+
+#define PATH_MAXLEN 260           /* ASs held on the stack - longer paths go to the heap */
+
+
+/* path text is split into tokens at white space. A path is the run
+   of AS tokens - asplain 65551 or asdot 1.15 - up to the first token
+   that is not one (an AS set, an origin code) or is AS 0.
+
+   The tokenizer never writes to the text. It classifies 64 bytes at a
+   time into bit masks of digits and of white space, 16 bytes at a time
+   with SSE2 where the compiler has it, and walks the tokens with bit
+   scans. Digits are turned into a number 8 at a time within a 64 bit
+   word (SWAR), by three multiplies that each join neighbouring groups
+   of digits */
+
+#define PATH_WINDOW 64
+
+/* bit i of <digit> and <space> for byte <w>[i] up to <end> - past the
+   end every byte counts as space */
+
+static void
+path_classify(const unsigned char *w, const unsigned char *end, u_int64_t *digit, u_int64_t *space)
+{
+  u_int64_t d = 0, sp = 0 ;
+  int i = 0 ;
+
+#ifdef __SSE2__
+  const __m128i zero = _mm_set1_epi8('0') ;
+  const __m128i nine = _mm_set1_epi8(9) ;
+  const __m128i tab = _mm_set1_epi8('\t') ;
+  const __m128i four = _mm_set1_epi8(4) ;
+  const __m128i blank = _mm_set1_epi8(' ') ;
+  unsigned char tail[16] ;
+  const unsigned char *b ;
+  __m128i v, t ;
+
+  for ( ; (i < PATH_WINDOW) && (w + i < end) ; i += 16) {
+    /* the last few bytes are classified from a copy, as the text may
+       end just short of unmapped memory */
+    if (w + i + 16 <= end) b = w + i ;
+    else {
+      memset(tail,0,sizeof tail) ;
+      memcpy(tail,w + i,end - (w + i)) ;
+      b = tail ;
+      }
+    v = _mm_loadu_si128((const __m128i *) b) ;
+    t = _mm_sub_epi8(v,zero) ;
+    d |= (u_int64_t) (unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(t,nine),t)) << i ;
+    /* ' ', or '\t' to '\r' */
+    t = _mm_sub_epi8(v,tab) ;
+    sp |= (u_int64_t) (unsigned int) _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v,blank),
+                                                                    _mm_cmpeq_epi8(_mm_min_epu8(t,four),t))) << i ;
+    }
+  if (w + PATH_WINDOW > end) {
+    i = (int) (end - w) ;
+    d &= ~(~(u_int64_t) 0 << i) ;
+    }
+#else
+  for ( ; (i < PATH_WINDOW) && (w + i < end) ; ++i) {
+    if ((unsigned char) (w[i] - '0') <= 9) d |= (u_int64_t) 1 << i ;
+    else if ((w[i] == ' ') || ((unsigned char) (w[i] - '\t') <= 4)) sp |= (u_int64_t) 1 << i ;
+    }
+#endif
+  if (i < PATH_WINDOW) sp |= ~(u_int64_t) 0 << i ;
+  *digit = d ;
+  *space = sp ;
+}
+
+/* the value of the <n> (1 to 8) digits at <p>: the digits are loaded
+   as one little endian word (byte swapped on big endian hosts) and
+   shifted up so that the zero bytes below them are leading zeros, then
+   digit pairs, groups of 4 and of 8 are each joined by a multiply */
+
+static u_int64_t
+swar8(const unsigned char *p, const unsigned char *end, int n)
+{
+  u_int64_t v = 0 ;
+
+  if (p + 8 <= end) memcpy(&v,p,8) ;
+  else memcpy(&v,p,n) ;
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+  v = __builtin_bswap64(v) ;
+#endif
+  v -= 0x3030303030303030ULL ;
+  v <<= 8 * (8 - n) ;
+  v = (v * 10) + (v >> 8) ;
+  v = (((v & 0x000000ff000000ffULL) * (100 + (1000000ULL << 32))) +
+       (((v >> 16) & 0x000000ff000000ffULL) * (1 + (10000ULL << 32)))) >> 32 ;
+  return(v) ;
+}
+
+/* the value of the <n> digits at <p>, modulo 2^32 as strtoul would
+   give it once cast */
+
+static unsigned int
+path_number(const unsigned char *p, const unsigned char *end, int n)
+{
+  unsigned int v = 0 ;
+
+  if (n <= 8) return((unsigned int) swar8(p,end,n)) ;
+  if (n <= 16) return((unsigned int) ((swar8(p,end,n - 8) * 100000000ULL) + swar8(p + n - 8,end,8))) ;
+  while (n--) v = (v * 10) + (*p++ - '0') ;
+  return(v) ;
+}
+
+
+/*--------------------------------------------------
+ * path_scan
+ * the ASs of path text <path>, neighbour first: up to <max> are
+ * stored in <ases> (if it is not null) and their number returned,
+ * and the last one is stored in <last>
+ */
+
+static int
+path_scan(const char *path, unsigned int *ases, int max, unsigned int *last)
+{
+  const unsigned char *p = (const unsigned char *) path ;
+  const unsigned char *end = p + strlen(path) ;
+  const unsigned char *w = 0 ;
+  const unsigned char *q ;
+  u_int64_t digit = 0 ;
+  u_int64_t space = 0 ;
+  u_int64_t m ;
+  unsigned int asn ;
+  int n = 0 ;
+  int nd ;
+
+  *last = 0 ;
+  while (n < max) {
+    /* keep the window 32 bytes ahead of the token, enough for any AS */
+    if (!w || (p + 32 > w + PATH_WINDOW)) {
+      w = p ;
+      path_classify(w,end,&digit,&space) ;
+      }
+    if (!(m = ~space >> (p - w))) {
+      p = w + PATH_WINDOW ;
+      if (p >= end) break ;
+      continue ;
+      }
+    p += __builtin_ctzll(m) ;
+    if (p >= end) break ;
+    if (p + 32 > w + PATH_WINDOW) continue ;
+
+    /* the digits of the token, and those after a dot for asdot */
+    if ((m = ~digit >> (p - w))) nd = __builtin_ctzll(m) ;
+    else for (nd = 0 ; (p + nd < end) && ((unsigned char) (p[nd] - '0') <= 9) ; ++nd) ;
+    if (!nd) break ;
+    asn = path_number(p,end,nd) ;
+    q = p + nd ;
+    if ((q < end) && (*q == '.')) {
+      for (nd = 0, ++q ; (q + nd < end) && ((unsigned char) (q[nd] - '0') <= 9) ; ++nd) ;
+      asn = (asn << 16) + (nd ? path_number(q,end,nd) : 0) ;
+      q += nd ;
+      }
+    if (!asn) break ;
+    if (ases) ases[n] = asn ;
+    *last = asn ;
+    ++n ;
+
+    /* anything else in the token is passed over */
+    while ((q < end) && (*q != ' ') && ((unsigned char) (*q - '\t') > 4)) ++q ;
+    p = q ;
+    }
+  return(n) ;
+}
+
+
+static size_t
+path_hash(u_int32_t up, u_int32_t asn, size_t size)
+{
+  u_int64_t h = ((u_int64_t) up << 32) | asn ;
+
+  h *= 0x9e3779b97f4a7c15ULL ;
+  return((size_t) (h >> 32) & (size - 1)) ;
+}
+
+/* double the hash and put every node back in it */
+
+static void
+path_rehash(oa_table *t)
+{
+  size_t size = (t->hashsize ? t->hashsize * 2 : 4096) ;
+  size_t i, h ;
+
+  free(t->pathhash) ;
+  t->pathhash = (u_int32_t *) calloc(size,sizeof *t->pathhash) ;
+  t->hashsize = size ;
+  for (i = 1 ; i < t->npaths ; ++i) {
+    h = path_hash(t->paths[i].up,t->paths[i].asn,size) ;
+    while (t->pathhash[h]) h = (h + 1) & (size - 1) ;
+    t->pathhash[h] = (u_int32_t) i ;
+    }
+}
+
+
+/*--------------------------------------------------
+ * path_child
+ * the node for <asn> in front of path <up>, added if it is new
+ */
+
+static u_int32_t
+path_child(oa_table *t, u_int32_t up, u_int32_t asn)
+{
+  struct pathnode *pn ;
+  size_t h ;
+  u_int32_t i ;
+
+  if (2 * t->npaths >= t->hashsize) path_rehash(t) ;
+  h = path_hash(up,asn,t->hashsize) ;
+  while ((i = t->pathhash[h])) {
+    if ((t->paths[i].up == up) && (t->paths[i].asn == asn)) return(i) ;
+    h = (h + 1) & (t->hashsize - 1) ;
+    }
+
+  if (t->npaths == t->maxpaths) {
+    t->maxpaths = (t->maxpaths ? t->maxpaths * 2 : 4096) ;
+    t->paths = (struct pathnode *) realloc(t->paths,t->maxpaths * sizeof *t->paths) ;
+    }
+  i = (u_int32_t) t->npaths++ ;
+  pn = &t->paths[i] ;
+  pn->asn = asn ;
+  pn->up = up ;
+  pn->origin_as = (up ? t->paths[up].origin_as : asn) ;
+  pn->len = t->paths[up].len + 1 ;
+  t->pathhash[h] = i ;
+  return(i) ;
+}
+
+
+/*--------------------------------------------------
+ * parse_aspath
+ * intern the path in text <aspath> and return its node, 0 for
+ * a path with no ASs. The path ends at an AS set, if there is one
+ */
+
+u_int32_t
+parse_aspath(oa_table *t, char *aspath)
+{
+  unsigned int local[PATH_MAXLEN] ;
+  unsigned int *ases = local ;
+  unsigned int last ;
+  u_int32_t node = 0 ;
+  size_t max ;
+  int asl ;
+
+  /* if the path is the same as the last path then add this prefix in */
+  if (t->npaths && !strcmp(t->lastpathtext,aspath)) return(t->lastpath) ;
+
+  if (!t->npaths) {
+    t->paths = (struct pathnode *) malloc(4096 * sizeof *t->paths) ;
+    t->maxpaths = 4096 ;
+    memset(&t->paths[0],0,sizeof t->paths[0]) ;
+    t->npaths = 1 ;
+    }
+
+  /* every AS takes a digit and a separator, so this is room for all */
+  if ((max = (strlen(aspath) + 1) / 2) > PATH_MAXLEN) {
+    if (max > INT_MAX) max = INT_MAX ;
+    ases = (unsigned int *) malloc(max * sizeof *ases) ;
+    }
+  else max = PATH_MAXLEN ;
+  asl = path_scan(aspath,ases,(int) max,&last) ;
+  while (asl) node = path_child(t,node,ases[--asl]) ;
+  if (ases != local) free(ases) ;
+
+  strncpy(t->lastpathtext,aspath,sizeof t->lastpathtext - 1) ;
+  t->lastpathtext[sizeof t->lastpathtext - 1] = '\0' ;
+  t->lastpath = node ;
+  return(node) ;
+}
+
+
+/*--------------------------------------------------
+ * aspath_origin
+ * the origin AS of the path in text <aspath>, 0 if there is none, for
+ * tables that do not keep paths - the last of the ASs parse_aspath()
+ * would read. Nothing is stored, so this may run outside the table's
+ * thread
+ */
+
+u_int32_t
+aspath_origin(char *aspath)
+{
+  unsigned int origin ;
+
+  path_scan(aspath,0,INT_MAX,&origin) ;
+  return(origin) ;
+}
+
+void
+free_aspaths(oa_table *t)
+{
+  free(t->paths) ;
+  free(t->pathhash) ;
+  t->paths = 0 ;
+  t->pathhash = 0 ;
+  t->npaths = t->maxpaths = t->hashsize = 0 ;
+}
+
+
+/*--------------------------------------------------------------------------------------------------*/
+
+/*
+ * path queries
+ */
+
+static const struct pathnode *
+path_node(const oa_table *t, uint32_t path)
+{
+  if (!path || (path >= t->npaths)) return(0) ;
+  return(&t->paths[path]) ;
+}
+
+uint32_t
+oa_lookup_path(const oa_table *t, oa_cursor *c, const char *field)
+{
+  char f[128] ;
+  char *p = 0 ;
+  u_int32_t path = 0 ;
+
+  strncpy(f,field,sizeof f - 1) ;
+  f[sizeof f - 1] = '\0' ;
+  originas(t,c,f,&p,&path) ;
+  return(path) ;
+}
+
+uint32_t
+oa_path_length(const oa_table *t, uint32_t path)
+{
+  const struct pathnode *pn = path_node(t,path) ;
+
+  return(pn ? pn->len : 0) ;
+}
+
+uint32_t
+oa_path_neighbour(const oa_table *t, uint32_t path)
+{
+  const struct pathnode *pn = path_node(t,path) ;
+
+  return(pn ? pn->asn : 0) ;
+}
+
+uint32_t
+oa_path_origin(const oa_table *t, uint32_t path)
+{
+  const struct pathnode *pn = path_node(t,path) ;
+
+  return(pn ? pn->origin_as : 0) ;
+}
+
+int
+oa_path_contains(const oa_table *t, uint32_t path, uint32_t asn)
+{
+  const struct pathnode *pn ;
+
+  for (pn = path_node(t,path) ; pn ; pn = path_node(t,pn->up)) {
+    if (pn->asn == asn) return(1) ;
+    }
+  return(0) ;
+}
+
+size_t
+oa_path_get(const oa_table *t, uint32_t path, uint32_t *ases, size_t max)
+{
+  const struct pathnode *pn ;
+  size_t n = 0 ;
+
+  for (pn = path_node(t,path) ; pn ; pn = path_node(t,pn->up)) {
+    if (n < max) ases[n] = pn->asn ;
+    ++n ;
+    }
+  return(n) ;
+}
@@ -0,0 +1,12 @@
+/* btree.c
+
+   the B+-trees of announced prefixes that incremental tables load into
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#define BT_IMPLEMENT
+#include "originas.h"
@@ -0,0 +1,345 @@
+/* btree.h
+
+   B+-tree template, included once per key type
+
+     #define BT_NAME   pfxtree4          prefix of the type and functions
+     #define BT_KEY    u_int64_t         key type, stored inline
+     #define BT_VAL    struct pfxval     value type, stored inline
+     #define BT_LESS(a,b) ((a) < (b))    key order
+     #define BT_NODE   256               node size in bytes
+     #include "btree.h"
+
+   declares struct BT_NAME and its functions, and defines the functions
+   as well where BT_IMPLEMENT is defined (btree.c).
+
+   Nodes are a few cache lines each, aligned to a line, with the keys of
+   a node side by side so a search reads a handful of lines per level
+   instead of chasing one pointer per key. The leaves are linked in key
+   order for scans. Nodes are not rebalanced on removal: a node is only
+   freed once it is empty, which keeps removal cheap, and as the tables
+   mostly grow the nodes stay well filled.
+
+*/
+
+#define BT_CAT_(a,b)  a##b
+#define BT_CAT(a,b)   BT_CAT_(a,b)
+#define BT_FN(f)      BT_CAT(BT_NAME,f)
+#define BT_LEAF       BT_FN(_leaf)
+#define BT_INNER      BT_FN(_inner)
+
+/* the leaf and inner node capacities that fill BT_NODE bytes */
+
+#define BT_LEAF_MAX   ((BT_NODE - 2 * sizeof(void *) - 8) / (sizeof(BT_KEY) + sizeof(BT_VAL)))
+#define BT_INNER_MAX  ((BT_NODE - sizeof(void *) - 8) / (sizeof(BT_KEY) + sizeof(void *)))
+
+struct BT_LEAF {
+  int n ;
+  int leaf ;
+  struct BT_LEAF *next ;
+  struct BT_LEAF *prev ;
+  BT_KEY key[BT_LEAF_MAX] ;
+  BT_VAL val[BT_LEAF_MAX] ;
+  } ;
+
+/* child i holds the keys from key[i - 1] up to, not including, key[i] */
+
+struct BT_INNER {
+  int n ;
+  int leaf ;
+  BT_KEY key[BT_INNER_MAX] ;
+  void *child[BT_INNER_MAX + 1] ;
+  } ;
+
+struct BT_NAME {
+  void *root ;
+  struct BT_LEAF *first ;
+  size_t n ;
+  } ;
+
+extern BT_VAL *BT_FN(_find)(const struct BT_NAME *, BT_KEY) ;
+extern BT_VAL *BT_FN(_insert)(struct BT_NAME *, BT_KEY, int *) ;
+extern int BT_FN(_remove)(struct BT_NAME *, BT_KEY, BT_VAL *) ;
+extern struct BT_LEAF *BT_FN(_seek)(const struct BT_NAME *, BT_KEY, int *) ;
+extern void BT_FN(_free)(struct BT_NAME *) ;
+
+
+#ifdef BT_IMPLEMENT
+
+static void *
+BT_FN(_node)(int leaf)
+{
+  void *p ;
+
+  if (posix_memalign(&p,64,leaf ? sizeof(struct BT_LEAF) : sizeof(struct BT_INNER))) return(0) ;
+  memset(p,0,leaf ? sizeof(struct BT_LEAF) : sizeof(struct BT_INNER)) ;
+  ((struct BT_LEAF *) p)->leaf = leaf ;
+  return(p) ;
+}
+
+/* the child of inner node <in> that holds <k> */
+
+static int
+BT_FN(_child)(const struct BT_INNER *in, BT_KEY k)
+{
+  int i = 0 ;
+
+  while ((i < in->n) && !BT_LESS(k,in->key[i])) ++i ;
+  return(i) ;
+}
+
+/* the first key of leaf <lf> not below <k> */
+
+static int
+BT_FN(_slot)(const struct BT_LEAF *lf, BT_KEY k)
+{
+  int i = 0 ;
+
+  while ((i < lf->n) && BT_LESS(lf->key[i],k)) ++i ;
+  return(i) ;
+}
+
+
+/*--------------------------------------------------
+ * _seek
+ * the leaf, and in <pos> the slot, of the first key not below <k>.
+ * The slot may be one past the end of the leaf - the key, if there is
+ * one, is then the first of the next leaf
+ */
+
+struct BT_LEAF *
+BT_FN(_seek)(const struct BT_NAME *bt, BT_KEY k, int *pos)
+{
+  void *p = bt->root ;
+
+  if (!p) return(0) ;
+  while (!((struct BT_LEAF *) p)->leaf)
+    p = ((struct BT_INNER *) p)->child[BT_FN(_child)((struct BT_INNER *) p,k)] ;
+  *pos = BT_FN(_slot)((struct BT_LEAF *) p,k) ;
+  return((struct BT_LEAF *) p) ;
+}
+
+BT_VAL *
+BT_FN(_find)(const struct BT_NAME *bt, BT_KEY k)
+{
+  struct BT_LEAF *lf ;
+  int i ;
+
+  if (!(lf = BT_FN(_seek)(bt,k,&i)) || (i == lf->n) || BT_LESS(k,lf->key[i])) return(0) ;
+  return(&lf->val[i]) ;
+}
+
+
+/* insert below node <p>. If the node splits, the new right half is
+   returned with its first key in <up> */
+
+static void *
+BT_FN(_ins)(struct BT_NAME *bt, void *p, BT_KEY k, BT_VAL **slot, BT_KEY *up)
+{
+  struct BT_LEAF *lf, *rl ;
+  struct BT_INNER *in, *ri ;
+  void *split ;
+  BT_KEY sk ;
+  int i, h ;
+
+  if (((struct BT_LEAF *) p)->leaf) {
+    lf = (struct BT_LEAF *) p ;
+    i = BT_FN(_slot)(lf,k) ;
+    if ((i < lf->n) && !BT_LESS(k,lf->key[i])) {
+      *slot = &lf->val[i] ;
+      return(0) ;
+      }
+    rl = 0 ;
+    if (lf->n == (int) BT_LEAF_MAX) {
+      /* move the top half to a new leaf and insert into one of them */
+      rl = (struct BT_LEAF *) BT_FN(_node)(1) ;
+      h = lf->n / 2 ;
+      rl->n = lf->n - h ;
+      memcpy(rl->key,lf->key + h,rl->n * sizeof(BT_KEY)) ;
+      memcpy(rl->val,lf->val + h,rl->n * sizeof(BT_VAL)) ;
+      lf->n = h ;
+      rl->next = lf->next ;
+      rl->prev = lf ;
+      if (lf->next) lf->next->prev = rl ;
+      lf->next = rl ;
+      if (i > h) {
+        lf = rl ;
+        i -= h ;
+        }
+      }
+    memmove(lf->key + i + 1,lf->key + i,(lf->n - i) * sizeof(BT_KEY)) ;
+    memmove(lf->val + i + 1,lf->val + i,(lf->n - i) * sizeof(BT_VAL)) ;
+    lf->key[i] = k ;
+    memset(&lf->val[i],0,sizeof(BT_VAL)) ;
+    ++lf->n ;
+    ++bt->n ;
+    *slot = &lf->val[i] ;
+    if (rl) *up = rl->key[0] ;
+    return(rl) ;
+    }
+
+  in = (struct BT_INNER *) p ;
+  i = BT_FN(_child)(in,k) ;
+  if (!(split = BT_FN(_ins)(bt,in->child[i],k,slot,&sk))) return(0) ;
+
+  ri = 0 ;
+  if (in->n == (int) BT_INNER_MAX) {
+    /* the middle key moves up, the keys above it to a new node */
+    ri = (struct BT_INNER *) BT_FN(_node)(0) ;
+    h = in->n / 2 ;
+    *up = in->key[h] ;
+    ri->n = in->n - h - 1 ;
+    memcpy(ri->key,in->key + h + 1,ri->n * sizeof(BT_KEY)) ;
+    memcpy(ri->child,in->child + h + 1,(ri->n + 1) * sizeof(void *)) ;
+    in->n = h ;
+    if (i > h) {
+      in = ri ;
+      i -= h + 1 ;
+      }
+    }
+  memmove(in->key + i + 1,in->key + i,(in->n - i) * sizeof(BT_KEY)) ;
+  memmove(in->child + i + 2,in->child + i + 1,(in->n - i) * sizeof(void *)) ;
+  in->key[i] = sk ;
+  in->child[i + 1] = split ;
+  ++in->n ;
+  return(ri) ;
+}
+
+/*--------------------------------------------------
+ * _insert
+ * the value of key <k>, added (zeroed) if it is new, with <inserted>
+ * set to say which. The value may move with the next change to the tree
+ */
+
+BT_VAL *
+BT_FN(_insert)(struct BT_NAME *bt, BT_KEY k, int *inserted)
+{
+  struct BT_INNER *root ;
+  BT_VAL *slot ;
+  BT_KEY up ;
+  size_t n = bt->n ;
+  void *split ;
+
+  if (!bt->root) bt->root = bt->first = (struct BT_LEAF *) BT_FN(_node)(1) ;
+  if ((split = BT_FN(_ins)(bt,bt->root,k,&slot,&up))) {
+    root = (struct BT_INNER *) BT_FN(_node)(0) ;
+    root->n = 1 ;
+    root->key[0] = up ;
+    root->child[0] = bt->root ;
+    root->child[1] = split ;
+    bt->root = root ;
+    }
+  *inserted = (bt->n != n) ;
+  return(slot) ;
+}
+
+
+/* remove from below node <p>, return 1 if the node is left empty (and
+   has been freed) */
+
+static int
+BT_FN(_rem)(struct BT_NAME *bt, void *p, BT_KEY k, BT_VAL *old, int *found)
+{
+  struct BT_LEAF *lf ;
+  struct BT_INNER *in ;
+  int i ;
+
+  if (((struct BT_LEAF *) p)->leaf) {
+    lf = (struct BT_LEAF *) p ;
+    i = BT_FN(_slot)(lf,k) ;
+    if ((i == lf->n) || BT_LESS(k,lf->key[i])) return(0) ;
+    *found = 1 ;
+    if (old) *old = lf->val[i] ;
+    --lf->n ;
+    memmove(lf->key + i,lf->key + i + 1,(lf->n - i) * sizeof(BT_KEY)) ;
+    memmove(lf->val + i,lf->val + i + 1,(lf->n - i) * sizeof(BT_VAL)) ;
+    --bt->n ;
+    if (lf->n || (lf == bt->root)) return(0) ;
+    if (lf->prev) lf->prev->next = lf->next ;
+    else bt->first = lf->next ;
+    if (lf->next) lf->next->prev = lf->prev ;
+    free(lf) ;
+    return(1) ;
+    }
+
+  in = (struct BT_INNER *) p ;
+  i = BT_FN(_child)(in,k) ;
+  if (!BT_FN(_rem)(bt,in->child[i],k,old,found)) return(0) ;
+
+  /* drop the empty child with the key that separates it */
+  if (!in->n) {
+    free(in) ;
+    return(1) ;
+    }
+  if (i) {
+    memmove(in->key + i - 1,in->key + i,(in->n - i) * sizeof(BT_KEY)) ;
+    memmove(in->child + i,in->child + i + 1,(in->n - i) * sizeof(void *)) ;
+    }
+  else {
+    memmove(in->key,in->key + 1,(in->n - 1) * sizeof(BT_KEY)) ;
+    memmove(in->child,in->child + 1,in->n * sizeof(void *)) ;
+    }
+  --in->n ;
+  return(0) ;
+}
+
+/*--------------------------------------------------
+ * _remove
+ * remove key <k>, with its value copied to <old> if that is not 0.
+ * Return 0 if there is no such key
+ */
+
+int
+BT_FN(_remove)(struct BT_NAME *bt, BT_KEY k, BT_VAL *old)
+{
+  struct BT_INNER *in ;
+  int found = 0 ;
+
+  if (!bt->root) return(0) ;
+  if (BT_FN(_rem)(bt,bt->root,k,old,&found)) {
+    bt->root = 0 ;
+    bt->first = 0 ;
+    }
+
+  /* an inner root left with one child hands the root down to it */
+  while (bt->root && !((struct BT_LEAF *) bt->root)->leaf && !((struct BT_INNER *) bt->root)->n) {
+    in = (struct BT_INNER *) bt->root ;
+    bt->root = in->child[0] ;
+    free(in) ;
+    }
+  return(found) ;
+}
+
+
+static void
+BT_FN(_freenode)(void *p)
+{
+  struct BT_INNER *in = (struct BT_INNER *) p ;
+  int i ;
+
+  if (!in->leaf) {
+    for (i = 0 ; i <= in->n ; ++i) BT_FN(_freenode)(in->child[i]) ;
+    }
+  free(p) ;
+}
+
+void
+BT_FN(_free)(struct BT_NAME *bt)
+{
+  if (bt->root) BT_FN(_freenode)(bt->root) ;
+  memset(bt,0,sizeof *bt) ;
+}
+
+#endif
+
+#undef BT_LEAF_MAX
+#undef BT_INNER_MAX
+#undef BT_LEAF
+#undef BT_INNER
+#undef BT_FN
+#undef BT_CAT
+#undef BT_CAT_
+#undef BT_NAME
+#undef BT_KEY
+#undef BT_VAL
+#undef BT_LESS
+#undef BT_NODE
@@ -0,0 +1,243 @@
+/* dumpread.c
+
+   block reader for bgp dump files
+
+   The dump is read in large blocks (through zlib for .gz files) and
+   split into lines in place, so a line costs one scan for its newline
+   and nothing is copied. Lines are handed out NUL terminated, without
+   the newline, and stay valid until the next dump_line() call.
+
+   dump_block() instead hands out whole blocks of lines, each ending
+   just before an entry line with a network, so that every block can be
+   parsed on its own - nothing carries over from the block before it.
+
+   The scans for newlines and for the spaces that end the columns are
+   done 16 bytes at a time with SSE2 where the compiler has it.
+
+*/
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <zlib.h>
+#include <sys/types.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "originas.h"
+
+char *strcasestr(const char *haystack, const char *needle);
+
+#define DUMP_BLOCK (1 << 20)
+
+
+/*--------------------------------------------------
+ * scan_byte
+ * the first <c> in <p> up to <end>, or 0
+ */
+
+const char *
+scan_byte(const char *p, const char *end, int c)
+{
+#ifdef __SSE2__
+  const __m128i pat = _mm_set1_epi8((char) c) ;
+  int m ;
+
+  while (p + 16 <= end) {
+    if ((m = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) p),pat))))
+      return(p + __builtin_ctz(m)) ;
+    p += 16 ;
+    }
+#endif
+  for ( ; p < end ; ++p) if (*p == c) return(p) ;
+  return(0) ;
+}
+
+/*--------------------------------------------------
+ * scan_space
+ * the first white space character in <p> up to <end>, or <end>
+ */
+
+const char *
+scan_space(const char *p, const char *end)
+{
+#ifdef __SSE2__
+  /* every space is at or below ' ' - find those bytes 16 at a time
+     and let isspace() pass over any other control character */
+  const __m128i top = _mm_set1_epi8(' ') ;
+  __m128i v ;
+  int m ;
+
+  while (p + 16 <= end) {
+    v = _mm_loadu_si128((const __m128i *) p) ;
+    m = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(v,top),v)) ;
+    while (m) {
+      if (isspace((unsigned char) p[__builtin_ctz(m)])) return(p + __builtin_ctz(m)) ;
+      m &= m - 1 ;
+      }
+    p += 16 ;
+    }
+#endif
+  for ( ; p < end ; ++p) if (isspace((unsigned char) *p)) return(p) ;
+  return(end) ;
+}
+
+
+/*--------------------------------------------------
+ * dump_open
+ * open <filename> for dump_line(), through zlib if its name has .gz
+ * return 0 if it cannot be opened
+ */
+
+int
+dump_open(struct dumpfile *df, const char *filename)
+{
+  memset(df,0,sizeof *df) ;
+  df->fd = -1 ;
+  if (strcasestr(filename,".gz")) {
+    if (!(df->gz = gzopen(filename,"r"))) return(0) ;
+    gzbuffer(df->gz,DUMP_BLOCK) ;
+    }
+  else if ((df->fd = open(filename,O_RDONLY)) < 0) return(0) ;
+  df->size = DUMP_BLOCK ;
+  if (!(df->buf = (char *) malloc(df->size + 1))) {
+    dump_close(df) ;
+    return(0) ;
+    }
+  return(1) ;
+}
+
+void
+dump_close(struct dumpfile *df)
+{
+  if (df->gz) gzclose(df->gz) ;
+  if (df->fd >= 0) close(df->fd) ;
+  free(df->buf) ;
+  df->gz = 0 ;
+  df->fd = -1 ;
+  df->buf = 0 ;
+}
+
+/* move the unread tail to the front of the buffer and read more after
+   it, growing the buffer if one line fills it. Return 0 at the end */
+
+static int
+dump_fill(struct dumpfile *df)
+{
+  ssize_t r ;
+
+  if (df->eof) return(0) ;
+  if (df->pos) {
+    memmove(df->buf,df->buf + df->pos,df->len - df->pos) ;
+    df->len -= df->pos ;
+    df->pos = 0 ;
+    }
+  if (df->len == df->size) {
+    df->size *= 2 ;
+    df->buf = (char *) realloc(df->buf,df->size + 1) ;
+    }
+  do {
+    if (df->gz) r = gzread(df->gz,df->buf + df->len,df->size - df->len) ;
+    else r = read(df->fd,df->buf + df->len,df->size - df->len) ;
+    } while ((r < 0) && !df->gz && (errno == EINTR)) ;
+  if (r <= 0) {
+    df->eof = 1 ;
+    return(0) ;
+    }
+  df->len += r ;
+  return(1) ;
+}
+
+
+/*--------------------------------------------------
+ * dump_line
+ * the next line, with its length (less the newline) in <n>, and
+ * df->lf set if it ended in a newline. Return 0 at the end of the file
+ */
+
+char *
+dump_line(struct dumpfile *df, size_t *n)
+{
+  const char *nl ;
+  size_t from = df->pos ;
+  char *line ;
+
+  while (!(nl = scan_byte(df->buf + from,df->buf + df->len,'\n'))) {
+    from = df->len - df->pos ;
+    if (!dump_fill(df)) break ;
+    }
+  if (!nl && (df->pos == df->len)) return(0) ;
+
+  line = df->buf + df->pos ;
+  if (nl) {
+    *n = nl - line ;
+    df->lf = 1 ;
+    df->pos += *n + 1 ;
+    }
+  else {
+    *n = df->len - df->pos ;
+    df->lf = 0 ;
+    df->pos = df->len ;
+    }
+  line[*n] = '\0' ;
+  return(line) ;
+}
+
+
+/* a line at <p> starts an entry if it is a route with a network - a
+   header line never starts with '*' and a continuation line is blank
+   up to its next hop */
+
+static int
+entry_start(const char *p, const char *end)
+{
+  if ((end - p < 4) || (p[0] != '*')) return(0) ;
+  return(!isspace((unsigned char) p[3]) && (p[1] != '\n') && (p[2] != '\n')) ;
+}
+
+
+/*--------------------------------------------------
+ * dump_block
+ * the next block of at least DUMP_BLOCK bytes (unless the file ends
+ * first), cut before an entry line, with its length in <n>. The block
+ * is the caller's to free, and has room for a NUL after it. Return 0 at
+ * the end of the file
+ */
+
+char *
+dump_block(struct dumpfile *df, size_t *n)
+{
+  const char *cp ;
+  const char *end ;
+  char *blk ;
+  size_t cut = 0 ;
+
+  while (!cut) {
+    if ((df->len < DUMP_BLOCK) && dump_fill(df)) continue ;
+    if (df->eof) {
+      if (!df->len) return(0) ;
+      cut = df->len ;
+      break ;
+      }
+
+    /* the last entry line in the buffer, looking back from the end */
+    end = df->buf + df->len ;
+    for (cp = end ; cp > df->buf ; --cp) {
+      if ((cp[-1] == '\n') && entry_start(cp,end)) break ;
+      }
+    if ((cp > df->buf) && (cp < end)) cut = cp - df->buf ;
+    else dump_fill(df) ;
+    }
+
+  /* hand the buffer over and keep what follows the cut in a new one */
+  blk = df->buf ;
+  *n = cut ;
+  df->buf = (char *) malloc(df->size + 1) ;
+  memcpy(df->buf,blk + cut,df->len - cut) ;
+  df->len -= cut ;
+  df->pos = 0 ;
+  return(blk) ;
+}
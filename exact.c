@@ -0,0 +1,147 @@
+/* exact.c
+
+   one probe lookups of announced prefixes
+
+   Fields are often prefixes exactly as they were announced (from IRR
+   or ROA data, say), which the range search would answer with the
+   origin of their first address. A table made with OA_EXACT_INDEX also
+   hashes every announced prefix on (start, length), into one open
+   addressed table per family at no more than half full, so such a
+   field is answered in about one probe with the origin that announced
+   it. Anything else - a miss, an address, a prefix with host bits set -
+   goes on to the range search.
+
+   Start 0 is never announced (the loader drops the default route), so
+   it marks an empty slot.
+
+*/
+
+#include <stdlib.h>
+#include <sys/types.h>
+#include "originas.h"
+
+
+static u_int64_t
+hash6(u_int128_t start, int mask)
+{
+  return(mix64((u_int64_t) start ^ mix64((u_int64_t) (start >> 64) ^ (u_int64_t) mask))) ;
+}
+
+/* a power of 2 of at least twice <n> slots */
+
+static size_t
+exact_size(size_t n)
+{
+  size_t size = 16 ;
+
+  while (size < 2 * n) size <<= 1 ;
+  return(size) ;
+}
+
+
+/*--------------------------------------------------
+ * exact4_build, exact6_build
+ * hash the announced prefixes of a table being built, before they
+ * are deaggregated, on huge pages if there are any. Tables that keep
+ * prefixes keep their text too
+ */
+
+void
+exact4_build(oa_table *t)
+{
+  struct addr4 *ap ;
+  size_t n = 0, h ;
+  u_int64_t key ;
+
+  for (ap = t->v4head ; ap ; ap = ap->nxt) ++n ;
+  t->exsize4 = exact_size(n) ;
+  t->ex4 = (struct exact4 *) huge_alloc(&t->ex4mem,t->exsize4 * sizeof *t->ex4) ;
+  if (t->flags & OA_KEEP_PREFIX) t->exaddr4 = (char **) calloc(t->exsize4,sizeof *t->exaddr4) ;
+  for (ap = t->v4head ; ap ; ap = ap->nxt) {
+    key = ((u_int64_t) ap->start << 8) | (u_int64_t) ap->mask ;
+    h = mix64(key) & (t->exsize4 - 1) ;
+    while (t->ex4[h].key && (t->ex4[h].key != key)) h = (h + 1) & (t->exsize4 - 1) ;
+    if (t->ex4[h].key) continue ;
+    t->ex4[h].key = key ;
+    t->ex4[h].origin_as = ap->origin_as ;
+    t->ex4[h].path = ap->path ;
+    if (t->exaddr4) t->exaddr4[h] = ap->address ;
+    }
+}
+
+void
+exact6_build(oa_table *t)
+{
+  struct addr6 *ap ;
+  size_t n = 0, h ;
+
+  for (ap = t->v6head ; ap ; ap = ap->nxt) ++n ;
+  t->exsize6 = exact_size(n) ;
+  t->ex6 = (struct exact6 *) huge_alloc(&t->ex6mem,t->exsize6 * sizeof *t->ex6) ;
+  if (t->flags & OA_KEEP_PREFIX) t->exaddr6 = (char **) calloc(t->exsize6,sizeof *t->exaddr6) ;
+  for (ap = t->v6head ; ap ; ap = ap->nxt) {
+    h = hash6(ap->start,ap->mask) & (t->exsize6 - 1) ;
+    while (t->ex6[h].start && ((t->ex6[h].start != ap->start) || (t->ex6[h].mask != ap->mask)))
+      h = (h + 1) & (t->exsize6 - 1) ;
+    if (t->ex6[h].start) continue ;
+    t->ex6[h].start = ap->start ;
+    t->ex6[h].mask = (u_int8_t) ap->mask ;
+    t->ex6[h].origin_as = ap->origin_as ;
+    t->ex6[h].path = ap->path ;
+    if (t->exaddr6) t->exaddr6[h] = ap->address ;
+    }
+}
+
+void
+exact_free(oa_table *t)
+{
+  huge_free(&t->ex4mem) ;
+  free(t->exaddr4) ;
+  huge_free(&t->ex6mem) ;
+  free(t->exaddr6) ;
+}
+
+
+/*--------------------------------------------------
+ * exact4_origin, exact6_origin
+ * look prefix <start>/<mask> up in the hash. Return 1 and set the
+ * origin, prefix text and path if it was announced, else return 0
+ */
+
+int
+exact4_origin(const oa_table *t, u_int32_t start, int mask, unsigned int *as, char **p, u_int32_t *path)
+{
+  u_int64_t key ;
+  size_t h ;
+
+  if (!t->ex4 || (mask < 1) || (mask > 32) || (start & (u_int32_t) ((((u_int64_t) 1) << (32 - mask)) - 1)))
+    return(0) ;
+  key = ((u_int64_t) start << 8) | (u_int64_t) mask ;
+  h = mix64(key) & (t->exsize4 - 1) ;
+  while (t->ex4[h].key != key) {
+    if (!t->ex4[h].key) return(0) ;
+    h = (h + 1) & (t->exsize4 - 1) ;
+    }
+  *as = t->ex4[h].origin_as ;
+  *p = (t->exaddr4 ? t->exaddr4[h] : 0) ;
+  if (path) *path = t->ex4[h].path ;
+  return(1) ;
+}
+
+int
+exact6_origin(const oa_table *t, u_int128_t start, int mask, unsigned int *as, char **p, u_int32_t *path)
+{
+  size_t h ;
+
+  if (!t->ex6 || (mask < 1) || (mask > 128) || ((mask < 128) && (start & (((u_int128_t) 1 << (128 - mask)) - 1))))
+    return(0) ;
+  h = hash6(start,mask) & (t->exsize6 - 1) ;
+  while ((t->ex6[h].start != start) || (t->ex6[h].mask != mask)) {
+    if (!t->ex6[h].start) return(0) ;
+    h = (h + 1) & (t->exsize6 - 1) ;
+    }
+  *as = t->ex6[h].origin_as ;
+  *p = (t->exaddr6 ? t->exaddr6[h] : 0) ;
+  if (path) *path = t->ex6[h].path ;
+  return(1) ;
+}
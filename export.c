@@ -0,0 +1,577 @@
+/* export.c
+
+   write the whole deaggregated table, v4 then v6
+
+   csv      one line per range:  start,end,origin[,prefix]
+            with OA_FMT_CIDR:    prefix,origin[,announced prefix]
+            the announced prefix column is only present for tables
+            built with OA_KEEP_PREFIX
+
+   binary   a 16 byte header, "OAX1", a flags word and the number
+            of v4 and v6 records as 32 bit counts, followed by the
+            records. All numbers are in network byte order
+
+              v4 range   start(4) end(4) origin(4)
+              v6 range   start(16) end(16) origin(4)
+              v4 cidr    start(4) length(1) origin(4)
+              v6 cidr    start(16) length(1) origin(4)
+
+   diff     one line per range whose origin differs between two tables:
+            start,end,old origin,new origin - 0 where the range is
+            not announced
+
+   Text is formatted by hand into a large buffer that is written out
+   when full, so a full table export is bound by the write speed.
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include "originas.h"
+
+#define EXPORT_BUFSIZE (1 << 20)
+
+struct outbuf {
+  int fd ;
+  int err ;
+  size_t len ;
+  char *buf ;
+  } ;
+
+
+static void
+ob_flush(struct outbuf *ob)
+{
+  size_t off = 0 ;
+  ssize_t w ;
+
+  while (!ob->err && (off < ob->len)) {
+    if ((w = write(ob->fd,ob->buf + off,ob->len - off)) < 0) {
+      if (errno == EINTR) continue ;
+      ob->err = 1 ;
+      }
+    else off += w ;
+    }
+  ob->len = 0 ;
+}
+
+/* make room for <n> more bytes and return where they go */
+
+static char *
+ob_room(struct outbuf *ob, size_t n)
+{
+  if (ob->len + n > EXPORT_BUFSIZE) ob_flush(ob) ;
+  return(ob->buf + ob->len) ;
+}
+
+static char *
+putdec(char *cp, u_int32_t v)
+{
+  char tmp[12] ;
+  int i = 0 ;
+
+  do {
+    tmp[i++] = '0' + (v % 10) ;
+    v /= 10 ;
+    } while (v) ;
+  while (i) *cp++ = tmp[--i] ;
+  return(cp) ;
+}
+
+static char *
+put32(char *cp, u_int32_t v)
+{
+  *cp++ = v >> 24 ;
+  *cp++ = v >> 16 ;
+  *cp++ = v >> 8 ;
+  *cp++ = v ;
+  return(cp) ;
+}
+
+static char *
+put128(char *cp, u_int128_t v)
+{
+  int i ;
+
+  for (i = 120 ; i >= 0 ; i -= 8) *cp++ = (unsigned char) (v >> i) ;
+  return(cp) ;
+}
+
+/* prefix length of the largest block that starts at <s> and ends at or before <e> */
+
+int
+cidr4(u_int32_t s, u_int32_t e)
+{
+  int len = (s ? 32 - __builtin_ctz(s) : 0) ;
+
+  while ((len < 32) && ((u_int64_t) s + ((u_int64_t) 1 << (32 - len)) - 1 > e)) ++len ;
+  return(len) ;
+}
+
+int
+cidr6(u_int128_t s, u_int128_t e)
+{
+  u_int64_t lo = (u_int64_t) s ;
+  u_int64_t hi = (u_int64_t) (s >> 64) ;
+  int len ;
+
+  if (lo) len = 128 - __builtin_ctzll(lo) ;
+  else if (hi) len = 64 - __builtin_ctzll(hi) ;
+  else if (e == ~(u_int128_t) 0) return(0) ;
+  else len = 1 ;
+  while ((len < 128) && (s + (((u_int128_t) 1 << (128 - len)) - 1) > e)) ++len ;
+  return(len) ;
+}
+
+
+/* what is written is the ranges, or for a table that keeps prefixes the
+   pieces of each range, so every line carries the prefix it came from */
+
+static size_t
+spans4(const oa_table *t)
+{
+  return((t->flags & OA_KEEP_PREFIX) ? t->np4 : t->n4) ;
+}
+
+static size_t
+spans6(const oa_table *t)
+{
+  return((t->flags & OA_KEEP_PREFIX) ? t->np6 : t->n6) ;
+}
+
+static void
+span4(const oa_table *t, size_t i, u_int32_t *start, u_int32_t *end, u_int32_t *origin, const char **address)
+{
+  if (t->flags & OA_KEEP_PREFIX) {
+    *start = t->p4[i].start ;
+    *end = t->p4[i].end ;
+    *origin = t->p4[i].origin_as ;
+    *address = t->p4[i].address ;
+    }
+  else {
+    *start = t->r4[i].start ;
+    *end = t->r4[i].end ;
+    *origin = t->r4[i].origin_as ;
+    *address = 0 ;
+    }
+}
+
+static void
+span6(const oa_table *t, size_t i, u_int128_t *start, u_int128_t *end, u_int32_t *origin, const char **address)
+{
+  if (t->flags & OA_KEEP_PREFIX) {
+    *start = t->p6[i].start ;
+    *end = t->p6[i].end ;
+    *origin = t->p6[i].origin_as ;
+    *address = t->p6[i].address ;
+    }
+  else {
+    *start = t->r6[i].start ;
+    *end = t->r6[i].end ;
+    *origin = t->r6[i].origin_as ;
+    *address = 0 ;
+    }
+}
+
+static void
+export4(const oa_table *t, struct outbuf *ob, int format)
+{
+  u_int32_t start, end ;
+  u_int32_t origin ;
+  const char *address ;
+  u_int32_t s ;
+  char *cp ;
+  int len = 0 ;
+  int text = !(format & OA_FMT_BINARY) ;
+  int cidr = (format & OA_FMT_CIDR) ;
+  size_t i ;
+
+  for (i = 0 ; i < spans4(t) ; ++i) {
+    span4(t,i,&start,&end,&origin,&address) ;
+    s = start ;
+    do {
+      cp = ob_room(ob,128) ;
+      if (cidr) {
+        len = cidr4(s,end) ;
+        if (text) {
+          cp += fmt4(cp,s,len) ;
+          if (len == 0) { *cp++ = '/' ; *cp++ = '0' ; }
+          }
+        else {
+          cp = put32(cp,s) ;
+          *cp++ = len ;
+          }
+        }
+      else if (text) {
+        cp += fmt4(cp,start,0) ;
+        *cp++ = ',' ;
+        cp += fmt4(cp,end,0) ;
+        }
+      else {
+        cp = put32(cp,start) ;
+        cp = put32(cp,end) ;
+        }
+      if (text) {
+        *cp++ = ',' ;
+        cp = putdec(cp,origin) ;
+        if (t->flags & OA_KEEP_PREFIX) {
+          *cp++ = ',' ;
+          if (address) {
+            strcpy(cp,address) ;
+            cp += strlen(cp) ;
+            }
+          }
+        *cp++ = '\n' ;
+        }
+      else cp = put32(cp,origin) ;
+      ob->len = cp - ob->buf ;
+      if (!cidr || (len == 0)) break ;
+      s += (u_int32_t) 1 << (32 - len) ;
+      } while (s && (s <= end) && (s > start)) ;
+    }
+}
+
+static void
+export6(const oa_table *t, struct outbuf *ob, int format)
+{
+  u_int128_t start, end ;
+  u_int32_t origin ;
+  const char *address ;
+  u_int128_t s ;
+  char *cp ;
+  int len = 0 ;
+  int text = !(format & OA_FMT_BINARY) ;
+  int cidr = (format & OA_FMT_CIDR) ;
+  size_t i ;
+
+  for (i = 0 ; i < spans6(t) ; ++i) {
+    span6(t,i,&start,&end,&origin,&address) ;
+    s = start ;
+    do {
+      cp = ob_room(ob,256) ;
+      if (cidr) {
+        len = cidr6(s,end) ;
+        if (text) {
+          cp += fmt6(cp,s,len) ;
+          if (len == 0) { *cp++ = '/' ; *cp++ = '0' ; }
+          }
+        else {
+          cp = put128(cp,s) ;
+          *cp++ = len ;
+          }
+        }
+      else if (text) {
+        cp += fmt6(cp,start,0) ;
+        *cp++ = ',' ;
+        cp += fmt6(cp,end,0) ;
+        }
+      else {
+        cp = put128(cp,start) ;
+        cp = put128(cp,end) ;
+        }
+      if (text) {
+        *cp++ = ',' ;
+        cp = putdec(cp,origin) ;
+        if (t->flags & OA_KEEP_PREFIX) {
+          *cp++ = ',' ;
+          if (address) {
+            strcpy(cp,address) ;
+            cp += strlen(cp) ;
+            }
+          }
+        *cp++ = '\n' ;
+        }
+      else cp = put32(cp,origin) ;
+      ob->len = cp - ob->buf ;
+      if (!cidr || (len == 0)) break ;
+      s += (u_int128_t) 1 << (128 - len) ;
+      } while (s && (s <= end) && (s > start)) ;
+    }
+}
+
+/* number of records a binary export will hold */
+
+static u_int32_t
+count4(const oa_table *t, int format)
+{
+  u_int32_t n = 0 ;
+  u_int32_t s, start, end ;
+  u_int32_t origin ;
+  const char *address ;
+  int len ;
+  size_t i ;
+
+  if (!(format & OA_FMT_CIDR)) return((u_int32_t) spans4(t)) ;
+  for (i = 0 ; i < spans4(t) ; ++i) {
+    span4(t,i,&start,&end,&origin,&address) ;
+    s = start ;
+    do {
+      ++n ;
+      if (!(len = cidr4(s,end))) break ;
+      s += (u_int32_t) 1 << (32 - len) ;
+      } while (s && (s <= end) && (s > start)) ;
+    }
+  return(n) ;
+}
+
+static u_int32_t
+count6(const oa_table *t, int format)
+{
+  u_int32_t n = 0 ;
+  u_int128_t s, start, end ;
+  u_int32_t origin ;
+  const char *address ;
+  int len ;
+  size_t i ;
+
+  if (!(format & OA_FMT_CIDR)) return((u_int32_t) spans6(t)) ;
+  for (i = 0 ; i < spans6(t) ; ++i) {
+    span6(t,i,&start,&end,&origin,&address) ;
+    s = start ;
+    do {
+      ++n ;
+      if (!(len = cidr6(s,end))) break ;
+      s += (u_int128_t) 1 << (128 - len) ;
+      } while (s && (s <= end) && (s > start)) ;
+    }
+  return(n) ;
+}
+
+
+/*--------------------------------------------------
+ * oa_table_export
+ * write the deaggregated table to <fd> in <format>
+ * return 1 if everything was written
+ */
+
+int
+oa_table_export(const oa_table *t, int fd, int format)
+{
+  struct outbuf ob ;
+  char *cp ;
+
+  if (!t->built) return(0) ;
+  ob.fd = fd ;
+  ob.err = 0 ;
+  ob.len = 0 ;
+  if (!(ob.buf = (char *) malloc(EXPORT_BUFSIZE))) return(0) ;
+
+  if (format & OA_FMT_BINARY) {
+    cp = ob.buf ;
+    memcpy(cp,"OAX1",4) ;
+    cp = put32(cp + 4,format & OA_FMT_CIDR) ;
+    cp = put32(cp,count4(t,format)) ;
+    cp = put32(cp,count6(t,format)) ;
+    ob.len = cp - ob.buf ;
+    }
+  export4(t,&ob,format) ;
+  export6(t,&ob,format) ;
+  ob_flush(&ob) ;
+  free(ob.buf) ;
+  return(!ob.err) ;
+}
+
+
+/* a run of changed addresses waiting to be written, extended while the
+   next run carries on with the same pair of origins */
+
+struct diff4 {
+  u_int32_t start ;
+  u_int32_t end ;
+  u_int32_t oldas ;
+  u_int32_t newas ;
+  int open ;
+  } ;
+
+struct diff6 {
+  u_int128_t start ;
+  u_int128_t end ;
+  u_int32_t oldas ;
+  u_int32_t newas ;
+  int open ;
+  } ;
+
+static void
+diff4_put(struct outbuf *ob, struct diff4 *d)
+{
+  char *cp ;
+
+  if (!d->open) return ;
+  cp = ob_room(ob,64) ;
+  cp += fmt4(cp,d->start,0) ;
+  *cp++ = ',' ;
+  cp += fmt4(cp,d->end,0) ;
+  *cp++ = ',' ;
+  cp = putdec(cp,d->oldas) ;
+  *cp++ = ',' ;
+  cp = putdec(cp,d->newas) ;
+  *cp++ = '\n' ;
+  ob->len = cp - ob->buf ;
+  d->open = 0 ;
+}
+
+static void
+diff6_put(struct outbuf *ob, struct diff6 *d)
+{
+  char *cp ;
+
+  if (!d->open) return ;
+  cp = ob_room(ob,128) ;
+  cp += fmt6(cp,d->start,0) ;
+  *cp++ = ',' ;
+  cp += fmt6(cp,d->end,0) ;
+  *cp++ = ',' ;
+  cp = putdec(cp,d->oldas) ;
+  *cp++ = ',' ;
+  cp = putdec(cp,d->newas) ;
+  *cp++ = '\n' ;
+  ob->len = cp - ob->buf ;
+  d->open = 0 ;
+}
+
+
+/*--------------------------------------------------
+ * diff4, diff6
+ * walk the ranges of both tables in one pass, as the history merge
+ * does: at each position take the origin each table has there and how
+ * far it holds, and step to the nearer end
+ */
+
+static size_t
+diff4(const oa_table *ot, const oa_table *nt, struct outbuf *ob)
+{
+  const struct range4 *ro = ot->r4 ;
+  const struct range4 *rn = nt->r4 ;
+  struct diff4 d ;
+  size_t i = 0, j = 0 ;
+  size_t n = 0 ;
+  u_int32_t pos = 0 ;
+  u_int32_t e, oend, nend ;
+  u_int32_t oorg, norg ;
+
+  d.open = 0 ;
+  for (;;) {
+    if ((i < ot->n4) && (ro[i].start <= pos)) {
+      oorg = ro[i].origin_as ;
+      oend = ro[i].end ;
+      }
+    else {
+      oorg = 0 ;
+      oend = (i < ot->n4) ? ro[i].start - 1 : ~(u_int32_t) 0 ;
+      }
+    if ((j < nt->n4) && (rn[j].start <= pos)) {
+      norg = rn[j].origin_as ;
+      nend = rn[j].end ;
+      }
+    else {
+      norg = 0 ;
+      nend = (j < nt->n4) ? rn[j].start - 1 : ~(u_int32_t) 0 ;
+      }
+    e = (oend < nend) ? oend : nend ;
+
+    if (oorg != norg) {
+      if (d.open && (d.end + 1 == pos) && (d.oldas == oorg) && (d.newas == norg)) d.end = e ;
+      else {
+        diff4_put(ob,&d) ;
+        d.start = pos ;
+        d.end = e ;
+        d.oldas = oorg ;
+        d.newas = norg ;
+        d.open = 1 ;
+        ++n ;
+        }
+      }
+
+    if (e == ~(u_int32_t) 0) break ;
+    pos = e + 1 ;
+    if ((i < ot->n4) && (ro[i].end < pos)) ++i ;
+    if ((j < nt->n4) && (rn[j].end < pos)) ++j ;
+    }
+  diff4_put(ob,&d) ;
+  return(n) ;
+}
+
+static size_t
+diff6(const oa_table *ot, const oa_table *nt, struct outbuf *ob)
+{
+  const struct range6 *ro = ot->r6 ;
+  const struct range6 *rn = nt->r6 ;
+  struct diff6 d ;
+  size_t i = 0, j = 0 ;
+  size_t n = 0 ;
+  u_int128_t pos = 0 ;
+  u_int128_t e, oend, nend ;
+  u_int32_t oorg, norg ;
+
+  d.open = 0 ;
+  for (;;) {
+    if ((i < ot->n6) && (ro[i].start <= pos)) {
+      oorg = ro[i].origin_as ;
+      oend = ro[i].end ;
+      }
+    else {
+      oorg = 0 ;
+      oend = (i < ot->n6) ? ro[i].start - 1 : ~(u_int128_t) 0 ;
+      }
+    if ((j < nt->n6) && (rn[j].start <= pos)) {
+      norg = rn[j].origin_as ;
+      nend = rn[j].end ;
+      }
+    else {
+      norg = 0 ;
+      nend = (j < nt->n6) ? rn[j].start - 1 : ~(u_int128_t) 0 ;
+      }
+    e = (oend < nend) ? oend : nend ;
+
+    if (oorg != norg) {
+      if (d.open && (d.end + 1 == pos) && (d.oldas == oorg) && (d.newas == norg)) d.end = e ;
+      else {
+        diff6_put(ob,&d) ;
+        d.start = pos ;
+        d.end = e ;
+        d.oldas = oorg ;
+        d.newas = norg ;
+        d.open = 1 ;
+        ++n ;
+        }
+      }
+
+    if (e == ~(u_int128_t) 0) break ;
+    pos = e + 1 ;
+    if ((i < ot->n6) && (ro[i].end < pos)) ++i ;
+    if ((j < nt->n6) && (rn[j].end < pos)) ++j ;
+    }
+  diff6_put(ob,&d) ;
+  return(n) ;
+}
+
+
+/*--------------------------------------------------
+ * oa_table_diff
+ * write the ranges whose origin differs between built tables <ot> and
+ * <nt> to <fd>, v4 then v6, and set <changes> (if not NULL) to the
+ * number written. Return 1 if everything was written
+ */
+
+int
+oa_table_diff(const oa_table *ot, const oa_table *nt, int fd, size_t *changes)
+{
+  struct outbuf ob ;
+  size_t n ;
+
+  if (!ot->built || !nt->built) return(0) ;
+  ob.fd = fd ;
+  ob.err = 0 ;
+  ob.len = 0 ;
+  if (!(ob.buf = (char *) malloc(EXPORT_BUFSIZE))) return(0) ;
+
+  n = diff4(ot,nt,&ob) ;
+  n += diff6(ot,nt,&ob) ;
+  ob_flush(&ob) ;
+  free(ob.buf) ;
+  if (changes) *changes = n ;
+  return(!ob.err) ;
+}
@@ -0,0 +1,354 @@
+/* history.c
+
+   origin history over a series of table snapshots
+
+   The address space is cut into segments, each with a list of the
+   origin changes it has seen, newest first. Adding a snapshot walks
+   the segments and the snapshot's ranges together: a segment whose
+   origin is unchanged keeps its list as it is, one that changed gets a
+   single new change pointing at its old list. Lists are never copied -
+   when a snapshot splits a segment both halves share the old list - and
+   neighbouring segments that end up with the same list are joined again.
+   Memory therefore grows with the number of origin changes, and a
+   snapshot identical to the last one adds nothing.
+
+   Unannounced space has origin 0, so a withdrawal is a change to 0.
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include "originas.h"
+
+struct hchange {
+  u_int32_t when ;
+  u_int32_t origin_as ;
+  struct hchange *older ;
+  } ;
+
+struct hseg4 {
+  u_int32_t start ;
+  u_int32_t end ;
+  struct hchange *hist ;
+  } ;
+
+struct hseg6 {
+  u_int128_t start ;
+  u_int128_t end ;
+  struct hchange *hist ;
+  } ;
+
+#define HCHANGE_BLOCK 4096
+
+struct hblock {
+  struct hblock *nxt ;
+  size_t used ;
+  struct hchange c[HCHANGE_BLOCK] ;
+  } ;
+
+struct oa_history {
+  struct hseg4 *s4 ;
+  size_t n4 ;
+  struct hseg6 *s6 ;
+  size_t n6 ;
+  struct hugemem s4mem ;    /* the segments, on huge pages once they fill one */
+  struct hugemem s6mem ;
+  u_int32_t last ;
+  size_t snapshots ;
+  size_t changes ;
+  struct hblock *blocks ;
+  } ;
+
+
+static struct hchange *
+hchange_new(oa_history *h, u_int32_t when, u_int32_t origin_as, struct hchange *older)
+{
+  struct hblock *hb = h->blocks ;
+  struct hchange *hc ;
+
+  if (!hb || (hb->used == HCHANGE_BLOCK)) {
+    hb = (struct hblock *) malloc(sizeof *hb) ;
+    hb->used = 0 ;
+    hb->nxt = h->blocks ;
+    h->blocks = hb ;
+    }
+  hc = &hb->c[hb->used++] ;
+  hc->when = when ;
+  hc->origin_as = origin_as ;
+  hc->older = older ;
+  ++h->changes ;
+  return(hc) ;
+}
+
+static u_int32_t
+hist_origin(const struct hchange *hc)
+{
+  return(hc ? hc->origin_as : 0) ;
+}
+
+
+oa_history *
+oa_history_new(void)
+{
+  oa_history *h ;
+
+  if (!(h = (oa_history *) calloc(1,sizeof *h))) return(0) ;
+  h->s4 = (struct hseg4 *) malloc(sizeof *h->s4) ;
+  h->s4->start = 0 ;
+  h->s4->end = ~(u_int32_t) 0 ;
+  h->s4->hist = 0 ;
+  h->n4 = 1 ;
+  h->s4mem.p = h->s4 ;
+  h->s6 = (struct hseg6 *) malloc(sizeof *h->s6) ;
+  h->s6->start = 0 ;
+  h->s6->end = ~(u_int128_t) 0 ;
+  h->s6->hist = 0 ;
+  h->n6 = 1 ;
+  h->s6mem.p = h->s6 ;
+  return(h) ;
+}
+
+void
+oa_history_free(oa_history *h)
+{
+  struct hblock *hb ;
+
+  if (!h) return ;
+  while ((hb = h->blocks)) {
+    h->blocks = hb->nxt ;
+    free(hb) ;
+    }
+  huge_free(&h->s4mem) ;
+  huge_free(&h->s6mem) ;
+  free(h) ;
+}
+
+
+/*--------------------------------------------------
+ * merge4, merge6
+ * fold the ranges of table <t> into the segments as of time <when>
+ */
+
+static void
+merge4(oa_history *h, const oa_table *t, u_int32_t when)
+{
+  struct hseg4 *out, *o ;
+  const struct hseg4 *sg ;
+  const struct range4 *r = t->r4 ;
+  struct hchange *hist ;
+  struct hchange *lastnew = 0 ;
+  size_t i = 0, j = 0 ;
+  size_t max = h->n4 + (2 * t->n4) + 1 ;
+  u_int32_t pos = 0 ;
+  u_int32_t e, rend ;
+  u_int32_t origin ;
+
+  o = out = (struct hseg4 *) malloc(max * sizeof *out) ;
+  for (;;) {
+    sg = &h->s4[i] ;
+
+    /* origin of the snapshot at pos, and how far it holds */
+    if ((j < t->n4) && (r[j].start <= pos)) {
+      origin = r[j].origin_as ;
+      rend = r[j].end ;
+      }
+    else {
+      origin = 0 ;
+      rend = (j < t->n4) ? r[j].start - 1 : ~(u_int32_t) 0 ;
+      }
+    e = (sg->end < rend) ? sg->end : rend ;
+
+    if (hist_origin(sg->hist) == origin) hist = sg->hist ;
+    else if (lastnew && (lastnew->older == sg->hist) && (lastnew->origin_as == origin)) hist = lastnew ;
+    else hist = lastnew = hchange_new(h,when,origin,sg->hist) ;
+
+    if ((o > out) && (o[-1].hist == hist)) o[-1].end = e ;
+    else {
+      o->start = pos ;
+      o->end = e ;
+      o->hist = hist ;
+      ++o ;
+      }
+
+    if (e == ~(u_int32_t) 0) break ;
+    pos = e + 1 ;
+    if (sg->end < pos) ++i ;
+    if ((j < t->n4) && (r[j].end < pos)) ++j ;
+    }
+  huge_free(&h->s4mem) ;
+  h->n4 = o - out ;
+  h->s4 = (struct hseg4 *) huge_move(&h->s4mem,out,h->n4 * sizeof *out) ;
+}
+
+static void
+merge6(oa_history *h, const oa_table *t, u_int32_t when)
+{
+  struct hseg6 *out, *o ;
+  const struct hseg6 *sg ;
+  const struct range6 *r = t->r6 ;
+  struct hchange *hist ;
+  struct hchange *lastnew = 0 ;
+  size_t i = 0, j = 0 ;
+  size_t max = h->n6 + (2 * t->n6) + 1 ;
+  u_int128_t pos = 0 ;
+  u_int128_t e, rend ;
+  u_int32_t origin ;
+
+  o = out = (struct hseg6 *) malloc(max * sizeof *out) ;
+  for (;;) {
+    sg = &h->s6[i] ;
+
+    if ((j < t->n6) && (r[j].start <= pos)) {
+      origin = r[j].origin_as ;
+      rend = r[j].end ;
+      }
+    else {
+      origin = 0 ;
+      rend = (j < t->n6) ? r[j].start - 1 : ~(u_int128_t) 0 ;
+      }
+    e = (sg->end < rend) ? sg->end : rend ;
+
+    if (hist_origin(sg->hist) == origin) hist = sg->hist ;
+    else if (lastnew && (lastnew->older == sg->hist) && (lastnew->origin_as == origin)) hist = lastnew ;
+    else hist = lastnew = hchange_new(h,when,origin,sg->hist) ;
+
+    if ((o > out) && (o[-1].hist == hist)) o[-1].end = e ;
+    else {
+      o->start = pos ;
+      o->end = e ;
+      o->hist = hist ;
+      ++o ;
+      }
+
+    if (e == ~(u_int128_t) 0) break ;
+    pos = e + 1 ;
+    if (sg->end < pos) ++i ;
+    if ((j < t->n6) && (r[j].end < pos)) ++j ;
+    }
+  huge_free(&h->s6mem) ;
+  h->n6 = o - out ;
+  h->s6 = (struct hseg6 *) huge_move(&h->s6mem,out,h->n6 * sizeof *out) ;
+}
+
+
+/*--------------------------------------------------
+ * oa_history_add
+ * add built table <t> as the snapshot at time <when>, which must not
+ * be earlier than the last snapshot added. The table is not referenced
+ * afterwards. Return 0 if the snapshot is out of order
+ */
+
+int
+oa_history_add(oa_history *h, uint32_t when, const oa_table *t)
+{
+  if (!t->built) return(0) ;
+  if (h->snapshots && (when < h->last)) return(0) ;
+  merge4(h,t,when) ;
+  merge6(h,t,when) ;
+  h->last = when ;
+  ++h->snapshots ;
+  return(1) ;
+}
+
+
+/* list of changes for the segment holding query field <field>, an
+   AS number field is returned in <asn> */
+
+static const struct hchange *
+history_find(const oa_history *h, const char *field, unsigned int *asn)
+{
+  char f[128] ;
+  u_int32_t a4 ;
+  u_int128_t a6 ;
+  int mask ;
+  size_t lo, hi, mid ;
+
+  strncpy(f,field,sizeof f - 1) ;
+  f[sizeof f - 1] = '\0' ;
+  *asn = 0 ;
+  switch (parse_field(f,&a4,&a6,&mask,asn)) {
+    case FIELD_V4:
+      lo = 0 ;
+      hi = h->n4 ;
+      while (hi - lo > 1) {
+        mid = (lo + hi) >> 1 ;
+        if (h->s4[mid].start <= a4) lo = mid ;
+        else hi = mid ;
+        }
+      return(h->s4[lo].hist) ;
+    case FIELD_V6:
+      lo = 0 ;
+      hi = h->n6 ;
+      while (hi - lo > 1) {
+        mid = (lo + hi) >> 1 ;
+        if (h->s6[mid].start <= a6) lo = mid ;
+        else hi = mid ;
+        }
+      return(h->s6[lo].hist) ;
+    }
+  return(0) ;
+}
+
+
+/*--------------------------------------------------
+ * oa_history_lookup
+ * origin AS of the address in <field> as of time <when> - as with
+ * oa_lookup(), an AS number field is its own origin
+ */
+
+uint32_t
+oa_history_lookup(const oa_history *h, const char *field, uint32_t when)
+{
+  unsigned int asn ;
+  const struct hchange *hc = history_find(h,field,&asn) ;
+
+  if (asn) return(asn) ;
+  while (hc && (hc->when > when)) hc = hc->older ;
+  return(hist_origin(hc)) ;
+}
+
+
+/*--------------------------------------------------
+ * oa_history_changes
+ * the origin changes of the address in <field>, oldest first: from
+ * when[i] the origin was origins[i]. The newest <max> are stored, and
+ * the total number is returned - call again with room for that many
+ * if it is more
+ */
+
+size_t
+oa_history_changes(const oa_history *h, const char *field, uint32_t *when, uint32_t *origins, size_t max)
+{
+  const struct hchange *first ;
+  const struct hchange *hc ;
+  unsigned int asn ;
+  size_t n = 0 ;
+  size_t i ;
+
+  first = history_find(h,field,&asn) ;
+  for (hc = first ; hc ; hc = hc->older) ++n ;
+
+  /* the list runs newest first */
+  i = ((n < max) ? n : max) ;
+  for (hc = first ; hc && i ; hc = hc->older) {
+    --i ;
+    when[i] = hc->when ;
+    origins[i] = hc->origin_as ;
+    }
+  return(n) ;
+}
+
+
+/*--------------------------------------------------
+ * oa_history_stats
+ * number of snapshots, segments and stored changes
+ */
+
+void
+oa_history_stats(const oa_history *h, size_t *snapshots, size_t *segments, size_t *changes)
+{
+  *snapshots = h->snapshots ;
+  *segments = h->n4 + h->n6 ;
+  *changes = h->changes ;
+}
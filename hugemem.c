@@ -0,0 +1,172 @@
+/* hugemem.c
+
+   huge page memory for the arrays lookups read at random
+
+   A lookup bisects arrays of tens or hundreds of MB, touching a new
+   page at nearly every step, so with 4 kB pages most steps also miss
+   the TLB. Arrays of at least one huge page are instead mapped
+
+     explicit    MAP_HUGETLB, from the pages reserved in
+                 /proc/sys/vm/nr_hugepages - none are by default
+     transparent a 2 MB aligned anonymous mapping the kernel is asked
+                 (madvise MADV_HUGEPAGE) to back with huge pages, unless
+                 transparent huge pages are turned off
+     base        malloc, as for anything smaller
+
+   each tried in turn, and each array records which it got and how it
+   is to be released.
+
+*/
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include "originas.h"
+
+#define HUGE_PAGE (2 << 20)
+
+
+/* transparent huge pages may be asked for - the setting is
+   "always [madvise] never" with the one in use bracketed */
+
+static int
+thp_usable(void)
+{
+  char buf[128] ;
+  ssize_t n ;
+  int fd ;
+
+  if ((fd = open("/sys/kernel/mm/transparent_hugepage/enabled",O_RDONLY)) < 0) return(0) ;
+  n = read(fd,buf,sizeof buf - 1) ;
+  close(fd) ;
+  if (n <= 0) return(0) ;
+  buf[n] = '\0' ;
+  return(!strstr(buf,"[never]")) ;
+}
+
+
+/* map <size> bytes on huge pages into <hm>, if they are at least one
+   and there are huge pages to be had. Return the memory, or 0 */
+
+static void *
+huge_map(struct hugemem *hm, size_t size)
+{
+  size_t len ;
+  char *p ;
+  char *a ;
+
+  memset(hm,0,sizeof *hm) ;
+  if (size < HUGE_PAGE) return(0) ;
+  len = (size + HUGE_PAGE - 1) & ~((size_t) HUGE_PAGE - 1) ;
+#ifdef MAP_HUGETLB
+  p = (char *) mmap(0,len,PROT_READ | PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,-1,0) ;
+  if (p != (char *) MAP_FAILED) {
+    hm->p = p ;
+    hm->size = len ;
+    hm->pages = OA_PAGES_HUGETLB ;
+    return(p) ;
+    }
+#endif
+#ifdef MADV_HUGEPAGE
+  /* over-map by a page and trim, to start on a huge page boundary */
+  if (!thp_usable()) return(0) ;
+  p = (char *) mmap(0,len + HUGE_PAGE,PROT_READ | PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS,-1,0) ;
+  if (p == (char *) MAP_FAILED) return(0) ;
+  a = (char *) (((size_t) p + HUGE_PAGE - 1) & ~((size_t) HUGE_PAGE - 1)) ;
+  if (a > p) munmap(p,a - p) ;
+  munmap(a + len,(p + len + HUGE_PAGE) - (a + len)) ;
+  if (!madvise(a,len,MADV_HUGEPAGE)) {
+    hm->p = a ;
+    hm->size = len ;
+    hm->pages = OA_PAGES_THP ;
+    return(a) ;
+    }
+  munmap(a,len) ;
+#endif
+  return(0) ;
+}
+
+
+/*--------------------------------------------------
+ * huge_alloc
+ * <size> bytes of zeroed memory into <hm>, on huge pages if it is
+ * at least one. Return the memory, or 0 if there is none
+ */
+
+void *
+huge_alloc(struct hugemem *hm, size_t size)
+{
+  if (huge_map(hm,size)) return(hm->p) ;
+  hm->p = calloc(1,(size ? size : 1)) ;
+  hm->size = size ;
+  hm->pages = OA_PAGES_BASE ;
+  return(hm->p) ;
+}
+
+
+/*--------------------------------------------------
+ * huge_move
+ * move the first <size> bytes of malloc'd block <p> into <hm>, on
+ * huge pages if they are at least one, and release <p>. Smaller
+ * blocks - and any that cannot be moved - are only trimmed to size
+ */
+
+void *
+huge_move(struct hugemem *hm, void *p, size_t size)
+{
+  void *q ;
+
+  if (huge_map(hm,size)) {
+    memcpy(hm->p,p,size) ;
+    free(p) ;
+    return(hm->p) ;
+    }
+  q = realloc(p,(size ? size : 1)) ;
+  hm->p = (q ? q : p) ;
+  hm->size = size ;
+  hm->pages = OA_PAGES_BASE ;
+  return(hm->p) ;
+}
+
+void
+huge_free(struct hugemem *hm)
+{
+  if (hm->pages == OA_PAGES_BASE) free(hm->p) ;
+  else munmap(hm->p,hm->size) ;
+  memset(hm,0,sizeof *hm) ;
+}
+
+/* the page size behind <hm> */
+
+size_t
+huge_pagesize(const struct hugemem *hm)
+{
+  return((hm->pages == OA_PAGES_BASE) ? (size_t) sysconf(_SC_PAGESIZE) : (size_t) HUGE_PAGE) ;
+}
+
+
+/*--------------------------------------------------
+ * oa_table_pages
+ * the OA_PAGES_ kind of memory behind the largest of the arrays the
+ * lookups of a built table search, with its page size in <pagesize>
+ */
+
+int
+oa_table_pages(const oa_table *t, size_t *pagesize)
+{
+  const struct hugemem *v[4] ;
+  const struct hugemem *big ;
+  int i ;
+
+  v[0] = &t->r4mem ;
+  v[1] = &t->r6mem ;
+  v[2] = &t->ex4mem ;
+  v[3] = &t->ex6mem ;
+  for (big = v[0], i = 1 ; i < 4 ; ++i) if (v[i]->size > big->size) big = v[i] ;
+  if (pagesize) *pagesize = huge_pagesize(big) ;
+  return(big->pages) ;
+}
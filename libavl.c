@@ -185,6 +185,27 @@ avl_ptr avl_inserted;
 
 enum AVLRES
 avlinsert(avl_ref n, avl_ptr d, CMP *ac)
+{
+  return(avlinsert_r(n, d, ac, &avl_inserted, &avlinserted)) ;
+}
+
+/*************************************************
+ *
+ *  avlinsert_r: reentrant form of avlinsert
+ *
+ *  Parameters:
+ *
+ *    inserted    Set to the node holding the item's AVLKEY, either
+ *                the newly created node or the existing one.
+ *
+ *    isnew       Set to 1 if a new node was created, 0 otherwise.
+ *
+ *  The return values are as for avlinsert. No global state is
+ *  touched, so separate trees may be updated from separate threads.
+ */
+
+enum AVLRES
+avlinsert_r(avl_ref n, avl_ptr d, CMP *ac, avl_ref inserted, int *isnew)
 {
   enum AVLRES tmp;
   int compare ;
@@ -196,26 +217,26 @@ avlinsert(avl_ref n, avl_ptr d, CMP *ac)
     (*n)->left = (*n)->right = NULL;
     (*n)->skew = NONE;
     (*n)->payload = d->payload;
-    avl_inserted = (*n);
-    avlinserted = 1 ;
+    *inserted = (*n);
+    *isnew = 1 ;
     return BALANCE;
     }
   compare = (*ac)(d,(*n));
 
   if (compare < 0) {
-    if ((tmp = avlinsert(& (*n)->left, d, ac)) == BALANCE) {
+    if ((tmp = avlinsert_r(& (*n)->left, d, ac, inserted, isnew)) == BALANCE) {
       return avlleftgrown(n);
       }
     return tmp;
     }
   if (compare > 0) {
-    if ((tmp = avlinsert(& (*n)->right, d, ac)) == BALANCE) {
+    if ((tmp = avlinsert_r(& (*n)->right, d, ac, inserted, isnew)) == BALANCE) {
       return avlrightgrown(n);
       }
     return tmp;
     }
-  avl_inserted = (*n);
-  avlinserted = 0 ;
+  *inserted = (*n);
+  *isnew = 0 ;
   return ERROR;
 }   
 
@@ -606,3 +627,52 @@ avlbreadthfirst(avl_ptr n, int cdepth , AVLWORKER *f, FILE *param, int depth)
   return(0) ;
 }
 
+
+/*************************************************
+ *
+ *  avlinorder: in-order traversal with a caller supplied context
+ *
+ *  Parameters:
+ *
+ *    n    Pointer to the root node.
+ *
+ *    f    Worker function to be called for every node, in
+ *         ascending AVLKEY order.
+ *
+ *    arg  Context pointer passed through to the worker.
+ */
+
+void
+avlinorder(avl_ptr n, AVLVISIT *f, void *arg)
+{
+  while (n) {
+    avlinorder(n->left, f, arg);
+    (*f)(n, arg);
+    n = n->right ;
+    }
+}
+
+
+/*************************************************
+ *
+ *  avldestroy: free every node of a tree
+ *
+ *  Parameters:
+ *
+ *    n    Address of a pointer to the root node, set to NULL
+ *         on return.
+ *
+ *    f    If not NULL, called with each node's payload before
+ *         the node itself is freed.
+ */
+
+void
+avldestroy(avl_ref n, void (*f)(void *))
+{
+  if (!(*n)) return ;
+  avldestroy(&(*n)->left, f) ;
+  avldestroy(&(*n)->right, f) ;
+  if (f) (*f)((*n)->payload) ;
+  free(*n) ;
+  *n = NULL ;
+}
@@ -6,6 +6,9 @@
 
 */
 
+#ifndef LIBAVL_H
+#define LIBAVL_H
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
@@ -35,9 +38,14 @@ extern avl_ptr          avl_inserted;
 
 typedef int CMP(avl_ptr, avl_ptr);
 typedef void AVLWORKER(avl_ptr, FILE *, int);
+typedef void AVLVISIT(avl_ptr, void *);
 
 extern enum AVLRES avlinsert(avl_ref, avl_ptr, CMP *) ;
+extern enum AVLRES avlinsert_r(avl_ref, avl_ptr, CMP *, avl_ref, int *) ;
 extern enum AVLRES avlremove(avl_ref, avl_ptr, CMP *) ;
 extern avl_ptr avlaccess(avl_ptr, avl_ptr key, CMP *) ;
 extern void avldepthfirst(avl_ptr, AVLWORKER *, FILE *, int);
+extern void avlinorder(avl_ptr, AVLVISIT *, void *);
+extern void avldestroy(avl_ref, void (*)(void *));
 
+#endif
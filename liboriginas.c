@@ -0,0 +1,1560 @@
+/* liboriginas.c
+   origin AS tables built from bgp dump files
+
+   Each oa_table holds its own prefix trees, as path set and AS names,
+   so tables are independent of each other. Once oa_table_build() has
+   run, lookups only read the table and may run concurrently.
+
+*/
+
+#include <ctype.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include "originas.h"
+
+
+
+/*--------------------------------------------------
+ * strsave
+ * copy string <s> into the table's string store
+ */
+
+static char *
+strsave(oa_table *t, const char *s)
+{
+  struct strblk *sb = t->strings ;
+  size_t l = strlen(s) + 1 ;
+  char *cp ;
+
+  if (!sb || (sb->used + l > sizeof sb->data)) {
+    sb = (struct strblk *) malloc(sizeof *sb) ;
+    sb->used = 0 ;
+    sb->nxt = t->strings ;
+    t->strings = sb ;
+    }
+  cp = &sb->data[sb->used] ;
+  memcpy(cp,s,l) ;
+  sb->used += l ;
+  return(cp) ;
+}
+
+
+static int
+asn_cmp(avl_ptr adp1, avl_ptr adp2)
+{
+  if (((struct as_names *)adp1->payload)->as < ((struct as_names *)adp2->payload)->as) return(-1) ;
+  if (((struct as_names *)adp1->payload)->as > ((struct as_names *)adp2->payload)->as) return(1) ;
+  return(0) ;
+}
+/*---------------------------------------------------*/
+
+
+const char *
+oa_asname(const oa_table *t, uint32_t asn)
+{
+  struct avldata local ;
+  struct as_names sasn ;
+  avl_ptr find ;
+
+  local.payload = &sasn ;
+  sasn.as = asn ;
+  if ((find = avlaccess(t->asnames,&local,asn_cmp)))
+    return(((struct as_names *)find->payload)->asname) ;
+  return(NULL) ;
+}
+
+/*--------------------------------------------------
+ * fmt4, fmt6
+ * write address <a> as text to <buf>, followed by /mask if <mask> > 0,
+ * and return the length. No stdio - these are on the export path.
+ * v6 addresses compress the first run of two or more zero groups
+ */
+
+static char *
+fmtdec(char *cp, unsigned int v)
+{
+  if (v >= 100) { *cp++ = '0' + (v / 100) ; v %= 100 ; *cp++ = '0' + (v / 10) ; v %= 10 ; }
+  else if (v >= 10) { *cp++ = '0' + (v / 10) ; v %= 10 ; }
+  *cp++ = '0' + v ;
+  return(cp) ;
+}
+
+int
+fmt4(char *buf, u_int32_t a, int mask)
+{
+  char *cp = buf ;
+
+  cp = fmtdec(cp,(a >> 24) & 255) ;
+  *cp++ = '.' ;
+  cp = fmtdec(cp,(a >> 16) & 255) ;
+  *cp++ = '.' ;
+  cp = fmtdec(cp,(a >> 8) & 255) ;
+  *cp++ = '.' ;
+  cp = fmtdec(cp,a & 255) ;
+  if (mask > 0) {
+    *cp++ = '/' ;
+    cp = fmtdec(cp,mask) ;
+    }
+  *cp = '\0' ;
+  return(cp - buf) ;
+}
+
+int
+fmt6(char *buf, u_int128_t a, int mask)
+{
+  static const char hex[] = "0123456789abcdef" ;
+  unsigned int g[8] ;
+  int i, sh ;
+  int zero = 0 ;
+  char *cp = buf ;
+
+  for (i = 0 ; i < 8 ; ++i) g[i] = (unsigned int) (a >> (112 - (16 * i))) & 0xffff ;
+  for (i = 0 ; i < 8 ; ++i) {
+    if ((i < 7) && (zero == 0) && (g[i] == 0) && (g[i+1] == 0)) {
+      *cp++ = ':' ;
+      if (!i) *cp++ = ':' ;
+      zero = 1 ;
+      }
+    else if ((zero == 1) && (g[i] == 0)) {
+      zero = 1 ;
+      }
+    else {
+      for (sh = 12 ; (sh > 0) && !(g[i] >> sh) ; sh -= 4) ;
+      for ( ; sh >= 0 ; sh -= 4) *cp++ = hex[(g[i] >> sh) & 15] ;
+      if (i < 7) {
+        *cp++ = ':' ;
+        if (zero) ++zero ;
+        }
+      }
+    }
+  if (mask > 0) {
+    *cp++ = '/' ;
+    cp = fmtdec(cp,mask) ;
+    }
+  *cp = '\0' ;
+  return(cp - buf) ;
+}
+
+/* an unsigned 128 bit number in decimal - up to 39 digits */
+
+int
+fmtu128(char *buf, u_int128_t v)
+{
+  char ts[40] ;
+  char *cp = ts + sizeof ts ;
+  int n ;
+
+  *--cp = '\0' ;
+  do {
+    *--cp = '0' + (int) (v % 10) ;
+    v /= 10 ;
+    }
+  while (v) ;
+  n = (int) (ts + sizeof ts - 1 - cp) ;
+  memcpy(buf,cp,n + 1) ;
+  return(n) ;
+}
+
+char *
+n4ta(u_int32_t *t, int mask)
+{
+  char ts[24] ;
+
+  fmt4(ts,*t,mask) ;
+  return(strdup(ts));
+}
+
+char *
+n6ta(u_int128_t *t, int mask)
+{
+  char ts[48] ;
+
+  fmt6(ts,*t,mask) ;
+  return(strdup(ts));
+}
+
+
+/*--------------------------------------------------
+ * addr4_new, addr6_new
+ * allocate a prefix entry covering <size> addresses from <start>
+ * with the prefix string set if <mask> is given
+ */
+
+static struct addr4 *
+addr4_new(oa_table *t, u_int32_t start, u_int32_t size, int mask)
+{
+  struct addr4 *ap ;
+  char ts[24] ;
+
+  ap = (struct addr4 *) malloc(sizeof *ap) ;
+  ap->start = start ;
+  ap->end = start + size - 1 ;
+  ap->size = size ;
+  ap->origin_as = 0 ;
+  ap->path = 0 ;
+  ap->nxt = 0 ;
+  ap->prv = 0 ;
+
+  ap->flags = 0 ;
+  ap->address = 0 ;
+  ap->mask = 0 ;
+  if (mask) {
+    if (t->flags & OA_KEEP_PREFIX) {
+      fmt4(ts,start,mask) ;
+      ap->address = strsave(t,ts) ;
+      }
+    ap->mask = mask ;
+    }
+  ap->status = 1 ;
+  return(ap) ;
+}
+
+static struct addr6 *
+addr6_new(oa_table *t, u_int128_t start, u_int128_t size, int mask)
+{
+  struct addr6 *ap ;
+  char ts[48] ;
+
+  ap = (struct addr6 *) malloc(sizeof *ap) ;
+  ap->start = start ;
+  ap->end = start ;
+  ap->end += size ;
+  ap->end -= 1 ;
+  ap->size = size ;
+  ap->origin_as = 0 ;
+  ap->path = 0 ;
+  ap->nxt = 0 ;
+  ap->prv = 0 ;
+
+  ap->flags = 0 ;
+  ap->address = 0 ;
+  ap->mask = 0 ;
+  if (mask) {
+    if (t->flags & OA_KEEP_PREFIX) {
+      fmt6(ts,start,mask) ;
+      ap->address = strsave(t,ts) ;
+      }
+    ap->mask = mask ;
+    }
+  ap->status = 1 ;
+  return(ap) ;
+}
+
+
+/*--------------------------------------------------
+ * pfx4_add, pfx6_add
+ * append an announced prefix to the bulk build vector
+ */
+
+static void *
+pfxvec_next(struct pfxvec *pv, size_t width)
+{
+  if (pv->n == pv->max) {
+    pv->max = (pv->max ? pv->max * 2 : 65536) ;
+    pv->v = realloc(pv->v,pv->max * width) ;
+    }
+  return((char *) pv->v + (pv->n++ * width)) ;
+}
+
+static void
+pfx4_add(oa_table *t, u_int32_t start, int mask, u_int32_t origin_as, u_int32_t path)
+{
+  struct pfx4 *pp = (struct pfx4 *) pfxvec_next(&t->pv4,sizeof *pp) ;
+
+  pp->key = ((u_int64_t) start << 8) | mask ;
+  pp->origin_as = origin_as ;
+  pp->path = path ;
+}
+
+static void
+pfx6_add(oa_table *t, u_int128_t start, int mask, u_int32_t origin_as, u_int32_t path)
+{
+  struct pfx6 *pp = (struct pfx6 *) pfxvec_next(&t->pv6,sizeof *pp) ;
+
+  pp->start = start ;
+  pp->mask = mask ;
+  pp->origin_as = origin_as ;
+  pp->path = path ;
+}
+
+
+/*--------------------------------------------------
+ * range4_seek, range6_seek
+ * given r[i].start <= a, return the last range index whose start
+ * is <= a, galloping forward from i and then bisecting, so a run of
+ * ascending addresses costs amortised O(1) per address
+ */
+
+static size_t
+range4_seek(const struct range4 *r, size_t n, size_t i, u_int32_t a)
+{
+  size_t step = 1 ;
+  size_t hi, mid ;
+
+  while ((i + step < n) && (r[i + step].start <= a)) {
+    i += step ;
+    step <<= 1 ;
+    }
+  hi = (i + step < n) ? i + step : n ;
+  while (hi - i > 1) {
+    mid = (i + hi) >> 1 ;
+    if (r[mid].start <= a) i = mid ;
+    else hi = mid ;
+    }
+  return(i) ;
+}
+
+static size_t
+range6_seek(const struct range6 *r, size_t n, size_t i, u_int128_t a)
+{
+  size_t step = 1 ;
+  size_t hi, mid ;
+
+  while ((i + step < n) && (r[i + step].start <= a)) {
+    i += step ;
+    step <<= 1 ;
+    }
+  hi = (i + step < n) ? i + step : n ;
+  while (hi - i > 1) {
+    mid = (i + hi) >> 1 ;
+    if (r[mid].start <= a) i = mid ;
+    else hi = mid ;
+    }
+  return(i) ;
+}
+
+
+/*--------------------------------------------------
+ * find4_range, find6_range
+ * find the compiled range holding <start>, or 0. With a cursor the
+ * search continues from the cursor's last range when the address has
+ * not gone backwards, otherwise it is a binary search of the whole table
+ */
+
+static const struct range4 *
+find4_range(const oa_table *t, oa_cursor *c, u_int32_t start)
+{
+  const struct range4 *r = t->r4 ;
+  size_t i ;
+
+  if (!t->n4 || (r[0].start > start)) return(0) ;
+  if (c && (c->pos4 < t->n4) && (r[c->pos4].start <= start))
+    i = range4_seek(r,t->n4,c->pos4,start) ;
+  else
+    i = range4_seek(r,t->n4,0,start) ;
+  if (c) c->pos4 = i ;
+  return((r[i].end >= start) ? &r[i] : 0) ;
+}
+
+static const struct range6 *
+find6_range(const oa_table *t, oa_cursor *c, u_int128_t start)
+{
+  const struct range6 *r = t->r6 ;
+  size_t i ;
+
+  if (!t->n6 || (r[0].start > start)) return(0) ;
+  if (c && (c->pos6 < t->n6) && (r[c->pos6].start <= start))
+    i = range6_seek(r,t->n6,c->pos6,start) ;
+  else
+    i = range6_seek(r,t->n6,0,start) ;
+  if (c) c->pos6 = i ;
+  return((r[i].end >= start) ? &r[i] : 0) ;
+}
+
+
+/*--------------------------------------------------
+ * prov4_find, prov6_find
+ * the piece of range <r> that holds <a>, for tables that keep prefixes
+ */
+
+static const struct prov4 *
+prov4_find(const oa_table *t, const struct range4 *r, u_int32_t a)
+{
+  size_t lo = r->prov ;
+  size_t hi = ((r + 1 < t->r4 + t->n4) ? r[1].prov : t->np4) ;
+  size_t mid ;
+
+  while (hi - lo > 1) {
+    mid = (lo + hi) >> 1 ;
+    if (t->p4[mid].start <= a) lo = mid ;
+    else hi = mid ;
+    }
+  return(&t->p4[lo]) ;
+}
+
+static const struct prov6 *
+prov6_find(const oa_table *t, const struct range6 *r, u_int128_t a)
+{
+  size_t lo = r->prov ;
+  size_t hi = ((r + 1 < t->r6 + t->n6) ? r[1].prov : t->np6) ;
+  size_t mid ;
+
+  while (hi - lo > 1) {
+    mid = (lo + hi) >> 1 ;
+    if (t->p6[mid].start <= a) lo = mid ;
+    else hi = mid ;
+    }
+  return(&t->p6[lo]) ;
+}
+
+
+/*--------------------------------------------------
+ * find4_origin_as, find6_origin_as
+ * the origin of the range holding <start>, setting <p> to the prefix
+ * it was announced in (OA_KEEP_PREFIX tables) and <path> (if given) to
+ * its as path
+ */
+
+unsigned int
+find6_origin_as(const oa_table *t, oa_cursor *c, u_int128_t *start, char **p, u_int32_t *path)
+{
+  const struct range6 *r ;
+
+  if (t->live) {
+    *p = 0 ;
+    if (path) *path = 0 ;
+    return(live6_origin(t,*start)) ;
+    }
+  if (!(r = find6_range(t,c,*start))) return(0) ;
+  *p = ((t->flags & OA_KEEP_PREFIX) ? prov6_find(t,r,*start)->address : 0) ;
+  if (path) *path = r->path ;
+  return(r->origin_as) ;
+}
+
+unsigned int
+find4_origin_as(const oa_table *t, oa_cursor *c, u_int32_t *start, char **p, u_int32_t *path)
+{
+  const struct range4 *r ;
+
+  if (t->live) {
+    *p = 0 ;
+    if (path) *path = 0 ;
+    return(live4_origin(t,*start)) ;
+    }
+  if (!(r = find4_range(t,c,*start))) return(0) ;
+  *p = ((t->flags & OA_KEEP_PREFIX) ? prov4_find(t,r,*start)->address : 0) ;
+  if (path) *path = r->path ;
+  return(r->origin_as) ;
+}
+
+
+/*--------------------------------------------------
+ * parse_prefix
+ * parse announced prefix <addr> into <lr>. Return 1 if it is a prefix
+ * to add, 0 if it does not parse or is the default route
+ */
+
+int
+parse_prefix(char *addr, struct loadrec *lr)
+{
+  int i ;
+  int q[4];
+  int msk ;
+  u_int32_t strt4 ;
+
+  if (strchr(addr,':')) {
+    // V6 address processing
+    unsigned long int hex[8] ;
+    v6addr x ;
+    char *cp ;
+    char *slashcp ;
+    int mask ;
+    int k ;
+    int shuffle = 8 ;
+
+    slashcp = strchr(addr,'/') ;
+    if (!slashcp || (sscanf(slashcp,"/%d",&mask) != 1)) return(0) ;
+    *slashcp = ':';
+    for (i = 0 ; i < 8 ; ++i) hex[i] = 0 ;
+    i = 0 ;
+    cp = addr ;
+    while (cp) {
+      if (sscanf(cp,"%lx:",&hex[i]) != 1) { *slashcp = '/' ; return(0) ; }
+      if ((cp = strchr(cp,':')))
+        ++cp ;
+      ++i ;
+      if (cp && (*cp == ':')) {
+        if (shuffle < 8) { *slashcp = '/' ; return(0) ; }
+        shuffle = i ;
+        ++cp ;
+        if (*cp == ':')
+          cp = 0 ;
+        }
+      if (i == 8) continue;
+      }
+    *slashcp = '/' ;
+    if (shuffle < 8) {
+      k = 7 ;
+      while (i > shuffle) {
+        hex[k] = hex[i-1] ;
+        hex[i-1] = 0 ;
+        --k ;
+        --i ;
+        }
+      }
+
+    for (i = 0 ; i < 8 ; ++i) {
+      x.sds[7 - i] = hex[i] ;
+      }
+    if ((!x.lds[0]) && (!x.lds[1])) return(0) ;
+    lr->family = 6 ;
+    lr->start = x.llds ;
+    lr->mask = mask ;
+    return(1) ;
+    }
+  /* address does not start with a digit - error */
+  if (!isdigit(*addr)) {
+    return(0);
+    }
+
+  /* Break address into octets and mask. If no explicit mask
+     then apply the class A/B/C rules */
+  i = sscanf(addr,"%d.%d.%d.%d/%d", &q[0], &q[1], &q[2], &q[3] ,&msk);
+  if (i < 4) return(0) ;
+  if (i < 5) {
+    if (q[0] < 128) msk = 8 ;
+    else if (q[0] < 192) msk = 16 ;
+    else msk = 24 ;
+    }
+
+  /* get start and end 32-bit address values of the address span */
+  strt4 = (q[0] << 24) + (q[1] << 16) + (q[2] << 8) + q[3];
+  if (!strt4) {
+    /* this is the default route - in this case its not much use, so it's rejected */
+    return(0) ;
+    }
+  lr->family = 4 ;
+  lr->start = strt4 ;
+  lr->mask = msk ;
+  return(1) ;
+}
+
+
+/*--------------------------------------------------
+ * add_prefix
+ * add the prefix parsed into <lr> to the table, with its origin or,
+ * if the table keeps paths, with its path text interned into the as
+ * path set. The first announcement of a prefix is kept, later
+ * duplicates are ignored
+ */
+
+void
+add_prefix(oa_table *t, struct loadrec *lr)
+{
+  struct pfxval *pv ;
+  struct pfxkey6 k6 ;
+  u_int32_t path = 0 ;
+  u_int32_t origin = lr->origin_as ;
+  int inserted ;
+
+  if (t->flags & OA_KEEP_PATH) {
+    if (!(path = parse_aspath(t,lr->path))) return ;
+    origin = t->paths[path].origin_as ;
+    }
+  if (!origin) return ;
+
+  if (!(t->flags & OA_INCREMENTAL)) {
+    if (lr->family == 6) pfx6_add(t,lr->start,lr->mask,origin,path) ;
+    else pfx4_add(t,(u_int32_t) lr->start,lr->mask,origin,path) ;
+    return ;
+    }
+
+  if (lr->family == 6) {
+    k6.start = lr->start ;
+    k6.mask = lr->mask ;
+    pv = pfxtree6_insert(&t->tree6,k6,&inserted) ;
+    }
+  else pv = pfxtree4_insert(&t->tree4,((u_int64_t) lr->start << 8) | lr->mask,&inserted) ;
+  if (inserted) {
+    pv->origin_as = origin ;
+    pv->path = path ;
+    }
+}
+
+
+/*--------------------------------------------------
+ * parse_field
+ * classify query field <f> as an address or prefix (setting <a4> or
+ * <a6>, and <mask> to the prefix length or -1 if there is none), or
+ * an AS number or ASnnn (setting <asn>). Return FIELD_V4, FIELD_V6,
+ * FIELD_ASN or FIELD_NONE. <f> is modified while it is parsed but
+ * restored before return
+ */
+
+int
+parse_field(char *f, u_int32_t *a4, u_int128_t *a6, int *mask, unsigned int *asn)
+{
+  v6addr x ;
+  unsigned int q[4] ;
+  int msk ;
+  int i ;
+  char *cp ;
+  char *cp1 ;
+  unsigned long int hex[8] ;
+  int k ;
+  int shuffle = 8 ;
+
+  *mask = -1 ;
+  if ((cp1 = strchr(f,':'))) {
+    if ((cp1 = strchr(f,'/'))) {
+      if (sscanf(cp1,"/%d",&msk) != 1) return(FIELD_NONE) ;
+      *mask = msk ;
+      *cp1 = '\0' ;
+      }
+    for (i = 0 ; i < 8 ; ++i) hex[i] = 0 ;
+    i = 0 ;
+    cp = f ;
+    while ((cp) && (*cp)) {
+      if ((i >= 8) || (sscanf(cp,"%lx",&hex[i]) != 1)) { if (cp1) *cp1 = '/' ; return(FIELD_NONE) ; }
+      if ((cp = strchr(cp,':'))) ++cp ;
+      ++i ;
+      if (cp && (*cp == ':')) {
+        if (shuffle < 8) { if (cp1) *cp1 = '/' ; return(FIELD_NONE) ; }
+        shuffle = i ;
+        ++cp ;
+        if (*cp == ':')  cp = 0 ;
+        }
+      }
+    if (cp1) *cp1 = '/' ;
+    if (shuffle < 8) {
+      k = 7 ;
+      while (i > shuffle) {
+        hex[k] = hex[i-1] ;
+        hex[i-1] = 0 ;
+        --k ;
+        --i ;
+        }
+      }
+    x.lds[1] = ((hex[0] & 65535) << 48) + ((hex[1] & 65535) << 32)  +
+        ((hex[2] & 65535) << 16) + (hex[3] & 65535) ;
+    x.lds[0] = ((hex[4] & 65535) << 48) + ((hex[5] & 65535) << 32)  +
+        ((hex[6] & 65535) << 16) + (hex[7] & 65535) ;
+    *a6 = x.llds ;
+    if (*a6 == 0) return(FIELD_NONE) ;
+    return(FIELD_V6) ;
+    }
+  else if ((cp1 = strchr(f,'.'))) {
+    i = sscanf(f,"%d.%d.%d.%d/%d", &q[0], &q[1], &q[2], &q[3] ,&msk);
+    if (i < 4) return(FIELD_NONE) ;
+    if (i == 5) *mask = msk ;
+    *a4 = ((q[0] & 255) << 24) + ((q[1] & 255) << 16) + ((q[2] & 255) << 8) + (q[3] & 255) ;
+    return(FIELD_V4) ;
+    }
+  else if (isdigit(*f)) {
+    *asn = strtoul(f,0,10) ;
+    return(FIELD_ASN) ;
+    }
+  else if ((toupper(*f) == 'A') && (toupper(*(f+1)) == 'S') && isdigit(*(f+2))) {
+    *asn = strtoul(f+2,0,10) ;
+    return(FIELD_ASN) ;
+    }
+  return(FIELD_NONE) ;
+  }
+
+
+/*--------------------------------------------------
+ * originas
+ * return the origin AS for query field <f>, which is an address,
+ * a prefix, an AS number or ASnnn. <c> is an optional cursor for
+ * runs of ascending addresses, <path> optionally takes the as path.
+ * A prefix that was announced as it is answers with the origin that
+ * announced it in OA_EXACT_INDEX tables
+ */
+
+unsigned int
+originas(const oa_table *t, oa_cursor *c, char *f, char **p, u_int32_t *path)
+{
+  u_int32_t strt ;
+  u_int128_t start ;
+  unsigned int as = 0 ;
+  int mask ;
+
+  switch (parse_field(f,&strt,&start,&mask,&as)) {
+    case FIELD_V6:
+      if ((mask >= 0) && exact6_origin(t,start,mask,&as,p,path)) return(as) ;
+      return(find6_origin_as(t,c,&start,p,path)) ;
+    case FIELD_V4:
+      if ((mask >= 0) && exact4_origin(t,strt,mask,&as,p,path)) return(as) ;
+      return(find4_origin_as(t,c,&strt,p,path)) ;
+    case FIELD_ASN:
+      return(as) ;
+    }
+  return(0) ;
+  }
+
+
+/*--------------------------------------------------
+ * overhang4, overhang6
+ * add the part of <ap> from <start> for <size> addresses that is left
+ * over past the more specific that follows it, placed in the list prior
+ * to the next entry with start >= the start of this remainder. Nothing
+ * is added if an announced prefix already covers exactly this span
+ */
+
+static struct addr4 *
+overhang4(oa_table *tb, struct addr4 *ap, u_int32_t start, u_int32_t size, char *addr)
+{
+  struct addr4 *t, *xn, *xp ;
+
+  xn = ap->nxt ;
+  xp = xn->prv ;
+  while ((xn) && ((xn->start < start) || ((xn->start == start) && (xn->size > size)))) { xp = xn ; xn = xn->nxt ; }
+  if (xn && (xn->start == start) && (xn->size == size)) return(0) ;
+  t = addr4_new(tb,start,size,0) ;
+  t->origin_as = ap->origin_as ;
+  t->path = ap->path ;
+  t->flags = 0 ;
+  t->status = 2 ;
+  t->address = addr ;
+  t->mask = ap->mask ;
+  t->prv = xp ;
+  if (xp) xp->nxt = t ;
+  t->nxt = xn ;
+  if (xn) xn->prv = t ;
+  return(t) ;
+}
+
+static struct addr6 *
+overhang6(oa_table *tb, struct addr6 *ap, u_int128_t start, u_int128_t size, char *addr)
+{
+  struct addr6 *t, *xn, *xp ;
+
+  xn = ap->nxt ;
+  xp = xn->prv ;
+  while ((xn) && ((xn->start < start) || ((xn->start == start) && (xn->size > size)))) { xp = xn ; xn = xn->nxt ; }
+  if (xn && (xn->start == start) && (xn->size == size)) return(0) ;
+  t = addr6_new(tb,start,size,0) ;
+  t->origin_as = ap->origin_as ;
+  t->path = ap->path ;
+  t->flags = 0 ;
+  t->status = 2 ;
+  t->address = addr ;
+  t->mask = ap->mask ;
+  t->prv = xp ;
+  if (xp) xp->nxt = t ;
+  t->nxt = xn ;
+  if (xn) xn->prv = t ;
+  return(t) ;
+}
+
+
+/*--------------------------------------------------
+ * deaggregate4
+ * flatten the sorted prefix list at v4head into non-overlapping ranges,
+ * more specifics taking precedence over the prefixes that cover them
+ */
+
+static void
+deaggregate4(oa_table *tb)
+{
+  struct addr4 *ap, *app, *apnxt ;
+  u_int32_t start, end, size ;
+  ap = tb->v4head ;
+  while (ap) {
+    app = 0 ;
+    if (ap->nxt) {
+      if (ap->end >= ap->nxt->start) {
+        if (ap->start < ap->nxt->start) {
+          /* shrink this to the leading part that is "exposed" */
+          /* record the overhang */
+          end = ap->end ;
+
+          /* now shrink this */
+          ap->end = ap->nxt->start - 1 ;
+          ap->size = ap->end - ap->start + 1 ;
+
+          /* if there is "overhang" then generate a new item with start ap->nxt->end + 1 through to ap->end */
+          if (end > ap->nxt->end) {
+            start = ap->nxt->end  + 1 ;
+            size = end - start + 1 ;
+            if (size > 0) overhang4(tb,ap,start,size,ap->address) ;
+            }
+          }
+        else if (ap->start == ap->nxt->start) {
+          /* there is no leading part */
+          /* remove ap from the linked list */
+          ap->status += 10 ;
+	  ap->nxt->prv = ap->prv ;
+          if (ap->prv) ap->prv->nxt = ap->nxt ;
+          else tb->v4head = ap->nxt ;
+          end = ap->end ;
+
+          app = ap ;
+
+          /* if there is "overhang" then generate a new item with start ap->nxt->end + 1 through to ap->end */
+          if (end > ap->nxt->end) {
+            start = ap->nxt->end  + 1 ;
+            size = end - start + 1 ;
+            if (size > 0) overhang4(tb,ap,start,size,ap->address) ;
+            }
+	  }
+        }
+      }
+    ap = ap->nxt ;
+    if (app) {
+      free(app) ;
+      app = 0 ;
+      }
+    }
+
+
+  if (!(tb->flags & OA_KEEP_PREFIX)) {
+    ap = tb->v4head ;
+    while (ap && ap->nxt) {
+      if ((ap->end +1 == ap->nxt->start) && (ap->origin_as == ap->nxt->origin_as) &&
+          (!(tb->flags & OA_KEEP_PATH) || (ap->path == ap->nxt->path))) {
+        app = ap->nxt ;
+        size = ap->size + app->size ;
+        end = app->end ;
+        apnxt = app->nxt ;
+
+        free(app) ;
+
+        ap->size = size ;
+        ap->end = end ;
+        ap->nxt = apnxt ;
+        if (apnxt) apnxt->prv = ap ;
+        }
+      else {
+        ap = ap->nxt ;
+        }
+      }
+    }
+}
+
+
+static void
+deaggregate6(oa_table *tb)
+{
+  struct addr6 *ap, *app, *apnxt ;
+  u_int128_t start, end, size ;
+  ap = tb->v6head ;
+  while (ap) {
+    app = 0 ;
+    if (ap->nxt) {
+      if (ap->end >= ap->nxt->start) {
+        if (ap->start < ap->nxt->start) {
+          /* shrink this to the leading part that is "exposed" */
+          /* record the overhang */
+          end = ap->end ;
+
+          /* now shrink this */
+          ap->end = ap->nxt->start - 1 ;
+          ap->size = ap->end - ap->start + 1 ;
+
+          /* if there is "overhang" then generate a new item with start ap->nxt->end + 1 through to ap->end */
+          if (end > ap->nxt->end) {
+            start = ap->nxt->end  ;
+            start += 1 ;
+            size = end ;
+            size  -= start ;
+            size += 1 ;
+            if (size > 0) overhang6(tb,ap,start,size,ap->address) ;
+            }
+          }
+        else if (ap->start == ap->nxt->start) {
+          /* there is no leading part */
+          /* remove ap from the linked list */
+          ap->status += 10 ;
+	  ap->nxt->prv = ap->prv ;
+          if (ap->prv) ap->prv->nxt = ap->nxt ;
+          else tb->v6head = ap->nxt ;
+          end = ap->end ;
+
+          app = ap ;
+
+          /* if there is "overhang" then generate a new item with start ap->nxt->end + 1 through to ap->end */
+          if (end > ap->nxt->end) {
+            start = ap->nxt->end  + 1 ;
+            size = end - start + 1 ;
+            if (size > 0) overhang6(tb,ap,start,size,ap->address) ;
+            }
+	  }
+        }
+      }
+    ap = ap->nxt ;
+    if (app) {
+      free(app) ;
+      app = 0 ;
+      }
+    }
+
+  if (!(tb->flags & OA_KEEP_PREFIX)) {
+    ap = tb->v6head ;
+    while (ap && ap->nxt) {
+      if ((ap->end +1 == ap->nxt->start) && (ap->origin_as == ap->nxt->origin_as) &&
+          (!(tb->flags & OA_KEEP_PATH) || (ap->path == ap->nxt->path))) {
+        app = ap->nxt ;
+        size = ap->size ;
+        size += app->size ;
+        end = app->end ;
+        apnxt = app->nxt ;
+
+        free(app) ;
+
+        ap->size = size ;
+        ap->end = end ;
+        ap->nxt = apnxt ;
+        if (apnxt) apnxt->prv = ap ;
+        }
+      else {
+        ap = ap->nxt ;
+        }
+      }
+    }
+}
+
+
+/*--------------------------------------------------
+ * link4, link6
+ * thread the prefixes of an incremental table into the sorted list,
+ * walking the leaves of its prefix tree in order
+ */
+
+static void
+link4(oa_table *t)
+{
+  const struct pfxtree4_leaf *lf ;
+  struct addr4 *ap, *tail = 0 ;
+  int i, mask ;
+
+  for (lf = t->tree4.first ; lf ; lf = lf->next) {
+    for (i = 0 ; i < lf->n ; ++i) {
+      mask = lf->key[i] & 255 ;
+      ap = addr4_new(t,(u_int32_t) (lf->key[i] >> 8),(u_int32_t) 1 << (32 - mask),mask) ;
+      ap->origin_as = lf->val[i].origin_as ;
+      ap->path = lf->val[i].path ;
+      ap->prv = tail ;
+      if (tail) tail->nxt = ap ;
+      else t->v4head = ap ;
+      tail = ap ;
+      }
+    }
+}
+
+static void
+link6(oa_table *t)
+{
+  const struct pfxtree6_leaf *lf ;
+  struct addr6 *ap, *tail = 0 ;
+  int i ;
+
+  for (lf = t->tree6.first ; lf ; lf = lf->next) {
+    for (i = 0 ; i < lf->n ; ++i) {
+      ap = addr6_new(t,lf->key[i].start,(u_int128_t) 1 << (128 - lf->key[i].mask),lf->key[i].mask) ;
+      ap->origin_as = lf->val[i].origin_as ;
+      ap->path = lf->val[i].path ;
+      ap->prv = tail ;
+      if (tail) tail->nxt = ap ;
+      else t->v6head = ap ;
+      tail = ap ;
+      }
+    }
+}
+
+
+/*--------------------------------------------------
+ * pfx4_sort, pfx6_sort
+ * radix sort a vector of prefixes into prefix tree order, start then
+ * length, and drop all but the first of any duplicates. Return 0,
+ * with the vector as it was, if there is no memory to sort it
+ */
+
+int
+pfx4_sort(struct pfxvec *pv)
+{
+  static const int keys[5] = { RADIX_KEY(0,8,0), RADIX_KEY(0,8,1), RADIX_KEY(0,8,2),
+                               RADIX_KEY(0,8,3), RADIX_KEY(0,8,4) } ;
+  struct pfx4 *pp = (struct pfx4 *) pv->v ;
+  size_t i, n = 0 ;
+
+  if (!oa_radixsort(pp,pv->n,sizeof *pp,keys,5)) return(0) ;
+  for (i = 0 ; i < pv->n ; ++i) {
+    if (n && (pp[i].key == pp[n - 1].key)) continue ;
+    pp[n++] = pp[i] ;
+    }
+  pv->n = n ;
+  return(1) ;
+}
+
+int
+pfx6_sort(struct pfxvec *pv)
+{
+  static const int keys[17] = { offsetof(struct pfx6,mask),
+                                RADIX_KEY(0,16,0), RADIX_KEY(0,16,1), RADIX_KEY(0,16,2), RADIX_KEY(0,16,3),
+                                RADIX_KEY(0,16,4), RADIX_KEY(0,16,5), RADIX_KEY(0,16,6), RADIX_KEY(0,16,7),
+                                RADIX_KEY(0,16,8), RADIX_KEY(0,16,9), RADIX_KEY(0,16,10), RADIX_KEY(0,16,11),
+                                RADIX_KEY(0,16,12), RADIX_KEY(0,16,13), RADIX_KEY(0,16,14), RADIX_KEY(0,16,15) } ;
+  struct pfx6 *pp = (struct pfx6 *) pv->v ;
+  size_t i, n = 0 ;
+
+  if (!oa_radixsort(pp,pv->n,sizeof *pp,keys,17)) return(0) ;
+  for (i = 0 ; i < pv->n ; ++i) {
+    if (n && (pp[i].start == pp[n - 1].start) && (pp[i].mask == pp[n - 1].mask)) continue ;
+    pp[n++] = pp[i] ;
+    }
+  pv->n = n ;
+  return(1) ;
+}
+
+
+/*--------------------------------------------------
+ * run_add
+ * append a run of prefixes to the table. The prefixes loaded one file
+ * at a time are collected as the open run, closed off (unsorted) when
+ * another run is added or the table is built
+ */
+
+struct pfxrun *
+run_add(oa_table *t)
+{
+  struct pfxrun *rn ;
+
+  if (t->nruns == t->maxruns) {
+    t->maxruns = (t->maxruns ? t->maxruns * 2 : 8) ;
+    t->runs = (struct pfxrun *) realloc(t->runs,t->maxruns * sizeof *t->runs) ;
+    }
+  rn = &t->runs[t->nruns++] ;
+  memset(rn,0,sizeof *rn) ;
+  return(rn) ;
+}
+
+void
+run_close(oa_table *t)
+{
+  struct pfxrun *rn ;
+
+  if (!t->pv4.n && !t->pv6.n) return ;
+  rn = run_add(t) ;
+  rn->pv4 = t->pv4 ;
+  rn->pv6 = t->pv6 ;
+  memset(&t->pv4,0,sizeof t->pv4) ;
+  memset(&t->pv6,0,sizeof t->pv6) ;
+}
+
+
+/*--------------------------------------------------
+ * bulk4, bulk6
+ * sort every run and merge them into the sorted prefix list. Each
+ * run is in load order and has no duplicates of its own, so where runs
+ * share a prefix the one from the earliest run is kept - the first
+ * announcement wins, whichever thread loaded which run
+ */
+
+static int
+merge4_less(const struct pfxrun *rn, const size_t *pos, size_t a, size_t b)
+{
+  u_int64_t ka = ((struct pfx4 *) rn[a].pv4.v)[pos[a]].key ;
+  u_int64_t kb = ((struct pfx4 *) rn[b].pv4.v)[pos[b]].key ;
+
+  return((ka < kb) || ((ka == kb) && (a < b))) ;
+}
+
+static int
+merge6_less(const struct pfxrun *rn, const size_t *pos, size_t a, size_t b)
+{
+  const struct pfx6 *pa = &((struct pfx6 *) rn[a].pv6.v)[pos[a]] ;
+  const struct pfx6 *pb = &((struct pfx6 *) rn[b].pv6.v)[pos[b]] ;
+
+  if (pa->start != pb->start) return(pa->start < pb->start) ;
+  if (pa->mask != pb->mask) return(pa->mask < pb->mask) ;
+  return(a < b) ;
+}
+
+/* restore the heap of run indices below <i> */
+
+static void
+heap_down(size_t *heap, size_t n, size_t i, const struct pfxrun *rn, const size_t *pos,
+          int (*less)(const struct pfxrun *, const size_t *, size_t, size_t))
+{
+  size_t c, tmp ;
+
+  while ((c = (2 * i) + 1) < n) {
+    if ((c + 1 < n) && less(rn,pos,heap[c + 1],heap[c])) ++c ;
+    if (!less(rn,pos,heap[c],heap[i])) break ;
+    tmp = heap[i] ;
+    heap[i] = heap[c] ;
+    heap[c] = tmp ;
+    i = c ;
+    }
+}
+
+static int
+bulk4(oa_table *t)
+{
+  struct pfxrun *rn ;
+  struct pfx4 *pp ;
+  struct addr4 *ap, *tail = 0 ;
+  size_t *heap, *pos ;
+  size_t i, n = 0 ;
+  u_int64_t last = 0 ;
+  int mask ;
+
+  run_close(t) ;
+  rn = t->runs ;
+  heap = (size_t *) malloc((t->nruns + 1) * sizeof *heap) ;
+  pos = (size_t *) calloc(t->nruns + 1,sizeof *pos) ;
+  for (i = 0 ; i < t->nruns ; ++i) {
+    if (!rn[i].sorted && !pfx4_sort(&rn[i].pv4)) {
+      free(heap) ;
+      free(pos) ;
+      return(0) ;
+      }
+    if (rn[i].pv4.n) heap[n++] = i ;
+    }
+  for (i = n ; i-- > 0 ; ) heap_down(heap,n,i,rn,pos,merge4_less) ;
+
+  while (n) {
+    i = heap[0] ;
+    pp = &((struct pfx4 *) rn[i].pv4.v)[pos[i]] ;
+    if (!tail || (pp->key != last)) {
+      mask = pp->key & 255 ;
+      ap = addr4_new(t,(u_int32_t) (pp->key >> 8),(u_int32_t) 1 << (32 - mask),mask) ;
+      ap->origin_as = pp->origin_as ;
+      ap->path = pp->path ;
+      ap->prv = tail ;
+      if (tail) tail->nxt = ap ;
+      else t->v4head = ap ;
+      tail = ap ;
+      last = pp->key ;
+      }
+    if (++pos[i] == rn[i].pv4.n) heap[0] = heap[--n] ;
+    heap_down(heap,n,0,rn,pos,merge4_less) ;
+    }
+
+  for (i = 0 ; i < t->nruns ; ++i) {
+    free(rn[i].pv4.v) ;
+    memset(&rn[i].pv4,0,sizeof rn[i].pv4) ;
+    }
+  free(heap) ;
+  free(pos) ;
+  return(1) ;
+}
+
+static int
+bulk6(oa_table *t)
+{
+  struct pfxrun *rn ;
+  struct pfx6 *pp ;
+  struct addr6 *ap, *tail = 0 ;
+  size_t *heap, *pos ;
+  size_t i, n = 0 ;
+
+  run_close(t) ;
+  rn = t->runs ;
+  heap = (size_t *) malloc((t->nruns + 1) * sizeof *heap) ;
+  pos = (size_t *) calloc(t->nruns + 1,sizeof *pos) ;
+  for (i = 0 ; i < t->nruns ; ++i) {
+    if (!rn[i].sorted && !pfx6_sort(&rn[i].pv6)) {
+      free(heap) ;
+      free(pos) ;
+      return(0) ;
+      }
+    if (rn[i].pv6.n) heap[n++] = i ;
+    }
+  for (i = n ; i-- > 0 ; ) heap_down(heap,n,i,rn,pos,merge6_less) ;
+
+  while (n) {
+    i = heap[0] ;
+    pp = &((struct pfx6 *) rn[i].pv6.v)[pos[i]] ;
+    if (!tail || (pp->start != tail->start) || (pp->mask != tail->mask)) {
+      ap = addr6_new(t,pp->start,(u_int128_t) 1 << (128 - pp->mask),pp->mask) ;
+      ap->origin_as = pp->origin_as ;
+      ap->path = pp->path ;
+      ap->prv = tail ;
+      if (tail) tail->nxt = ap ;
+      else t->v6head = ap ;
+      tail = ap ;
+      }
+    if (++pos[i] == rn[i].pv6.n) heap[0] = heap[--n] ;
+    heap_down(heap,n,0,rn,pos,merge6_less) ;
+    }
+
+  for (i = 0 ; i < t->nruns ; ++i) {
+    free(rn[i].pv6.v) ;
+    memset(&rn[i].pv6,0,sizeof rn[i].pv6) ;
+    }
+  free(heap) ;
+  free(pos) ;
+  return(1) ;
+}
+
+
+/*--------------------------------------------------
+ * compile4, compile6
+ * copy the deaggregated list into the range array used for lookups,
+ * merging adjacent ranges with the same origin (and path, if paths are
+ * kept). A table that keeps prefixes leaves those unmerged in the list,
+ * so each list entry becomes a piece of the side table as well. The
+ * list is released - an incremental table keeps its prefix trees -
+ * and the ranges are moved onto huge pages if there are any
+ */
+
+static void
+compile4(oa_table *t)
+{
+  struct addr4 *ap, *nxt ;
+  struct range4 *r ;
+  struct prov4 *pc ;
+  size_t n = 0, nr = 0 ;
+  int keep = (t->flags & OA_KEEP_PREFIX) ;
+
+  for (ap = t->v4head ; ap ; ap = ap->nxt) ++n ;
+  t->r4 = r = (struct range4 *) malloc((n ? n : 1) * sizeof *r) ;
+  if (keep) t->p4 = (struct prov4 *) malloc((n ? n : 1) * sizeof *t->p4) ;
+  for (ap = t->v4head ; ap ; ap = nxt) {
+    nxt = ap->nxt ;
+    if (keep) {
+      pc = &t->p4[t->np4++] ;
+      pc->start = ap->start ;
+      pc->end = ap->end ;
+      pc->origin_as = ap->origin_as ;
+      pc->mask = ap->mask ;
+      pc->address = ap->address ;
+      }
+    if (nr && (r[nr - 1].end + 1 == ap->start) && (r[nr - 1].origin_as == ap->origin_as) &&
+        (!(t->flags & OA_KEEP_PATH) || (r[nr - 1].path == ap->path))) {
+      r[nr - 1].end = ap->end ;
+      }
+    else {
+      r[nr].start = ap->start ;
+      r[nr].end = ap->end ;
+      r[nr].origin_as = ap->origin_as ;
+      r[nr].path = ap->path ;
+      r[nr].prov = (keep ? (u_int32_t) (t->np4 - 1) : 0) ;
+      ++nr ;
+      }
+    free(ap) ;
+    }
+  t->v4head = 0 ;
+  t->n4 = nr ;
+  t->r4 = (struct range4 *) huge_move(&t->r4mem,t->r4,nr * sizeof *r) ;
+}
+
+static void
+compile6(oa_table *t)
+{
+  struct addr6 *ap, *nxt ;
+  struct range6 *r ;
+  struct prov6 *pc ;
+  size_t n = 0, nr = 0 ;
+  int keep = (t->flags & OA_KEEP_PREFIX) ;
+
+  for (ap = t->v6head ; ap ; ap = ap->nxt) ++n ;
+  t->r6 = r = (struct range6 *) malloc((n ? n : 1) * sizeof *r) ;
+  if (keep) t->p6 = (struct prov6 *) malloc((n ? n : 1) * sizeof *t->p6) ;
+  for (ap = t->v6head ; ap ; ap = nxt) {
+    nxt = ap->nxt ;
+    if (keep) {
+      pc = &t->p6[t->np6++] ;
+      pc->start = ap->start ;
+      pc->end = ap->end ;
+      pc->origin_as = ap->origin_as ;
+      pc->mask = ap->mask ;
+      pc->address = ap->address ;
+      }
+    if (nr && (r[nr - 1].end + 1 == ap->start) && (r[nr - 1].origin_as == ap->origin_as) &&
+        (!(t->flags & OA_KEEP_PATH) || (r[nr - 1].path == ap->path))) {
+      r[nr - 1].end = ap->end ;
+      }
+    else {
+      r[nr].start = ap->start ;
+      r[nr].end = ap->end ;
+      r[nr].origin_as = ap->origin_as ;
+      r[nr].path = ap->path ;
+      r[nr].prov = (keep ? (u_int32_t) (t->np6 - 1) : 0) ;
+      ++nr ;
+      }
+    free(ap) ;
+    }
+  t->v6head = 0 ;
+  t->n6 = nr ;
+  t->r6 = (struct range6 *) huge_move(&t->r6mem,t->r6,nr * sizeof *r) ;
+}
+
+int
+oa_table_load_names(oa_table *t, const char *fname) {
+  FILE *f ;
+  char buffer[1024] ;
+  unsigned int asn, ash, asl ;
+  char *name ;
+  char *cp ;
+  struct avldata local ;
+  struct as_names sasn ;
+  struct as_names *sasnp ;
+  avl_ptr tmp ;
+  int inserted ;
+
+  local.payload = &sasn ;
+  if (!(f = fopen(fname,"r"))) return(0) ;
+  while (fgets(buffer,1023,f)) {
+    buffer[strlen(buffer) - 1] = '\0';
+    if (*buffer == '#') continue ;
+
+    name = "" ;
+    if ((cp = strchr(buffer,'\t'))) {
+      name = (cp + 1) ;
+      *cp = '\0'; ;
+      }
+    else if ((cp = strchr(buffer,' '))) {
+      name = &buffer[8] ;
+      *cp = '\0'; ;
+      }
+    if (strchr(buffer,'.')) {
+      sscanf(buffer,"%d.%d",&ash,&asl) ;
+      asn = (ash << 16) + asl ;
+      }
+    else
+      asn = strtoul(buffer,0,10) ;
+
+    sasn.as = asn ;
+    inserted = 0 ;
+    avlinsert_r(&t->asnames,&local,asn_cmp,&tmp,&inserted) ;
+    if (inserted) {
+      sasnp = (struct as_names *) malloc(sizeof *sasnp) ;
+      sasnp->as = asn ;
+      sasnp->asname = strdup(name) ;
+      tmp->payload = sasnp ;
+      }
+    }
+  fclose(f) ;
+  return(1) ;
+}
+
+/*--------------------------------------------------------------------------------------------------*/
+
+/*
+ * table construction and release
+ */
+
+int
+oa_abi_version(void)
+{
+  return(OA_ABI_VERSION) ;
+}
+
+oa_table *
+oa_table_new(int flags)
+{
+  oa_table *t ;
+
+  if (!(t = (oa_table *) calloc(1, sizeof *t))) return(0) ;
+  /* live updates redraw ranges from the prefix trees, by origin alone,
+     and leave the compiled ranges the origin index points into, and the
+     nested prefixes, behind */
+  if (flags & OA_LIVE)
+    flags = (flags | OA_INCREMENTAL) &
+            ~(OA_KEEP_PREFIX | OA_KEEP_PATH | OA_KEEP_NEST | OA_KEEP_ORIGIN | OA_EXACT_INDEX) ;
+  t->flags = flags ;
+  return(t) ;
+}
+
+/*--------------------------------------------------
+ * oa_table_build
+ * sort and deaggregate the loaded prefixes - after this
+ * the table is read-only and may be shared between threads.
+ * Prefixes are sorted in bulk unless the table was loaded
+ * through the prefix trees, which are already in order.
+ * Return 0 if there was no memory to sort them - the table
+ * can then only be freed
+ */
+
+int
+oa_table_build(oa_table *t)
+{
+  if (t->built) return(1) ;
+
+  t->v4head = 0 ;
+  t->v6head = 0 ;
+  if (t->flags & OA_INCREMENTAL) {
+    link4(t) ;
+    link6(t) ;
+    }
+  else if (!bulk4(t) || !bulk6(t)) return(0) ;
+  if (t->flags & OA_KEEP_NEST) {
+    nest4_build(t) ;
+    nest6_build(t) ;
+    }
+  if (t->flags & OA_EXACT_INDEX) {
+    exact4_build(t) ;
+    exact6_build(t) ;
+    }
+
+  deaggregate4(t) ;
+  compile4(t) ;
+  deaggregate6(t) ;
+  compile6(t) ;
+  if (t->flags & OA_KEEP_ORIGIN) asindex_build(t) ;
+  if (t->flags & OA_LIVE) live_build(t) ;
+
+  t->built = 1 ;
+  return(1) ;
+}
+
+static void
+free_asname(void *p)
+{
+  free(((struct as_names *) p)->asname) ;
+  free(p) ;
+}
+
+void
+oa_table_free(oa_table *t)
+{
+  struct strblk *sb ;
+  size_t i ;
+
+  if (!t) return ;
+  if (t->master) {
+    replica_free(t) ;
+    return ;
+    }
+  live_free(t) ;
+  pfxtree4_free(&t->tree4) ;
+  pfxtree6_free(&t->tree6) ;
+  avldestroy(&t->asnames,free_asname) ;
+  free(t->pv4.v) ;
+  free(t->pv6.v) ;
+  for (i = 0 ; i < t->nruns ; ++i) {
+    free(t->runs[i].pv4.v) ;
+    free(t->runs[i].pv6.v) ;
+    }
+  free(t->runs) ;
+  huge_free(&t->r4mem) ;
+  huge_free(&t->r6mem) ;
+  free(t->p4) ;
+  free(t->p6) ;
+  free(t->nest4) ;
+  free(t->nest6) ;
+  asindex_free(t) ;
+  exact_free(t) ;
+  free_aspaths(t) ;
+  while ((sb = t->strings)) {
+    t->strings = sb->nxt ;
+    free(sb) ;
+    }
+  free(t) ;
+}
+
+
+/*--------------------------------------------------------------------------------------------------*/
+
+/*
+ * lookups
+ */
+
+uint32_t
+oa_lookup4(const oa_table *t, uint32_t addr, const char **prefix)
+{
+  char *p = 0 ;
+  unsigned int as ;
+
+  as = find4_origin_as(t,0,&addr,&p,0) ;
+  if (prefix) *prefix = p ;
+  return(as) ;
+}
+
+uint32_t
+oa_lookup6(const oa_table *t, const uint8_t addr[16], const char **prefix)
+{
+  u_int128_t start = 0 ;
+  char *p = 0 ;
+  unsigned int as ;
+  int i ;
+
+  for (i = 0 ; i < 16 ; ++i) start = (start << 8) | addr[i] ;
+  as = find6_origin_as(t,0,&start,&p,0) ;
+  if (prefix) *prefix = p ;
+  return(as) ;
+}
+
+/*--------------------------------------------------
+ * oa_lookup4_len, oa_lookup6_len
+ * the origin of an address and, in <length>, the length of the
+ * announced prefix covering it - 0 if the address is not announced,
+ * -1 if the table does not keep prefixes
+ */
+
+uint32_t
+oa_lookup4_len(const oa_table *t, oa_cursor *c, uint32_t addr, int *length)
+{
+  const struct range4 *r ;
+  unsigned int as ;
+
+  if (t->live) {
+    *length = ((as = live4_origin(t,addr)) ? -1 : 0) ;
+    return(as) ;
+    }
+  if (!(r = find4_range(t,c,addr))) {
+    *length = 0 ;
+    return(0) ;
+    }
+  *length = ((t->flags & OA_KEEP_PREFIX) ? prov4_find(t,r,addr)->mask : -1) ;
+  return(r->origin_as) ;
+}
+
+uint32_t
+oa_lookup6_len(const oa_table *t, oa_cursor *c, const uint8_t addr[16], int *length)
+{
+  const struct range6 *r ;
+  u_int128_t start = 0 ;
+  unsigned int as ;
+  int i ;
+
+  for (i = 0 ; i < 16 ; ++i) start = (start << 8) | addr[i] ;
+  if (t->live) {
+    *length = ((as = live6_origin(t,start)) ? -1 : 0) ;
+    return(as) ;
+    }
+  if (!(r = find6_range(t,c,start))) {
+    *length = 0 ;
+    return(0) ;
+    }
+  *length = ((t->flags & OA_KEEP_PREFIX) ? prov6_find(t,r,start)->mask : -1) ;
+  return(r->origin_as) ;
+}
+
+uint32_t
+oa_lookup(const oa_table *t, const char *field, const char **prefix)
+{
+  char f[128] ;
+  char *p = 0 ;
+  unsigned int as ;
+
+  strncpy(f,field,sizeof f - 1) ;
+  f[sizeof f - 1] = '\0' ;
+  as = originas(t,0,f,&p,0) ;
+  if (prefix) *prefix = p ;
+  return(as) ;
+}
+
+uint32_t
+oa_lookup_sorted(const oa_table *t, oa_cursor *c, const char *field, const char **prefix)
+{
+  char f[128] ;
+  char *p = 0 ;
+  unsigned int as ;
+
+  strncpy(f,field,sizeof f - 1) ;
+  f[sizeof f - 1] = '\0' ;
+  as = originas(t,c,f,&p,0) ;
+  if (prefix) *prefix = p ;
+  return(as) ;
+}
+
+size_t
+oa_lookup_batch(const oa_table *t, const char *const *fields, size_t n,
+                uint32_t *origins, const char **prefixes)
+{
+  size_t i ;
+  size_t found = 0 ;
+
+  for (i = 0 ; i < n ; ++i) {
+    if ((origins[i] = oa_lookup(t,fields[i],(prefixes ? &prefixes[i] : 0)))) ++found ;
+    }
+  return(found) ;
+}
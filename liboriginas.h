@@ -0,0 +1,228 @@
+/* liboriginas.h
+
+   embeddable origin AS lookup
+
+   A table is built from one or more bgp dump files (the same files
+   the originas command reads) and is then read-only: any number of
+   tables may coexist, and a built table may be queried from any
+   number of threads at once.
+
+     oa_table *t = oa_table_new(0) ;
+     oa_table_load(t, "bgp4.txt") ;
+     oa_table_load(t, "bgp6.txt") ;
+     oa_table_build(t) ;
+     asn = oa_lookup(t, "192.0.2.1", 0) ;
+     oa_table_free(t) ;
+
+   Only fixed width types cross this interface, and the table itself
+   is opaque, so the ABI stays stable as the implementation changes.
+*/
+
+#ifndef LIBORIGINAS_H
+#define LIBORIGINAS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OA_ABI_VERSION 1
+
+#if defined(__GNUC__)
+#define OA_EXPORT __attribute__((visibility("default")))
+#else
+#define OA_EXPORT
+#endif
+
+typedef struct oa_table oa_table ;
+
+/* position in the table for lookups of ascending addresses -
+   zero it before the first oa_lookup_sorted() of a run */
+
+typedef struct oa_cursor {
+  uint64_t pos4 ;
+  uint64_t pos6 ;
+  } oa_cursor ;
+
+/* a prefix and its origin, as the prefix queries return them */
+
+typedef struct oa_prefix {
+  uint8_t family ;          /* 4 or 6 */
+  uint8_t length ;
+  uint8_t addr[16] ;        /* network order - a v4 address in the first 4 bytes */
+  uint32_t origin ;
+  } oa_prefix ;
+
+/* the address space of an origin, as oa_table_space() returns it */
+
+typedef struct oa_space {
+  uint32_t origin ;
+  uint64_t addrs4 ;
+  uint64_t addrs6[2] ;      /* high word first */
+  } oa_space ;
+
+/* oa_table_new flags */
+
+#define OA_KEEP_PREFIX  0x0001    /* keep the announced prefix of each range (originas -m) */
+#define OA_INCREMENTAL  0x0002    /* load through the prefix trees, kept for later updates */
+#define OA_KEEP_PATH    0x0004    /* keep the as path of each range for the path queries */
+#define OA_LIVE         0x0008    /* keep the table open to oa_table_update() once built */
+#define OA_KEEP_NEST    0x0010    /* keep the announced prefixes nested, for oa_covering() */
+#define OA_KEEP_ORIGIN  0x0020    /* index the ranges on origin, for oa_origin_prefixes() */
+#define OA_EXACT_INDEX  0x0040    /* hash the announced prefixes - see oa_lookup() */
+
+/* oa_table_pages kinds */
+
+#define OA_PAGES_BASE     0       /* ordinary pages, from malloc */
+#define OA_PAGES_THP      1       /* transparent huge pages, asked for with madvise */
+#define OA_PAGES_HUGETLB  2       /* explicit huge pages, from those the system reserves */
+
+/* oa_table_export formats */
+
+#define OA_FMT_CSV      0x0000    /* start,end,origin text lines */
+#define OA_FMT_BINARY   0x0001    /* fixed width network order records */
+#define OA_FMT_CIDR     0x0010    /* split each range into minimal CIDR blocks */
+
+/* table construction - a table is not thread safe until oa_table_build() returns,
+   which it does with 0 if there is no memory to sort the prefixes.
+   oa_table_load_files() loads several files at once, with the same result
+   as loading them in order, and returns n or the index of the first file
+   that cannot be opened.
+   oa_table_diff() writes the address ranges whose origin differs between
+   two built tables as start,end,old origin,new origin lines, with origin
+   0 where a range is not announced in that table */
+
+OA_EXPORT extern int       oa_abi_version(void) ;
+OA_EXPORT extern oa_table *oa_table_new(int flags) ;
+OA_EXPORT extern int       oa_table_load(oa_table *, const char *filename) ;
+OA_EXPORT extern size_t    oa_table_load_files(oa_table *, const char *const *files, size_t n) ;
+OA_EXPORT extern int       oa_table_load_names(oa_table *, const char *filename) ;
+OA_EXPORT extern int       oa_table_build(oa_table *) ;
+OA_EXPORT extern void      oa_table_free(oa_table *) ;
+OA_EXPORT extern int       oa_table_export(const oa_table *, int fd, int format) ;
+OA_EXPORT extern int       oa_table_diff(const oa_table *from, const oa_table *to, int fd,
+                                         size_t *changes) ;
+
+/* the arrays lookups search are put on huge pages once they fill one,
+   where the system has them, to spare the TLB. oa_table_pages() returns
+   the OA_PAGES_ kind of the largest of a built table, and sets pagesize
+   (if not NULL) to its page size */
+
+OA_EXPORT extern int       oa_table_pages(const oa_table *, size_t *pagesize) ;
+
+/* NUMA - oa_numa_nodes() is the number of memory nodes (OA_NUMA_NODES in
+   the environment simulates that many, sharing out the CPUs), and
+   oa_numa_bind() pins the calling thread to the CPUs of one, returning 0
+   if it cannot. oa_table_replica() called from a pinned thread copies
+   the arrays the lookups of a built table search into that node's
+   memory, sharing the rest with the original, which must outlive it.
+   A replica is looked up in like any table and released with
+   oa_table_free(). Live tables are not replicated (NULL is returned) */
+
+OA_EXPORT extern int       oa_numa_nodes(void) ;
+OA_EXPORT extern int       oa_numa_bind(int node) ;
+OA_EXPORT extern oa_table *oa_table_replica(const oa_table *) ;
+
+/* lookups - return the origin AS, or 0 if the address is not announced.
+   If prefix is not NULL it is set to the announced prefix covering the
+   address (OA_KEEP_PREFIX tables only), owned by the table.
+   oa_lookup_sorted() is oa_lookup() for fields that mostly arrive in
+   ascending address order: each lookup starts from where the last one
+   ended, and an address that goes backwards costs one ordinary search.
+   In a table made with OA_EXACT_INDEX a field that is a prefix exactly
+   as announced is found in one hash probe, and answers with the origin
+   (and prefix and path) of that announcement rather than those of its
+   first address */
+
+OA_EXPORT extern uint32_t  oa_lookup4(const oa_table *, uint32_t addr, const char **prefix) ;
+OA_EXPORT extern uint32_t  oa_lookup6(const oa_table *, const uint8_t addr[16], const char **prefix) ;
+OA_EXPORT extern uint32_t  oa_lookup(const oa_table *, const char *field, const char **prefix) ;
+OA_EXPORT extern size_t    oa_lookup_batch(const oa_table *, const char *const *fields, size_t n,
+                                           uint32_t *origins, const char **prefixes) ;
+OA_EXPORT extern uint32_t  oa_lookup_sorted(const oa_table *, oa_cursor *, const char *field,
+                                            const char **prefix) ;
+OA_EXPORT extern const char *oa_asname(const oa_table *, uint32_t asn) ;
+
+/* lookups that also set length to the announced prefix length, 0 if
+   the address is not announced, -1 if the table was not made with
+   OA_KEEP_PREFIX. The cursor may be NULL */
+
+OA_EXPORT extern uint32_t  oa_lookup4_len(const oa_table *, oa_cursor *, uint32_t addr, int *length) ;
+OA_EXPORT extern uint32_t  oa_lookup6_len(const oa_table *, oa_cursor *, const uint8_t addr[16],
+                                          int *length) ;
+
+/* prefix nesting - the announced prefixes covering an address or prefix,
+   most specific first, and those inside a prefix (itself included), in
+   address order. Up to max are stored and the number there are is
+   returned. Only tables made with OA_KEEP_NEST keep the prefixes -
+   others always return 0 */
+
+OA_EXPORT extern size_t    oa_covering(const oa_table *, const char *field, oa_prefix *out, size_t max) ;
+OA_EXPORT extern size_t    oa_more_specifics(const oa_table *, const char *field, oa_prefix *out,
+                                             size_t max) ;
+
+/* origins - the address space an origin AS announces, as the fewest CIDR
+   blocks, v4 and then v6, each in address order. Up to max are stored
+   and the number there are is returned. addrs4 and addrs6 (high word
+   first) are set to the number of addresses, if they are not NULL. Only
+   tables made with OA_KEEP_ORIGIN are indexed - others always return 0.
+   oa_table_space() needs no index: it totals the addresses of every
+   origin in one pass, and stores up to max of them in AS order,
+   returning the number of origins. A live table is totalled as built */
+
+OA_EXPORT extern size_t    oa_origin_prefixes(const oa_table *, uint32_t asn, oa_prefix *out, size_t max,
+                                              uint64_t *addrs4, uint64_t addrs6[2]) ;
+OA_EXPORT extern size_t    oa_table_space(const oa_table *, oa_space *out, size_t max) ;
+
+/* as paths - oa_lookup_path() returns the as path of the best route
+   covering an address, 0 if there is none. A path is a handle into the
+   table, valid until the table is freed. Paths are only kept by tables
+   made with OA_KEEP_PATH - otherwise the build reads just the origin of
+   each path, and every lookup returns path 0.
+   oa_path_get() stores up to max ASs, neighbour first, and returns the
+   path length */
+
+OA_EXPORT extern uint32_t  oa_lookup_path(const oa_table *, oa_cursor *, const char *field) ;
+OA_EXPORT extern uint32_t  oa_path_length(const oa_table *, uint32_t path) ;
+OA_EXPORT extern uint32_t  oa_path_neighbour(const oa_table *, uint32_t path) ;
+OA_EXPORT extern uint32_t  oa_path_origin(const oa_table *, uint32_t path) ;
+OA_EXPORT extern int       oa_path_contains(const oa_table *, uint32_t path, uint32_t asn) ;
+OA_EXPORT extern size_t    oa_path_get(const oa_table *, uint32_t path, uint32_t *ases, size_t max) ;
+
+/* live tables - a table made with OA_LIVE is loaded and built as usual
+   and may then be updated from MRT BGP4MP update files (or pipes) while
+   it is searched from other threads: oa_table_update() applies each
+   UPDATE message as a whole, between lookups. It returns the number of
+   MRT records read, or -1 on error. A live table keeps no prefixes,
+   paths, nesting or origin index (those flags are dropped), and export,
+   history and oa_table_space() see the table as it was built.
+   oa_update_stats() gives the messages applied, the prefixes announced
+   and withdrawn, and the total and longest time to apply a message */
+
+OA_EXPORT extern long      oa_table_update(oa_table *, const char *filename) ;
+OA_EXPORT extern void      oa_update_stats(const oa_table *, uint64_t *messages, uint64_t *announced,
+                                           uint64_t *withdrawn, uint64_t *nsec, uint64_t *maxnsec) ;
+
+/* origin history - built tables are added in time order (any 32 bit
+   time, e.g. yyyymmdd or a unix time) and may be freed once added.
+   Unannounced space has origin 0. oa_history_changes() returns the
+   number of changes, storing the newest max of them oldest first */
+
+typedef struct oa_history oa_history ;
+
+OA_EXPORT extern oa_history *oa_history_new(void) ;
+OA_EXPORT extern int       oa_history_add(oa_history *, uint32_t when, const oa_table *) ;
+OA_EXPORT extern uint32_t  oa_history_lookup(const oa_history *, const char *field, uint32_t when) ;
+OA_EXPORT extern size_t    oa_history_changes(const oa_history *, const char *field,
+                                              uint32_t *when, uint32_t *origins, size_t max) ;
+OA_EXPORT extern void      oa_history_stats(const oa_history *, size_t *snapshots,
+                                            size_t *segments, size_t *changes) ;
+OA_EXPORT extern void      oa_history_free(oa_history *) ;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,463 @@
+/* loader.c
+
+   load a bgp dump into a table as a pipeline
+
+     reader     reads (and inflates) the dump in blocks of whole entries
+     parsers    turn the lines of a block into prefix records
+     inserter   adds the records to the table - the calling thread
+
+   The stages are joined by bounded single producer, single consumer
+   queues: the reader deals blocks to the parsers in turn, and the
+   inserter takes them back from the parsers in the same turn, so the
+   records reach the table in file order and the first announcement of
+   a prefix still wins. A full queue holds its producer back, so no more
+   than a few blocks per parser are ever in memory.
+
+   oa_table_load_files() runs one such pipeline per file, a few files
+   at a time, each into a sorted run that the build merges in file order.
+
+*/
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+#include "originas.h"
+
+#define LOAD_PARSERS  4       /* most parser threads */
+#define LOAD_DEPTH    4       /* blocks each queue holds */
+#define LOAD_SPIN     256     /* polls before a waiting stage yields */
+
+
+/*--------------------------------------------------
+ * spsc queue - one thread pushes, one thread pops. head and tail are
+ * on their own cache lines so the two sides do not share one
+ */
+
+struct spsc {
+  _Atomic size_t head __attribute__((aligned(64))) ;
+  _Atomic size_t tail __attribute__((aligned(64))) ;
+  void *slot[LOAD_DEPTH] __attribute__((aligned(64))) ;
+  } ;
+
+static void
+spsc_wait(int *spins)
+{
+  if (++*spins > LOAD_SPIN) sched_yield() ;
+}
+
+static void
+spsc_push(struct spsc *q, void *p)
+{
+  size_t t = atomic_load_explicit(&q->tail,memory_order_relaxed) ;
+  int spins = 0 ;
+
+  while (t - atomic_load_explicit(&q->head,memory_order_acquire) == LOAD_DEPTH) spsc_wait(&spins) ;
+  q->slot[t % LOAD_DEPTH] = p ;
+  atomic_store_explicit(&q->tail,t + 1,memory_order_release) ;
+}
+
+static void *
+spsc_pop(struct spsc *q)
+{
+  size_t h = atomic_load_explicit(&q->head,memory_order_relaxed) ;
+  int spins = 0 ;
+  void *p ;
+
+  while (atomic_load_explicit(&q->tail,memory_order_acquire) == h) spsc_wait(&spins) ;
+  p = q->slot[h % LOAD_DEPTH] ;
+  atomic_store_explicit(&q->head,h + 1,memory_order_release) ;
+  return(p) ;
+}
+
+
+/* a block of dump text and the records parsed from it */
+
+struct loadblk {
+  char *text ;
+  size_t len ;
+  struct loadrec *rec ;
+  size_t nrec ;
+  size_t maxrec ;
+  } ;
+
+struct loader {
+  oa_table *t ;
+  struct dumpfile df ;
+  int nparsers ;
+  struct parser {
+    struct loader *ld ;
+    pthread_t tid ;
+    struct spsc in ;
+    struct spsc out ;
+    } p[LOAD_PARSERS] ;
+  } ;
+
+
+/*--------------------------------------------------
+ * chop
+ * remove trailing aspath detritus from the aspath string
+ */
+
+static void
+chop(char *s)
+{
+  int i = strlen(s) - 1 ;
+
+  while ((i >= 0)
+          && (isspace(s[i]) ||
+              (s[i] == '\n') ||
+              (s[i] == '\r') ||
+              (s[i] == 'i') ||
+              (s[i] == 'e') ||
+              (s[i] == '?'))) {
+    s[i--] = '\0';
+    }
+}
+
+
+/*--------------------------------------------------
+ * substr
+ * return TRUE is s1 is a substring of s2
+ */
+
+static int substr(char *s1, char *s2)
+  {
+  int l = strlen(s1);
+
+  while ((s2 = strchr(s2, *s1))) {
+    if (!strncmp(s1,s2,l)) return(1) ;
+    if (!*(++s2)) return(0) ;
+    }
+  return(0) ;
+  }
+
+
+/* the network column of a line, chopped, in <dst> */
+
+static void
+dump_network(char *dst, const char *line, size_t n)
+{
+  const char *cp = line + 3 ;
+  const char *end ;
+  size_t l ;
+
+  *dst = '\0' ;
+  if (n <= 3) return ;
+  if (!(end = scan_byte(cp,line + n,' '))) end = line + n ;
+  if ((l = end - cp) > 127) l = 127 ;
+  memcpy(dst,cp,l) ;
+  dst[l] = '\0' ;
+  chop(dst) ;
+}
+
+static struct loadrec *
+loadblk_next(struct loadblk *lb)
+{
+  if (lb->nrec == lb->maxrec) {
+    lb->maxrec = (lb->maxrec ? lb->maxrec * 2 : 8192) ;
+    lb->rec = (struct loadrec *) realloc(lb->rec,lb->maxrec * sizeof *lb->rec) ;
+    }
+  return(&lb->rec[lb->nrec]) ;
+}
+
+
+/*--------------------------------------------------
+ * parse_block
+ * parse the lines of block <lb> into its records
+ *
+ * The status is in column 1, the network from column 3 and the path from
+ * column 61, pushed right by however far a long network runs past column
+ * 19. Only best paths (a '>' status) are parsed - any other line just
+ * updates the last network seen, for the lines with a blank network that
+ * follow it. A v6 entry whose line is too short to hold the path carries
+ * on to the next line, or the one after that.
+ */
+
+static void
+parse_block(const oa_table *t, struct loadblk *lb)
+{
+  struct dumpfile df ;
+  struct loadrec *lr ;
+  char *inl ;
+  char *pnl ;
+  char lastaddr[128] = "" ;
+  char addr[128] ;
+  char *aspath ;
+  const char *cp ;
+  size_t n, pn ;
+  size_t rest ;
+  int parse_header = 0 ;
+  int pathoffset ;
+
+  /* the block is read as a file that has already ended */
+  memset(&df,0,sizeof df) ;
+  df.fd = -1 ;
+  df.buf = lb->text ;
+  df.len = df.size = lb->len ;
+  df.eof = 1 ;
+
+  while ((inl = dump_line(&df,&n))) {
+    if (parse_header) {
+
+      //the last line of the header is
+      // "Network..Next Hop..Metric LocPrf Weight Path"
+
+      if (substr("Prf",inl)) parse_header = 0 ;
+      continue ;
+      }
+
+    // if there is a header it starts with "show ip bgp"
+    if (!strncmp(inl,"show",4)) {
+      parse_header = 1 ;
+      continue ;
+      }
+
+    // anything but the "best" (or selected) as path only moves the
+    // last address along
+    if ((n < 2) || (inl[1] != '>')) {
+      dump_network(addr,inl,n) ;
+      if (*addr) strcpy(lastaddr,addr) ;
+      continue ;
+      }
+
+    // look for lines where the address is too long and the
+    // path field is offset
+    pathoffset = 0 ;
+    if (n > 19) pathoffset = scan_space(inl + 19,inl + n) - (inl + 19) ;
+
+    // a blank network means use the last address - the bytes of the
+    // line after the network are what is left to hold the path
+    dump_network(addr,inl,n) ;
+    if (*addr) {
+      cp = scan_byte(inl + 3,inl + n,' ') ;
+      rest = (cp ? (inl + n + df.lf) - (cp + 1) : 0) ;
+      }
+    else {
+      strcpy(addr,lastaddr) ;
+      cp = inl + 4 + strlen(addr) ;
+      rest = ((inl + n + df.lf) > cp) ? (inl + n + df.lf) - cp : 0 ;
+      }
+    strcpy(lastaddr,addr) ;
+    if (!*addr) continue ;
+
+    if (strchr(addr,':')) {
+      if (!cp || (rest < 35)) {
+        pn = 0 ;
+        if ((pnl = dump_line(&df,&pn)) && (pn + df.lf < 60)) pnl = dump_line(&df,&pn) ;
+        aspath = ((pnl && (pn > 61)) ? &pnl[61] : "") ;
+        }
+      else {
+        aspath = ((n > 61) ? &inl[61] : "") ;
+        }
+      if (*aspath == 'i') continue ;
+      }
+    else
+      aspath = ((n > 61 + (size_t) pathoffset) ? &inl[61 + pathoffset] : "") ;
+
+    chop(aspath) ;
+    lr = loadblk_next(lb) ;
+    if (!parse_prefix(addr,lr)) continue ;
+    if (t->flags & OA_KEEP_PATH) {
+      lr->path = aspath ;
+      lr->origin_as = 0 ;
+      }
+    else {
+      lr->path = 0 ;
+      if (!(lr->origin_as = aspath_origin(aspath))) continue ;
+      }
+    ++lb->nrec ;
+    }
+}
+
+
+/* reader stage - deal the blocks out to the parsers in turn, then
+   tell every parser there are no more */
+
+static void *
+load_reader(void *arg)
+{
+  struct loader *ld = (struct loader *) arg ;
+  struct loadblk *lb ;
+  char *text ;
+  size_t len ;
+  int i = 0 ;
+
+  while ((text = dump_block(&ld->df,&len))) {
+    lb = (struct loadblk *) calloc(1,sizeof *lb) ;
+    lb->text = text ;
+    lb->len = len ;
+    spsc_push(&ld->p[i].in,lb) ;
+    if (++i == ld->nparsers) i = 0 ;
+    }
+  for (i = 0 ; i < ld->nparsers ; ++i) spsc_push(&ld->p[i].in,0) ;
+  return(0) ;
+}
+
+/* parser stage */
+
+static void *
+load_parser(void *arg)
+{
+  struct parser *p = (struct parser *) arg ;
+  struct loadblk *lb ;
+
+  while ((lb = (struct loadblk *) spsc_pop(&p->in))) {
+    parse_block(p->ld->t,lb) ;
+    spsc_push(&p->out,lb) ;
+    }
+  spsc_push(&p->out,0) ;
+  return(0) ;
+}
+
+
+/*--------------------------------------------------
+ * oa_table_load
+ * add the best paths in dump file <filename> to the table.
+ * return 0 if the file cannot be opened
+ */
+
+int
+oa_table_load(oa_table *t, const char *filename)
+{
+  struct loader *ld ;
+  struct loadblk *lb ;
+  pthread_t reader ;
+  size_t i ;
+  int np ;
+
+  if (t->built) return(0) ;
+  if (posix_memalign((void **) &ld,64,sizeof *ld)) return(0) ;
+  memset(ld,0,sizeof *ld) ;
+  if (!dump_open(&ld->df,filename)) {
+    free(ld) ;
+    return(0) ;
+    }
+
+  /* the reader and the inserter each take a cpu, the parsers share the rest */
+  ld->t = t ;
+  ld->nparsers = oa_nthreads(LOAD_PARSERS + 2,0) - 2 ;
+  if (ld->nparsers < 1) ld->nparsers = 1 ;
+  for (np = 0 ; np < ld->nparsers ; ++np) {
+    ld->p[np].ld = ld ;
+    pthread_create(&ld->p[np].tid,0,load_parser,&ld->p[np]) ;
+    }
+  pthread_create(&reader,0,load_reader,ld) ;
+
+  /* inserter stage - take the blocks back in the order they were dealt */
+  np = 0 ;
+  while ((lb = (struct loadblk *) spsc_pop(&ld->p[np].out))) {
+    for (i = 0 ; i < lb->nrec ; ++i) add_prefix(t,&lb->rec[i]) ;
+    free(lb->rec) ;
+    free(lb->text) ;
+    free(lb) ;
+    if (++np == ld->nparsers) np = 0 ;
+    }
+
+  /* every other parser has its end marker next */
+  for (i = 1 ; i < (size_t) ld->nparsers ; ++i) {
+    if (++np == ld->nparsers) np = 0 ;
+    spsc_pop(&ld->p[np].out) ;
+    }
+  pthread_join(reader,0) ;
+  for (np = 0 ; np < ld->nparsers ; ++np) pthread_join(ld->p[np].tid,0) ;
+  dump_close(&ld->df) ;
+  free(ld) ;
+  return(1) ;
+}
+
+
+/*--------------------------------------------------
+ * oa_table_load_files
+ * add the best paths in the <n> dump files <files> to the table, several
+ * files at once. Each file is loaded and sorted as a run of its own and
+ * the runs are merged when the table is built, earliest file first, so a
+ * prefix in more than one file keeps the origin from the first file that
+ * has it - just as if the files were loaded one at a time.
+ * Return <n>, or the index of the first file that cannot be opened (the
+ * other files are loaded all the same)
+ */
+
+struct filejob {
+  oa_table *t ;
+  const char *const *files ;
+  size_t n ;
+  size_t base ;             /* run of the first file */
+  _Atomic size_t next ;     /* next file to take */
+  int *ok ;
+  } ;
+
+static void *
+load_file(void *arg)
+{
+  struct filejob *fj = (struct filejob *) arg ;
+  struct pfxrun *rn ;
+  oa_table *ft ;
+  size_t i ;
+
+  while ((i = atomic_fetch_add(&fj->next,1)) < fj->n) {
+    rn = &fj->t->runs[fj->base + i] ;
+    ft = oa_table_new(fj->t->flags) ;
+    rn->sorted = 1 ;
+    if ((fj->ok[i] = oa_table_load(ft,fj->files[i]))) {
+      /* a run left unsorted is sorted again by the build */
+      rn->sorted = (pfx4_sort(&ft->pv4) && pfx6_sort(&ft->pv6)) ;
+      rn->pv4 = ft->pv4 ;
+      rn->pv6 = ft->pv6 ;
+      memset(&ft->pv4,0,sizeof ft->pv4) ;
+      memset(&ft->pv6,0,sizeof ft->pv6) ;
+      }
+    oa_table_free(ft) ;
+    }
+  return(0) ;
+}
+
+size_t
+oa_table_load_files(oa_table *t, const char *const *files, size_t n)
+{
+  struct filejob fj ;
+  pthread_t *tid ;
+  size_t i, bad = n ;
+  int nt ;
+
+  if (t->built) return(0) ;
+
+  /* the prefix trees and the path store belong to the one table, so
+     those tables take a file at a time */
+  if (t->flags & (OA_INCREMENTAL | OA_KEEP_PATH)) {
+    for (i = 0 ; i < n ; ++i) {
+      if (!oa_table_load(t,files[i]) && (bad == n)) bad = i ;
+      }
+    return(bad) ;
+    }
+
+  /* whatever was loaded before goes ahead of these files, and the runs
+     are all made before any thread can see them */
+  run_close(t) ;
+  memset(&fj,0,sizeof fj) ;
+  fj.t = t ;
+  fj.files = files ;
+  fj.n = n ;
+  fj.base = t->nruns ;
+  for (i = 0 ; i < n ; ++i) run_add(t) ;
+  fj.ok = (int *) calloc(n + 1,sizeof *fj.ok) ;
+  atomic_init(&fj.next,0) ;
+
+  nt = oa_nthreads(n,0) ;
+  tid = (pthread_t *) malloc(nt * sizeof *tid) ;
+  for (i = 0 ; i < (size_t) nt ; ++i) pthread_create(&tid[i],0,load_file,&fj) ;
+  for (i = 0 ; i < (size_t) nt ; ++i) pthread_join(tid[i],0) ;
+
+  for (i = 0 ; i < n ; ++i) {
+    if (!fj.ok[i]) {
+      bad = i ;
+      break ;
+      }
+    }
+  free(tid) ;
+  free(fj.ok) ;
+  return(bad) ;
+}
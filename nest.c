@@ -0,0 +1,254 @@
+/* nest.c
+
+   covering and more-specific prefix queries
+
+   Deaggregation keeps only the most specific origin of each address,
+   so a table made with OA_KEEP_NEST also keeps every announced prefix,
+   as it was before deaggregation, in an array sorted on start and then
+   length. Prefixes either nest or are disjoint, so in that order the
+   prefixes inside a prefix follow it as one run, and each entry holds
+   the index of its parent - the nearest prefix covering it.
+
+     more specifics   bisect to the first entry not before the prefix,
+                      and read on while entries start inside it
+     covering chain   bisect to the last entry not after the prefix,
+                      climb parents until one covers it, and then
+                      follow parents to the top - O(depth) once found
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include "originas.h"
+
+#define NEST_NONE (~(u_int32_t) 0)
+
+
+/*--------------------------------------------------
+ * nest4_build, nest6_build
+ * copy the sorted prefix list of a table being built into its nest
+ * array, setting parents from a stack of the prefixes still open
+ */
+
+void
+nest4_build(oa_table *t)
+{
+  struct addr4 *ap ;
+  struct nest4 *nv ;
+  u_int32_t stack[33] ;
+  u_int32_t send[33] ;
+  size_t n = 0 ;
+  int sp = 0 ;
+
+  for (ap = t->v4head ; ap ; ap = ap->nxt) ++n ;
+  t->nest4 = nv = (struct nest4 *) malloc((n ? n : 1) * sizeof *nv) ;
+  t->nnest4 = n ;
+  for (n = 0, ap = t->v4head ; ap ; ap = ap->nxt, ++n) {
+    while (sp && (send[sp - 1] < ap->start)) --sp ;
+    nv[n].start = ap->start ;
+    nv[n].origin_as = ap->origin_as ;
+    nv[n].mask = ap->mask ;
+    nv[n].parent = (sp ? stack[sp - 1] : NEST_NONE) ;
+    stack[sp] = (u_int32_t) n ;
+    send[sp++] = ap->end ;
+    }
+}
+
+void
+nest6_build(oa_table *t)
+{
+  struct addr6 *ap ;
+  struct nest6 *nv ;
+  u_int32_t stack[129] ;
+  u_int128_t send[129] ;
+  size_t n = 0 ;
+  int sp = 0 ;
+
+  for (ap = t->v6head ; ap ; ap = ap->nxt) ++n ;
+  t->nest6 = nv = (struct nest6 *) malloc((n ? n : 1) * sizeof *nv) ;
+  t->nnest6 = n ;
+  for (n = 0, ap = t->v6head ; ap ; ap = ap->nxt, ++n) {
+    while (sp && (send[sp - 1] < ap->start)) --sp ;
+    nv[n].start = ap->start ;
+    nv[n].origin_as = ap->origin_as ;
+    nv[n].mask = ap->mask ;
+    nv[n].parent = (sp ? stack[sp - 1] : NEST_NONE) ;
+    stack[sp] = (u_int32_t) n ;
+    send[sp++] = ap->end ;
+    }
+}
+
+
+static u_int32_t
+hostmask4(int mask)
+{
+  return((mask < 32) ? (u_int32_t) ((((u_int64_t) 1) << (32 - mask)) - 1) : 0) ;
+}
+
+static u_int128_t
+hostmask6(int mask)
+{
+  return((mask < 128) ? (((u_int128_t) 1 << (128 - mask)) - 1) : 0) ;
+}
+
+/* the number of entries before prefix <s>/<m> in start then length
+   order, counting an equal entry as before it if <equal> is set */
+
+static size_t
+nest4_rank(const oa_table *t, u_int32_t s, int m, int equal)
+{
+  const struct nest4 *nv = t->nest4 ;
+  size_t lo = 0, hi = t->nnest4, mid ;
+
+  while (lo < hi) {
+    mid = (lo + hi) >> 1 ;
+    if ((nv[mid].start < s) || ((nv[mid].start == s) && ((nv[mid].mask < m) || (equal && (nv[mid].mask == m)))))
+      lo = mid + 1 ;
+    else hi = mid ;
+    }
+  return(lo) ;
+}
+
+static size_t
+nest6_rank(const oa_table *t, u_int128_t s, int m, int equal)
+{
+  const struct nest6 *nv = t->nest6 ;
+  size_t lo = 0, hi = t->nnest6, mid ;
+
+  while (lo < hi) {
+    mid = (lo + hi) >> 1 ;
+    if ((nv[mid].start < s) || ((nv[mid].start == s) && ((nv[mid].mask < m) || (equal && (nv[mid].mask == m)))))
+      lo = mid + 1 ;
+    else hi = mid ;
+    }
+  return(lo) ;
+}
+
+
+/* fill in <p> for the caller of a prefix query */
+
+void
+prefix4_put(oa_prefix *p, u_int32_t start, int mask, u_int32_t origin)
+{
+  memset(p,0,sizeof *p) ;
+  p->family = 4 ;
+  p->length = (uint8_t) mask ;
+  p->addr[0] = start >> 24 ;
+  p->addr[1] = start >> 16 ;
+  p->addr[2] = start >> 8 ;
+  p->addr[3] = start ;
+  p->origin = origin ;
+}
+
+void
+prefix6_put(oa_prefix *p, u_int128_t start, int mask, u_int32_t origin)
+{
+  int i ;
+
+  p->family = 6 ;
+  p->length = (uint8_t) mask ;
+  for (i = 0 ; i < 16 ; ++i) p->addr[i] = (uint8_t) (start >> (120 - (8 * i))) ;
+  p->origin = origin ;
+}
+
+
+/* the field as a prefix - an address is taken as a host prefix.
+   Return its family, or 0 if it is neither */
+
+static int
+nest_field(const char *field, u_int32_t *s4, u_int128_t *s6, int *mask)
+{
+  char f[128] ;
+  unsigned int asn ;
+  int type ;
+
+  strncpy(f,field,sizeof f - 1) ;
+  f[sizeof f - 1] = '\0' ;
+  type = parse_field(f,s4,s6,mask,&asn) ;
+  if (type == FIELD_V4) {
+    if ((*mask < 0) || (*mask > 32)) *mask = 32 ;
+    *s4 &= ~hostmask4(*mask) ;
+    return(4) ;
+    }
+  if (type == FIELD_V6) {
+    if ((*mask < 0) || (*mask > 128)) *mask = 128 ;
+    *s6 &= ~hostmask6(*mask) ;
+    return(6) ;
+    }
+  return(0) ;
+}
+
+
+/*--------------------------------------------------
+ * oa_covering
+ * the announced prefixes covering address or prefix <field>, most
+ * specific first. Up to <max> are stored in <out>, and the number
+ * there are is returned
+ */
+
+size_t
+oa_covering(const oa_table *t, const char *field, oa_prefix *out, size_t max)
+{
+  u_int32_t s4 = 0 ;
+  u_int128_t s6 = 0 ;
+  u_int32_t i ;
+  size_t k ;
+  size_t n = 0 ;
+  int m ;
+
+  if (!(t->flags & OA_KEEP_NEST)) return(0) ;
+  switch (nest_field(field,&s4,&s6,&m)) {
+    case 4:
+      if (!(k = nest4_rank(t,s4,m,1))) return(0) ;
+      i = (u_int32_t) (k - 1) ;
+      while ((i != NEST_NONE) &&
+             ((t->nest4[i].mask > m) || ((s4 & ~hostmask4(t->nest4[i].mask)) != t->nest4[i].start)))
+        i = t->nest4[i].parent ;
+      for ( ; i != NEST_NONE ; i = t->nest4[i].parent, ++n)
+        if (n < max) prefix4_put(&out[n],t->nest4[i].start,t->nest4[i].mask,t->nest4[i].origin_as) ;
+      break ;
+    case 6:
+      if (!(k = nest6_rank(t,s6,m,1))) return(0) ;
+      i = (u_int32_t) (k - 1) ;
+      while ((i != NEST_NONE) &&
+             ((t->nest6[i].mask > m) || ((s6 & ~hostmask6(t->nest6[i].mask)) != t->nest6[i].start)))
+        i = t->nest6[i].parent ;
+      for ( ; i != NEST_NONE ; i = t->nest6[i].parent, ++n)
+        if (n < max) prefix6_put(&out[n],t->nest6[i].start,t->nest6[i].mask,t->nest6[i].origin_as) ;
+      break ;
+    }
+  return(n) ;
+}
+
+
+/*--------------------------------------------------
+ * oa_more_specifics
+ * the announced prefixes inside prefix <field>, itself included, in
+ * address order. Up to <max> are stored in <out>, and the number there
+ * are is returned
+ */
+
+size_t
+oa_more_specifics(const oa_table *t, const char *field, oa_prefix *out, size_t max)
+{
+  u_int32_t s4 = 0, e4 ;
+  u_int128_t s6 = 0, e6 ;
+  size_t i, n = 0 ;
+  int m ;
+
+  if (!(t->flags & OA_KEEP_NEST)) return(0) ;
+  switch (nest_field(field,&s4,&s6,&m)) {
+    case 4:
+      e4 = s4 | hostmask4(m) ;
+      for (i = nest4_rank(t,s4,m,0) ; (i < t->nnest4) && (t->nest4[i].start <= e4) ; ++i, ++n)
+        if (n < max) prefix4_put(&out[n],t->nest4[i].start,t->nest4[i].mask,t->nest4[i].origin_as) ;
+      break ;
+    case 6:
+      e6 = s6 | hostmask6(m) ;
+      for (i = nest6_rank(t,s6,m,0) ; (i < t->nnest6) && (t->nest6[i].start <= e6) ; ++i, ++n)
+        if (n < max) prefix6_put(&out[n],t->nest6[i].start,t->nest6[i].mask,t->nest6[i].origin_as) ;
+      break ;
+    }
+  return(n) ;
+}
@@ -0,0 +1,219 @@
+/* numa.c
+
+   a copy of the lookup arrays for each memory node
+
+   On a machine of several NUMA nodes, threads looking up in one table
+   read half their pages from another socket's memory. A thread pinned
+   to a node with oa_numa_bind() can instead make its own replica of a
+   built table with oa_table_replica(): the arrays the lookups search -
+   the compiled ranges, the pieces they were announced as and the exact
+   prefix hashes - are copied into
+   memory the thread itself writes first, which Linux places on that
+   node. Everything else (prefix text, paths, names) is read once per
+   answer at most, and stays with the original.
+
+   The nodes and their CPUs come from /sys/devices/system/node. Setting
+   OA_NUMA_NODES to a count instead splits the online CPUs into that
+   many nodes, so the replicas can be exercised on one node machines.
+
+*/
+
+#define _GNU_SOURCE
+#include <ctype.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include "originas.h"
+
+#define NUMA_MAXNODES 64
+
+
+/* the number of nodes set in OA_NUMA_NODES, or 0 */
+
+static int
+numa_simulated(void)
+{
+  const char *cp = getenv("OA_NUMA_NODES") ;
+  int n ;
+
+  if (!cp || ((n = atoi(cp)) < 1)) return(0) ;
+  return((n > NUMA_MAXNODES) ? NUMA_MAXNODES : n) ;
+}
+
+
+/*--------------------------------------------------
+ * oa_numa_nodes
+ * the number of memory nodes, simulated or from sysfs. 1 if the
+ * system does not say
+ */
+
+int
+oa_numa_nodes(void)
+{
+  struct dirent *de ;
+  DIR *d ;
+  int n = 0 ;
+
+  if ((n = numa_simulated())) return(n) ;
+  if (!(d = opendir("/sys/devices/system/node"))) return(1) ;
+  while ((de = readdir(d))) {
+    if (!strncmp(de->d_name,"node",4) && isdigit((unsigned char) de->d_name[4])) ++n ;
+    }
+  closedir(d) ;
+  if (n > NUMA_MAXNODES) n = NUMA_MAXNODES ;
+  return(n ? n : 1) ;
+}
+
+
+/* add the CPUs of sysfs list <cp> ("0-3,8,10-11") to <set>. Return
+   the number added */
+
+static int
+cpulist_parse(const char *cp, cpu_set_t *set)
+{
+  long lo, hi ;
+  char *ep ;
+  int n = 0 ;
+
+  while (*cp) {
+    lo = strtol(cp,&ep,10) ;
+    if (ep == cp) break ;
+    hi = lo ;
+    if (*ep == '-') {
+      cp = ep + 1 ;
+      hi = strtol(cp,&ep,10) ;
+      if (ep == cp) break ;
+      }
+    for ( ; (lo <= hi) && (lo < CPU_SETSIZE) ; ++lo, ++n) CPU_SET(lo,set) ;
+    cp = ep ;
+    if (*cp == ',') ++cp ;
+    }
+  return(n) ;
+}
+
+
+/* the CPUs of <node> into <set>. Return the number there are */
+
+static int
+numa_cpus(int node, cpu_set_t *set)
+{
+  char path[64] ;
+  char buf[1024] ;
+  FILE *fp ;
+  long ncpu ;
+  int nodes, lo, hi, i ;
+
+  CPU_ZERO(set) ;
+
+  /* simulated nodes take an even share of the CPUs, or one each if
+     there are more nodes than CPUs */
+  if ((nodes = numa_simulated())) {
+    if ((ncpu = sysconf(_SC_NPROCESSORS_ONLN)) < 1) ncpu = 1 ;
+    lo = (int) ((node * ncpu) / nodes) ;
+    hi = (int) (((node + 1) * ncpu) / nodes) ;
+    if (hi == lo) hi = lo + 1 ;
+    for (i = lo ; i < hi ; ++i) CPU_SET(i % ncpu,set) ;
+    return(hi - lo) ;
+    }
+
+  snprintf(path,sizeof path,"/sys/devices/system/node/node%d/cpulist",node) ;
+  if (!(fp = fopen(path,"r"))) return(0) ;
+  i = (fgets(buf,sizeof buf,fp) ? cpulist_parse(buf,set) : 0) ;
+  fclose(fp) ;
+  return(i) ;
+}
+
+
+/*--------------------------------------------------
+ * oa_numa_bind
+ * pin the calling thread to the CPUs of <node>, so the memory it
+ * writes first is placed there. Return 1, or 0 if it could not be
+ */
+
+int
+oa_numa_bind(int node)
+{
+  cpu_set_t set ;
+
+  if ((node < 0) || !numa_cpus(node,&set)) return(0) ;
+  return(!pthread_setaffinity_np(pthread_self(),sizeof set,&set)) ;
+}
+
+
+/* a copy of the <size> bytes at <p> into <hm>, written by this thread */
+
+static void *
+replica_copy(struct hugemem *hm, const void *p, size_t size)
+{
+  void *q ;
+
+  if (!p) {
+    memset(hm,0,sizeof *hm) ;
+    return(0) ;
+    }
+  if ((q = huge_alloc(hm,size))) memcpy(q,p,size) ;
+  return(q) ;
+}
+
+/* the same into malloc'd memory, for arrays the table frees itself */
+
+static void *
+array_copy(const void *p, size_t size)
+{
+  void *q ;
+
+  if (p && (q = malloc(size ? size : 1))) memcpy(q,p,size) ;
+  else q = 0 ;
+  return(q) ;
+}
+
+
+/*--------------------------------------------------
+ * oa_table_replica
+ * a read only copy of built table <t> for the calling thread's node,
+ * sharing all but the lookup arrays with <t> - which is to outlive it.
+ * Live tables change under their lookups and are not replicated.
+ * Return the copy, or 0
+ */
+
+oa_table *
+oa_table_replica(const oa_table *t)
+{
+  oa_table *rt ;
+
+  if (!t->built || t->live || t->master) return(0) ;
+  if (!(rt = (oa_table *) malloc(sizeof *rt))) return(0) ;
+  memcpy(rt,t,sizeof *rt) ;
+  rt->master = t ;
+  rt->r4 = (struct range4 *) replica_copy(&rt->r4mem,t->r4,t->n4 * sizeof *t->r4) ;
+  rt->r6 = (struct range6 *) replica_copy(&rt->r6mem,t->r6,t->n6 * sizeof *t->r6) ;
+  rt->ex4 = (struct exact4 *) replica_copy(&rt->ex4mem,t->ex4,t->exsize4 * sizeof *t->ex4) ;
+  rt->ex6 = (struct exact6 *) replica_copy(&rt->ex6mem,t->ex6,t->exsize6 * sizeof *t->ex6) ;
+  rt->p4 = (struct prov4 *) array_copy(t->p4,t->np4 * sizeof *t->p4) ;
+  rt->p6 = (struct prov6 *) array_copy(t->p6,t->np6 * sizeof *t->p6) ;
+  if ((t->r4 && !rt->r4) || (t->r6 && !rt->r6) || (t->ex4 && !rt->ex4) || (t->ex6 && !rt->ex6) ||
+      (t->p4 && !rt->p4) || (t->p6 && !rt->p6)) {
+    replica_free(rt) ;
+    return(0) ;
+    }
+  return(rt) ;
+}
+
+/* release replica <rt>, which owns only its arrays */
+
+void
+replica_free(oa_table *rt)
+{
+  huge_free(&rt->r4mem) ;
+  huge_free(&rt->r6mem) ;
+  huge_free(&rt->ex4mem) ;
+  huge_free(&rt->ex6mem) ;
+  free(rt->p4) ;
+  free(rt->p6) ;
+  free(rt) ;
+}
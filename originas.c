@@ -5,92 +5,189 @@
 
    ./originas bgp4.yxy bgp6.txt <data.txt
 
+   ./originas --binary-in bgp4.txt bgp6.txt <addrs.bin >origins.bin
+
+   with --binary-in stdin is instead a run of records, each a family
+   byte (4 or 6) and then a 4 or 16 byte address, and stdout a run of
+   5 byte records: the origin AS (4) and the length of the announced
+   prefix covering the address (1), both 0 if it is not announced. All
+   numbers are in network byte order
+
+   ./originas --binary-in --threads 16 --numa bgp4.txt bgp6.txt <addrs.bin >origins.bin
+
+   with --threads the records are looked up on that many threads, and
+   with --numa as well those are pinned across the memory nodes (by
+   default one per node), each node searching its own copy of the table.
+   OA_NUMA_NODES=n in the environment simulates n nodes
+
+   ./originas --serve /run/originas.sock bgp4.txt bgp6.txt
+   ./originas --serve 127.0.0.1:4343 --threads 8 bgp4.txt bgp6.txt
+
+   with --serve the table stays resident, answering any number of
+   clients on a unix socket (or TCP, given a port or host:port). Each
+   line a client sends is answered as the line and the origin of its
+   first field (the -f field, with the prefix for -m and names for -n),
+   in the order it was sent. Lookups run on a work stealing pool of
+   --threads workers (by default one per CPU), which splits large
+   batches across the pool while single queries are taken up at once.
+   With --updates the table is kept live under the server
+
+   ./originas --updates updates.20240101.0000.gz bgp4.txt bgp6.txt <data.txt
+
+   with --updates the table is kept live: an updater thread applies the
+   BGP4MP UPDATE messages of each MRT file (or named pipe) in turn while
+   the lookups run, so each field is looked up in the table as it is at
+   the time. --updates-first applies all of them before the first lookup
+
+   ./originas --covering bgp4.txt bgp6.txt <data.txt
+   ./originas --more-specific bgp4.txt bgp6.txt <prefixes.txt
+
+   with --covering or --more-specific each line is followed by the
+   announced prefixes covering its first field (most specific first), or
+   inside it (in address order), each as prefix,origin
+
+   ./originas --origin-prefixes bgp4.txt bgp6.txt <asns.txt
+
+   with --origin-prefixes the first field is an AS (nnn or ASnnn), and
+   each line is followed by the number of v4 and of v6 addresses it
+   originates and then that address space as CIDR blocks
+
+   ./originas --space-report bgp4.txt bgp6.txt >space.csv
+
+   with --space-report stdin is not read: stdout is a line for each
+   origin, origin,v4 addresses,v6 /48s (whole /48s of address space),
+   most v4 addresses first and then most v6
+
+   ./originas --diff bgp4.old,bgp6.old bgp4.txt,bgp6.txt >changes.csv
+
+   with --diff two tables are built, each from a comma separated list of
+   dumps, and stdout is the address ranges whose origin changed from
+   the first to the second: start,end,old origin,new origin, with 0 for
+   a range that was not announced
+
+   a field that is a prefix exactly as announced is answered with the
+   origin of that announcement, and any other field with the origin of
+   its first address
+
+   the table itself is built and searched by liboriginas
+
 */
 
 #include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include "libavl.h"
-#include <zlib.h>
 #include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
 #include <sys/types.h>
-char *strcasestr(const char *haystack, const char *needle);
-
-typedef __uint128_t u_int128_t ;
+#include "originas.h"
 
-union v6add {
-  u_int16_t sds[8];
-  u_int32_t quad[4];
-  u_int64_t lds[2];
-  u_int128_t llds ;
-  };
-
-typedef union v6add v6addr ;
-
-
-/* structure to hold each as path */
+int show_prefix = 0 ;
+int use_names = 0 ;
+int sorted_input = 0 ;
+int export_format = -1 ;
+int show_path = 0 ;
+unsigned int on_path = 0 ;
+int history_at = 0 ;
+u_int32_t history_when = 0 ;
+int output_compress = 0 ;
+int binary_in = 0 ;
+int aggregate = 0 ;
+int sum_field = 0 ;
+struct zout *zout = 0 ;
+int updates_first = 0 ;
+int diff_tables = 0 ;
+int nest_query = 0 ;
+int origin_query = 0 ;
+int space_report = 0 ;
+int table_stats = 0 ;
+int lookup_threads = 0 ;
+int numa_replicas = 0 ;
+char *serve_addr = 0 ;
+
+/* long options without a short form */
+
+enum {
+  OPT_SORTED_INPUT = 256,
+  OPT_EXPORT,
+  OPT_CIDR,
+  OPT_HISTORY,
+  OPT_AT,
+  OPT_PATH,
+  OPT_ON_PATH,
+  OPT_OUTPUT_COMPRESS,
+  OPT_BINARY_IN,
+  OPT_AGGREGATE,
+  OPT_SUM,
+  OPT_UPDATES,
+  OPT_UPDATES_FIRST,
+  OPT_DIFF,
+  OPT_COVERING,
+  OPT_MORE_SPECIFIC,
+  OPT_ORIGIN_PREFIXES,
+  OPT_SPACE_REPORT,
+  OPT_STATS,
+  OPT_THREADS,
+  OPT_NUMA,
+  OPT_SERVE
+  } ;
 
-struct s_asp {
-  char *aspth ;
-  unsigned int *s_ases;
-  int s_aspath_length ;
-  struct s_asp *s_left ;
-  struct s_asp *s_right ;
-  } *s_asps = 0, *s_last = 0;
+static struct option long_options[] = {
+  { "sorted-input", no_argument, 0, OPT_SORTED_INPUT },
+  { "export", optional_argument, 0, OPT_EXPORT },
+  { "cidr", no_argument, 0, OPT_CIDR },
+  { "history", required_argument, 0, OPT_HISTORY },
+  { "at", required_argument, 0, OPT_AT },
+  { "path", no_argument, 0, OPT_PATH },
+  { "on-path", required_argument, 0, OPT_ON_PATH },
+  { "output-compress", required_argument, 0, OPT_OUTPUT_COMPRESS },
+  { "binary-in", no_argument, 0, OPT_BINARY_IN },
+  { "aggregate", optional_argument, 0, OPT_AGGREGATE },
+  { "sum", required_argument, 0, OPT_SUM },
+  { "updates", required_argument, 0, OPT_UPDATES },
+  { "updates-first", no_argument, 0, OPT_UPDATES_FIRST },
+  { "diff", no_argument, 0, OPT_DIFF },
+  { "covering", no_argument, 0, OPT_COVERING },
+  { "more-specific", no_argument, 0, OPT_MORE_SPECIFIC },
+  { "origin-prefixes", no_argument, 0, OPT_ORIGIN_PREFIXES },
+  { "space-report", no_argument, 0, OPT_SPACE_REPORT },
+  { "stats", no_argument, 0, OPT_STATS },
+  { "threads", required_argument, 0, OPT_THREADS },
+  { "numa", no_argument, 0, OPT_NUMA },
+  { "serve", required_argument, 0, OPT_SERVE },
+  { 0, 0, 0, 0 }
+  } ;
 
-struct addr4 {
-  u_int32_t  start ;
-  u_int32_t end ;
-  u_int32_t size ;
-  u_int32_t origin_as ;
-  struct addr4 *nxt ;
-  struct addr4 *prv ;
+/* --history snapshots, in command line order */
 
-  /* remove this */
-  int flags ;
-  char *address ;
-  int mask ;
-  int status ;
+struct snapshot {
+  u_int32_t when ;
+  char *file ;
+  int argi ;                /* its place on the command line */
   } ;
 
-struct addr6 {
-  u_int128_t start ;
-  u_int128_t end ;
-  u_int128_t size ;
-  u_int32_t origin_as ;
-  struct addr6 *nxt ;
-  struct addr6 *prv ;
+struct snapshot snapshots[256] ;
+int nsnapshots = 0 ;
 
-  int flags ;
-  char *address ;
-  int mask ;
-  int status ;
-  } ;
+/* --updates files, applied in command line order */
 
+char *updates[256] ;
+int nupdates = 0 ;
 
-struct as_names {
-  unsigned int as ;
-  char *asname ;
-  } ;
- 
-int show_prefix = 0 ;
-int use_names = 0 ;
+/* the dumps read when none are named */
 
-avl_ptr addresses4 = 0 ;
-avl_ptr addresses6 = 0 ;
-avl_ptr asnames = 0 ;
-
-extern void chop (char *);
-extern int substr(char *, char *) ;
-extern struct s_asp *parse_aspath();
-extern void  print_addr(avl_ptr, FILE *, int);
-extern void  print_addr6(avl_ptr, FILE *, int);
-extern char *sprint6(u_int128_t *) ;
-extern void process_prefix_list(char, int *, int, int);
+static const char *default_dumps[] = { "bgp4.txt", "bgp6.txt" } ;
+
+extern void process_prefix_list(oa_table *, char, int *, int, int);
+extern void process_history_list(oa_history *, oa_table *, char, int *, int);
+extern int process_binary_list(oa_table *);
+extern int process_binary_threads(oa_table *, int, int);
+extern void process_aggregate_list(oa_table *, char, int, int);
+extern void process_nest_list(oa_table *, char, int, int);
+extern void process_origin_list(oa_table *, char, int);
+extern void space_report_list(oa_table *, char);
 extern void usage() ;
-extern char *find_as(unsigned int) ;
-extern int read_as_names(char *) ;
 
 extern char *optarg;
 extern int optind;
@@ -99,645 +196,606 @@ extern int opterr;
 extern int optreset;
 
 
-struct addr4 *aggregate4 = 0;
-struct addr4 *v4head ;
-
-struct addr6 *aggregate6 = 0;
-struct addr6 *v6head ;
-
-/*--------------------------------------------------
- * getas
- * get the next as number from the string <asp>
- * use the first AS in an AS set
- */
-
-unsigned int
-getas(char **asp)
+void
+process_prefix_list(oa_table *t, char delim, int *f, int fl, int showp)
 {
-  char *cp = *asp ;
-  char *cpt, *cpp ;
-  unsigned int asn ;
-
-  if (!cp || !*cp) return(0) ;
-
-  while ((*cp) && isspace(*cp)) ++cp ;
-  if (!*cp) return(0) ;
-  if (*cp == '{')  return(0) ;
-  if (isdigit(*cp)) {
-    if ((cpp = strchr(cp,' '))) 
-      *cpp = '\0';
-    asn = strtoul(cp,&cpt,10) ;
-    if (*cpt == '.')
-      asn = (asn << 16) + strtoul(++cpt,0,10) ;
-    if (cpp) 
-      *cpp = ' ' ;
-    *asp = cpp ;
-    return(asn) ;
-    }
-  return(0);
-}
+  char *inl ;
+  char inll[1026] ;
+  char *vec[256] ;
+  unsigned int asvec[256] ;
+  int vec_len ;
+  int fi ;
+  int vi ;
+  char sav = 0 ;
+  char *cp ;
+  char *pfx ;
+  char *prefixes[256] ;
+  const char *asname ;
+  oa_cursor cursors[256] ;
+  u_int32_t paths[256] ;
+  u_int32_t ases[64] ;
+  size_t n, i ;
 
+  /* each field has its own cursor, so input sorted on any one
+     field is walked in step with the table */
+  memset(cursors,0,sizeof cursors) ;
 
-/*--------------------------------------------------
- * parse_aspath
- * create an aspath entry for announcement <p> using
- * aspath text <aspath>
- * strip out duplicate AS instances and private ASs
- */
+  inl =&inll[0] ;
+  *inl++ = ',';
+  
+  while (fgets(inl,1024,stdin)) {
+    if ((cp = strchr(inl,'\n'))) *cp = '\0';
+    if ((cp = strchr(inl,'\r'))) *cp = '\0';
+    printf("%s",inl) ;
+    vec_len = 1 ;
+    vec[vec_len] = inll ;
+    cp  = inll ;
+    ++cp ;
+    while ((vec_len < 255) && (cp = strchr(cp,delim))) {
+      vec[++vec_len] = cp++ ;
+      }      
+    fi = 0 ;
+    vi = 0 ;
+    while (fi < fl) {
+      asvec[vi] = 0 ;
+      prefixes[vi] = 0 ;
+      paths[vi] = 0 ;
+      if ((f[fi] <= vec_len) && (vec[f[fi]]) && (*(vec[f[fi]] + 1) != delim)) {
+        if (f[fi] < vec_len) {
+          sav = *(vec[f[fi] + 1]) ;
+          *(vec[f[fi]+1]) = '\0';
+          }
+        pfx = 0 ;
+        if ((asvec[vi] = originas(t,(sorted_input ? &cursors[vi] : 0),vec[f[fi]]+1,&pfx,&paths[vi]))) {
+          if (showp) prefixes[vi] = (pfx ? strdup(pfx) : "") ;
+	  }
+        else if (showp) prefixes[vi] = "" ;
 
-struct s_asp *
-parse_aspath(char *aspath)
-{
-  int i;
-  int asl = 0;
-  char *asp ;
-  unsigned int new_aspath[260];
-  unsigned int asn ;
-  struct s_asp *sa = s_asps ;
-  struct s_asp *parent = 0 ;
+        if (use_names) {
+          asname = oa_asname(t,asvec[vi]) ;
+          if (asname) {
+            printf("%c%s",delim,asname) ;
+	    }
+          else {
+            printf("%cAS%u",delim,asvec[vi]) ;
+	    }
+	  }
+        else
+          printf("%c%u",delim,asvec[vi]) ;
+        if (f[fi] < vec_len) {
+          *(vec[f[fi]+1]) = sav;
+          }
+        }
+      else {
+        printf("%c%u",delim,0) ;
+        }    
+      ++fi ;
+      ++vi ;
+      }
+    if (showp) {
+      fi = 0 ;
+      while (fi < fl) {
+        if (prefixes[fi] && (*(prefixes[fi]))) { printf("%c%s",delim,prefixes[fi]) ; free(prefixes[fi]) ; }
+        else { printf("%c",delim) ; }
+	++fi ;
+        }
+      }
 
-  /* if the path is the same as the last path then add this prefix in */
-  if (s_last && !strcmp(s_last->aspth,aspath)) {
-    return(s_last) ;
-    }
+    /* neighbour AS, path length and the path itself, or whether
+       the --on-path AS is on the path */
+    if (show_path) {
+      for (fi = 0 ; fi < fl ; ++fi) {
+        printf("%c%u%c%u%c",delim,oa_path_neighbour(t,paths[fi]),delim,oa_path_length(t,paths[fi]),delim) ;
+        if ((n = oa_path_get(t,paths[fi],ases,64)) > 64) n = 64 ;
+        for (i = 0 ; i < n ; ++i) printf("%s%u",(i ? " " : ""),ases[i]) ;
+        }
+      }
+    if (on_path) {
+      for (fi = 0 ; fi < fl ; ++fi) printf("%c%d",delim,oa_path_contains(t,paths[fi],on_path)) ;
+      }
+    printf("\n") ;
 
-  /* search all paths for this path */
-  while ((sa) && (i = strcmp(sa->aspth,aspath))) {
-    parent = sa ;
-    if (i < 0) sa = sa->s_left ;
-    else sa = sa->s_right ;
+    /* sorted input is batch work - let stdio buffer the output */
+    if (!sorted_input) fflush(stdout) ;
     }
+  }
 
-  /* if this path is already in the list then add this ref */
-  if (sa) return(sa) ;
 
-  /* no - then set up a new path structure */
-  sa = (struct s_asp *) malloc(sizeof *sa) ;
 
-  /* copy the original path text to aspath array*/
-  strcpy((sa->aspth = (char *) malloc(strlen(aspath) + 1)),aspath);
-  asp = aspath ;
-  while ((asn = getas(&asp))) {
-    new_aspath[asl++] = asn;
-    }
+/*--------------------------------------------------------------------------------------------------*/
 
-  sa->s_ases = (unsigned int *) malloc(asl * (sizeof asn)) ;
-  for (i = 0 ; i < asl ; ++i) sa->s_ases[i] = new_aspath[i] ;
-  sa->s_aspath_length = asl ;
+/*
+ * process_binary_list
+ * --binary-in lookups, a block of records at a time. Return 0 if the
+ * input is not a run of whole records
+ */
 
+#define BINARY_BLOCK (1 << 20)
 
-  /* null pointers */
-  sa->s_left = sa->s_right = 0 ;
+/* look up the records from <ip> to <iend> into <*op>. Return where
+   they stop - at <iend>, a record cut short, or a bad family byte */
 
-  /* hoook into tree using full aspath */
-  if (parent) {
-    i = strcmp(parent->aspth,aspath);
-    if (i < 0) parent->s_left = sa ;
-    else parent->s_right = sa ;
+static const unsigned char *
+binary_lookups(const oa_table *t, oa_cursor *cp, const unsigned char *ip, const unsigned char *iend,
+               unsigned char **op)
+{
+  unsigned char *o = *op ;
+  u_int32_t as ;
+  int len ;
+
+  while (ip < iend) {
+    if (*ip == 4) {
+      if (iend - ip < 5) break ;
+      as = oa_lookup4_len(t,cp,((u_int32_t) ip[1] << 24) | (ip[2] << 16) | (ip[3] << 8) | ip[4],&len) ;
+      ip += 5 ;
+      }
+    else if (*ip == 6) {
+      if (iend - ip < 17) break ;
+      as = oa_lookup6_len(t,cp,ip + 1,&len) ;
+      ip += 17 ;
+      }
+    else break ;
+    o[0] = as >> 24 ;
+    o[1] = as >> 16 ;
+    o[2] = as >> 8 ;
+    o[3] = as ;
+    o[4] = (unsigned char) len ;
+    o += 5 ;
     }
-  else s_asps = sa ;
-
-  s_last = sa ;
-  return(sa) ;
+  *op = o ;
+  return(ip) ;
 }
 
+int
+process_binary_list(oa_table *t)
+{
+  unsigned char *in = (unsigned char *) malloc(BINARY_BLOCK + 17) ;
+  unsigned char *out = (unsigned char *) malloc(BINARY_BLOCK + 17) ;
+  const unsigned char *ip ;
+  unsigned char *iend, *op ;
+  oa_cursor cursor ;
+  oa_cursor *cp = (sorted_input ? &cursor : 0) ;
+  size_t have = 0 ;
+  size_t r ;
+  int ok = 1 ;
+
+  memset(&cursor,0,sizeof cursor) ;
+  while ((r = fread(in + have,1,BINARY_BLOCK,stdin)) > 0) {
+    have += r ;
+    iend = in + have ;
+    op = out ;
+    ip = binary_lookups(t,cp,in,iend,&op) ;
+    fwrite(out,1,op - out,stdout) ;
+    if ((ip < iend) && (*ip != 4) && (*ip != 6)) {
+      fprintf(stderr,"ERROR: Bad address family %u in binary input\n",*ip) ;
+      ok = 0 ;
+      break ;
+      }
 
+    /* keep a record cut by the end of the block for the next one */
+    have = iend - ip ;
+    memmove(in,ip,have) ;
+    }
+  if (ok && have) {
+    fprintf(stderr,"ERROR: Binary input ends in a partial record\n") ;
+    ok = 0 ;
+    }
+  fflush(stdout) ;
+  free(in) ;
+  free(out) ;
+  return(ok) ;
+}
 
-/*--------------------------------------------------
- * addr_cmp
- * compare a stored prefix with a start address and prefix length
- * return -1 if less, 0 if eql and 1 if gtr
+
+/*
+ * process_binary_threads
+ * --binary-in --threads: each block is cut at record boundaries into a
+ * slice per worker, which all look up at once, and the answers are
+ * written in input order. With --numa the workers are pinned across the
+ * memory nodes, and the first on each node replicates the table there
+ * for the rest
  */
 
-int 
-addr4_cmp(avl_ptr adp1, avl_ptr adp2)
-{
-  if (((struct addr4 *)adp1->payload)->start < ((struct addr4 *)adp2->payload)->start) return(-1) ;
-  if (((struct addr4 *)adp1->payload)->start > ((struct addr4 *)adp2->payload)->start) return(1) ;
-  if (((struct addr4 *)adp1->payload)->size >  ((struct addr4 *)adp2->payload)->size) return(-1) ;
-  if (((struct addr4 *)adp1->payload)->size <  ((struct addr4 *)adp2->payload)->size) return(1) ;
-  return(0) ;
-}
+struct bworker {
+  const oa_table *t ;       /* the table, or the replica of this node */
+  int id ;
+  int node ;
+  const unsigned char *ip ; /* this block's slice */
+  const unsigned char *iend ;
+  unsigned char *op ;       /* where its answers go, then where they end */
+  oa_cursor cursor ;
+  pthread_t tid ;
+  } ;
 
-int 
-addr6_cmp(avl_ptr adp1, avl_ptr adp2)
-{
-  if (((struct addr6 *)adp1->payload)->start < ((struct addr6 *)adp2->payload)->start) return(-1) ;
-  if (((struct addr6 *)adp1->payload)->start > ((struct addr6 *)adp2->payload)->start) return(1) ;
-  if (((struct addr6 *)adp1->payload)->size >  ((struct addr6 *)adp2->payload)->size) return(-1) ;
-  if (((struct addr6 *)adp1->payload)->size <  ((struct addr6 *)adp2->payload)->size) return(1) ;
-  return(0) ;
-}
+struct bpool {
+  struct bworker *w ;
+  int nworkers ;
+  int nodes ;
+  oa_table *replica[64] ;
+  int nreplicas ;
+  pthread_barrier_t sync ;  /* the workers and the reader */
+  int quit ;
+  } ;
 
-int 
-addr4_find(avl_ptr adp1, avl_ptr adp2)
-{
-  if (((struct addr4 *)adp1->payload)->start < ((struct addr4 *)adp2->payload)->start) return(-1) ;
-  if (((struct addr4 *)adp1->payload)->start > ((struct addr4 *)adp2->payload)->end) return(1) ;
-  return(0) ;
-}
+static struct bpool bpool ;
 
-int 
-addr6_find(avl_ptr adp1, avl_ptr adp2)
+static void *
+binary_worker(void *arg)
 {
-  if (((struct addr6 *)adp1->payload)->start < ((struct addr6 *)adp2->payload)->start) return(-1) ;
-  if (((struct addr6 *)adp1->payload)->start > ((struct addr6 *)adp2->payload)->end) return(1) ;
-  return(0) ;
-}
+  struct bworker *w = (struct bworker *) arg ;
+  oa_cursor *cp = (sorted_input ? &w->cursor : 0) ;
 
-int 
-asn_cmp(avl_ptr adp1, avl_ptr adp2)
-{
-  if (((struct as_names *)adp1->payload)->as < ((struct as_names *)adp2->payload)->as) return(-1) ;
-  if (((struct as_names *)adp1->payload)->as > ((struct as_names *)adp2->payload)->as) return(1) ;
+  /* the replicas are written by a thread on their own node */
+  if (bpool.nodes > 1) {
+    oa_numa_bind(w->node) ;
+    if (w->id < bpool.nodes) bpool.replica[w->node] = oa_table_replica(w->t) ;
+    }
+  pthread_barrier_wait(&bpool.sync) ;
+  if ((bpool.nodes > 1) && bpool.replica[w->node]) w->t = bpool.replica[w->node] ;
+
+  for (;;) {
+    pthread_barrier_wait(&bpool.sync) ;
+    if (bpool.quit) break ;
+    binary_lookups(w->t,cp,w->ip,w->iend,&w->op) ;
+    pthread_barrier_wait(&bpool.sync) ;
+    }
   return(0) ;
 }
-/*---------------------------------------------------*/
 
+/* the length of the whole record at <ip>, or 0 */
 
-char *
-find_as(unsigned int asn)
+static size_t
+binary_record(const unsigned char *ip, const unsigned char *iend)
 {
-  struct avldata local ;
-  struct as_names sasn ;
-  avl_ptr find ;
-
-  local.payload = &sasn ;
-  sasn.as = asn ;
-  if ((find = avlaccess(asnames,&local,asn_cmp))) 
-    return(((struct as_names *)find->payload)->asname) ;
-  return(NULL) ;
-}
+  size_t len = ((*ip == 4) ? 5 : ((*ip == 6) ? 17 : 0)) ;
 
-char *
-n4ta(u_int32_t *t, int mask)
-{
-  char *ts ;
-  unsigned int q[4] ;
-  q[0] = ((*t) >> 24) & 255 ;
-  q[1] = ((*t) >> 16) & 255 ;
-  q[2] = ((*t) >>  8) & 255 ;
-  q[3] = (*t) & 255 ;
-  ts = (char *) malloc(25) ;
-  if (mask > 0) {
-    sprintf(ts,"%u.%u.%u.%u/%d",q[0],q[1],q[2],q[3],mask) ;
-    }
-  else {
-    sprintf(ts,"%u.%u.%u.%u",q[0],q[1],q[2],q[3]) ;
-    }
-  return(ts);
+  return(((size_t) (iend - ip) >= len) ? len : 0) ;
 }
 
-char *
-n6ta(u_int128_t *t, int mask)
+int
+process_binary_threads(oa_table *t, int nthreads, int numa)
 {
-  v6addr lcl ;
-  int i ;
-  int tmp ;
-  int zero = 0 ;
-  char *cp ;
-  int ii[8] = {7,6,5,4,3,2,1,0} ;
-  static char buff[256] ;
-  char *ts ;
-
-  lcl.llds = *t ;
-  cp = buff;
-  for (i = 0 ; i < 8 ; ++i) {
-    if ((i < 7) && (zero == 0) && (lcl.sds[ii[i]] == 0) && (lcl.sds[ii[i+1]] == 0)) {
-      sprintf(cp,":") ;
-      if (!i) strcat(cp,":") ;
-      zero = 1 ;
-      }
-    else if ((zero == 1) && (lcl.sds[ii[i]] == 0)) {
-      zero = 1 ;
+  unsigned char *in = (unsigned char *) malloc(BINARY_BLOCK + 17) ;
+  unsigned char *out = (unsigned char *) malloc(BINARY_BLOCK + 17) ;
+  const unsigned char *ip, *cut ;
+  unsigned char *iend ;
+  size_t have = 0 ;
+  size_t r, len ;
+  int ok = 1 ;
+  int k ;
+
+  memset(&bpool,0,sizeof bpool) ;
+  bpool.nworkers = nthreads ;
+  if (numa && ((bpool.nodes = oa_numa_nodes()) > 64)) bpool.nodes = 64 ;
+  bpool.w = (struct bworker *) calloc(nthreads,sizeof *bpool.w) ;
+  pthread_barrier_init(&bpool.sync,0,nthreads + 1) ;
+  for (k = 0 ; k < nthreads ; ++k) {
+    bpool.w[k].t = t ;
+    bpool.w[k].id = k ;
+    bpool.w[k].node = (bpool.nodes ? k % bpool.nodes : 0) ;
+    pthread_create(&bpool.w[k].tid,0,binary_worker,&bpool.w[k]) ;
+    }
+  pthread_barrier_wait(&bpool.sync) ;
+  for (k = 0 ; k < bpool.nodes ; ++k) if (bpool.replica[k]) ++bpool.nreplicas ;
+  if (numa && table_stats)
+    fprintf(stderr,"numa: %d nodes, %d replicas, %d threads\n",bpool.nodes,bpool.nreplicas,nthreads) ;
+
+  while ((r = fread(in + have,1,BINARY_BLOCK,stdin)) > 0) {
+    have += r ;
+    iend = in + have ;
+
+    /* an even share of the block for each worker, to the next record */
+    ip = in ;
+    for (k = 0 ; k < nthreads ; ++k) {
+      cut = in + (have * (k + 1)) / nthreads ;
+      bpool.w[k].ip = ip ;
+      bpool.w[k].op = out + (ip - in) ;
+      while ((ip < cut) && (len = binary_record(ip,iend))) ip += len ;
+      bpool.w[k].iend = ip ;
       }
-    else if (i < 7) {
-      sprintf(cp,"%x:",lcl.sds[ii[i]]);
-      if (zero) { ++zero; } 
+    pthread_barrier_wait(&bpool.sync) ;
+    pthread_barrier_wait(&bpool.sync) ;
+
+    for (k = 0 ; k < nthreads ; ++k) {
+      fwrite(out + (bpool.w[k].ip - in),1,bpool.w[k].op - (out + (bpool.w[k].ip - in)),stdout) ;
       }
-    else {
-      sprintf(cp,"%x",lcl.sds[ii[i]]);
+    if ((ip < iend) && (*ip != 4) && (*ip != 6)) {
+      fprintf(stderr,"ERROR: Bad address family %u in binary input\n",*ip) ;
+      ok = 0 ;
+      break ;
       }
-    cp += strlen(cp) ;
+    have = iend - ip ;
+    memmove(in,ip,have) ;
     }
-  if (mask > 0) {
-    sprintf(cp,"/%d",mask) ;
+  if (ok && have) {
+    fprintf(stderr,"ERROR: Binary input ends in a partial record\n") ;
+    ok = 0 ;
     }
-  ts = strdup(buff) ;
-  return(ts);
+  fflush(stdout) ;
+
+  bpool.quit = 1 ;
+  pthread_barrier_wait(&bpool.sync) ;
+  for (k = 0 ; k < nthreads ; ++k) pthread_join(bpool.w[k].tid,0) ;
+  for (k = 0 ; k < bpool.nodes ; ++k) oa_table_free(bpool.replica[k]) ;
+  pthread_barrier_destroy(&bpool.sync) ;
+  free(bpool.w) ;
+  free(in) ;
+  free(out) ;
+  return(ok) ;
 }
 
 
-struct addr4 *
-address4_insert(avl_ref addresses,u_int32_t *start, u_int32_t *size,int mask)
-{
-  struct avldata local;
-  struct addr4 address ;
-  struct addr4 *ap = 0;
-  avl_ptr tmp ;
-
-  local.payload = &address ;
-  address.start = *start;
-  address.end = *start + *size - 1 ;
-  address.size = *size ;
-
-  avlinserted = 0 ;
-  avlinsert(addresses,&local,addr4_cmp) ;
-  tmp = avl_inserted ;
-  if (avlinserted) {
-    ap = (struct addr4 *) malloc(sizeof *ap) ;
-    ap->start = address.start ;
-    ap->end = address.end ;
-    ap->size = address.size ;
-    ap->origin_as = 0 ;
-    ap->nxt = 0 ;
-    ap->prv = 0 ;
-
-    ap->flags = 0 ;
-    if (mask) {
-      ap->address= n4ta(&(ap->start),mask) ;
-      ap->mask = mask ;
-      }
-    ap->status = 1 ;
+/*--------------------------------------------------------------------------------------------------*/
 
-    tmp->payload = ap ;
-    }
-  return(ap) ;
-}
+/*
+ * process_aggregate_list
+ * --aggregate: count each line against the origin of field <fn>, and
+ * print the totals per origin once the input ends
+ */
 
-struct addr6 *
-address6_insert(avl_ref addresses,u_int128_t *start, u_int128_t *size, int mask)
+void
+process_aggregate_list(oa_table *t, char delim, int fn, int sumf)
 {
-  struct avldata local;
-  struct addr6 address ;
-  struct addr6 *ap = 0;
-  avl_ptr tmp ;
-
-  local.payload = &address ;
-  address.start = *start;
-  address.end = address.start ;
-  address.end += *size ;
-  address.end  -= 1 ;
-  address.size = *size ;
-
-  avlinserted = 0 ;
-  avlinsert(addresses,&local,addr6_cmp) ;
-  tmp = avl_inserted ;
-  if (avlinserted) {
-    ap = (struct addr6 *) malloc(sizeof *ap) ;
-    ap->start = address.start ;
-    ap->end = address.end ;
-    ap->size = address.size ;
-    ap->origin_as = 0 ;
-    ap->nxt = 0 ;
-    ap->prv = 0 ;
-
-    ap->flags = 0 ;
-    if (mask) {
-      ap->address= n6ta(&(ap->start), mask) ;
-      ap->mask = mask ;
-      }
-    ap->status = 1 ;
-
-    tmp->payload = ap ;
-    }
-  return(ap) ;
-}
+  char inl[1026] ;
+  char field[1026] ;
+  char *vec[257] ;
+  int vec_len ;
+  char *cp ;
+  char *p ;
+  oa_cursor cursor ;
+  struct aggr *ag = aggr_new(aggregate) ;
+  u_int32_t a4 ;
+  u_int128_t a6 ;
+  unsigned int as ;
+  u_int32_t origin ;
+  size_t n ;
+  double value ;
+  int type ;
+  int mask ;
 
+  memset(&cursor,0,sizeof cursor) ;
+  while (fgets(inl,1024,stdin)) {
+    n = strlen(inl) ;
+    vec_len = 0 ;
+    vec[++vec_len] = inl ;
+    cp = inl ;
+    while ((vec_len < 255) && (cp = strchr(cp,delim))) vec[++vec_len] = ++cp ;
+    vec[vec_len + 1] = inl + n + 1 ;
+
+    /* the field up to its delimiter or the end of the line */
+    field[0] = '\0' ;
+    if ((fn >= 1) && (fn <= vec_len)) {
+      memcpy(field,vec[fn],vec[fn + 1] - vec[fn] - 1) ;
+      field[vec[fn + 1] - vec[fn] - 1] = '\0' ;
+      if ((cp = strpbrk(field,"\r\n"))) *cp = '\0' ;
+      }
+    value = (((sumf >= 1) && (sumf <= vec_len)) ? strtod(vec[sumf],0) : 0.0) ;
 
-unsigned int
-find6_origin_as(u_int128_t *start,char **p)
-{
-  struct avldata local;
-  struct addr6 address ;
-  struct addr6 *ap;
-  avl_ptr tmp ;
-
-  local.payload = &address ;
-  address.start = *start;
-  address.end = *start;
-  address.size = 1 ;
-
-  if ((tmp = avlaccess(addresses6,&local,addr6_find))) {
-    *p = ((struct addr6 *)tmp->payload)->address ;
-    return(((struct addr6 *)tmp->payload)->origin_as) ;
+    origin = 0 ;
+    a6 = 0 ;
+    as = 0 ;
+    p = 0 ;
+    switch ((type = parse_field(field,&a4,&a6,&mask,&as))) {
+      case FIELD_V4:
+        origin = find4_origin_as(t,(sorted_input ? &cursor : 0),&a4,&p,0) ;
+        a6 = a4 ;
+        break ;
+      case FIELD_V6:
+        origin = find6_origin_as(t,(sorted_input ? &cursor : 0),&a6,&p,0) ;
+        break ;
+      case FIELD_ASN:
+        origin = as ;
+        a6 = as ;
+        break ;
+      }
+    aggr_add(ag,origin,n,type,a6,value) ;
     }
-  return(0) ;
+  aggr_print(ag,stdout,(use_names ? t : 0),delim,sumf) ;
+  aggr_free(ag) ;
 }
 
-unsigned int
-find4_origin_as(u_int32_t *start,char **p)
-{
-  struct avldata local;
-  struct addr4 address ;
-  struct addr4 *ap;
-  avl_ptr tmp ;
-
-  local.payload = &address ;
-  address.start = *start;
-  address.end = *start;
-  address.size = 1 ;
-
-  if ((tmp = avlaccess(addresses4,&local,addr4_find))) {
-    *p = ((struct addr4 *)tmp->payload)->address ;
-    return(((struct addr4 *)tmp->payload)->origin_as) ;
-    }
-  return(0) ;
-}
 
+/*--------------------------------------------------------------------------------------------------*/
 
-/*--------------------------------------------------
- * add_addr
- * add address <addr> with aspath <asp> to the list of prefixes and as paths
- * if its not a selected prefix then simply add the as path to the as path set
- * return TRUE if it parses correctly
+/*
+ * process_nest_list
+ * --covering and --more-specific: each line, then the announced
+ * prefixes covering or inside field <fn>, as prefix,origin pairs
  */
 
-int
-add_addr(char *addr, char *asp)
+void
+process_nest_list(oa_table *t, char delim, int fn, int covering)
 {
-  int i ;
-  int q[4];
-  int mask;
-  int msk ;
-  v6addr ss ;
-  u_int128_t size;
-  int pv = 2;
-  u_int128_t strt ;
-  unsigned int ed ;
+  char inl[1026] ;
+  char field[1026] ;
+  char pfx[64] ;
+  char *vec[257] ;
+  int vec_len ;
   char *cp ;
-  struct addr4 *aptr ;
-  struct addr6 *aptr6 ;
-  struct s_asp *sa ;
-  u_int32_t strt4 ;
-  u_int32_t size4 ;
-
-  if (strchr(addr,':')) {
-    // V6 address processing
-    unsigned long int hex[8] ;
-    v6addr x ;
-    char *cp ;
-    char *slashcp ;
-    int i ;
-    int k ;
-    int shuffle = 8 ;
-    u_int128_t start ;
-
-    slashcp = strchr(addr,'/') ;
-    if (sscanf(slashcp,"/%d",&mask) != 1) return(0) ;
-    msk = mask ;
-    if (msk > 64) {
-      ss.lds[1] = 0 ;
-      msk -= 64 ;
-      if (msk > 32) {
-        ss.quad[1] = 0 ;
-        msk -= 32 ;
-        ss.quad[0] = (1 << (32 - msk)) ;
-        }
-      else {
-        ss.quad[0] = 0 ; 
-        ss.quad[1] = (1 << (32 - msk)) ;
-        }
-      }
-    else {
-      ss.lds[0] = 0 ;
-      if (msk > 32) {
-        msk -= 32 ;
-	ss.quad[2] = (1 << (32 - msk)) ;
-        ss.quad[3] = 0 ;
-        }
-      else {
-        ss.quad[2] = 0 ;
-        ss.quad[3] = (1 << (32 - msk)) ;
-        }
-      }
-    size = ss.llds ;
-    *slashcp = ':';
-    for (i = 0 ; i < 8 ; ++i) hex[i] = 0 ;
-    i = 0 ;
-    cp = addr ;
-    while (cp) {
-      if (sscanf(cp,"%lx:",&hex[i]) != 1) return(0) ;
-      if ((cp = strchr(cp,':')))
-        ++cp ;
-      ++i ;
-      if (cp && (*cp == ':')) { 
-        if (shuffle < 8) return(0) ;
-        shuffle = i ;
-        ++cp ;
-        if (*cp == ':') 
-          cp = 0 ;
-        }
-      if (i == 8) continue;
-      }
-    *slashcp = '/' ;
-    if (shuffle < 8) {
-      k = 7 ;
-      while (i > shuffle) {
-        hex[k] = hex[i-1] ;
-        hex[i-1] = 0 ;
-        --k ;
-        --i ;
-        }
-      }
+  const char *asname ;
+  oa_prefix *out ;
+  size_t max = 4096 ;
+  size_t n, i ;
+  u_int128_t a ;
+  int k ;
 
-    for (i = 0 ; i < 8 ; ++i) { 
-      x.sds[7 - i] = hex[i] ;
+  out = (oa_prefix *) malloc(max * sizeof *out) ;
+  while (fgets(inl,1024,stdin)) {
+    if ((cp = strpbrk(inl,"\r\n"))) *cp = '\0' ;
+    n = strlen(inl) ;
+    vec_len = 0 ;
+    vec[++vec_len] = inl ;
+    cp = inl ;
+    while ((vec_len < 255) && (cp = strchr(cp,delim))) vec[++vec_len] = ++cp ;
+    vec[vec_len + 1] = inl + n + 1 ;
+
+    field[0] = '\0' ;
+    if ((fn >= 1) && (fn <= vec_len)) {
+      memcpy(field,vec[fn],vec[fn + 1] - vec[fn] - 1) ;
+      field[vec[fn + 1] - vec[fn] - 1] = '\0' ;
       }
-    start = x.llds ;
-
-    if ((!x.lds[0]) && (!x.lds[1])) return(1) ;
-    sa = parse_aspath(asp);
-
-    aptr6 = address6_insert(&addresses6,&start,&size,mask);
-    aptr6->origin_as = sa->s_ases[sa->s_aspath_length - 1] ;
-    return(1) ;
-    }
-  /* address does not start with a digit - error */
-  if (!isdigit(*addr)) {
-    return(0);
-    }
 
-  /* Break address into octets and mask. If no explicit mask
-     then apply the class A/B/C rules */
-  i = sscanf(addr,"%d.%d.%d.%d/%d", &q[0], &q[1], &q[2], &q[3] ,&msk);
-  if (i < 5) {
-    if (q[0] < 128) msk = 8 ;
-    else if (q[0] < 192) msk = 16 ;
-    else msk = 24 ;
-    strcpy((cp = (char *)malloc(strlen(addr) + 4)), addr) ;
-    addr = cp ;
-    cp = addr + strlen(addr) ;
-    sprintf(cp,"/%d",msk);
-    }
+    /* a long run of more specifics is fetched again once there is room */
+    for (;;) {
+      n = (covering ? oa_covering(t,field,out,max) : oa_more_specifics(t,field,out,max)) ;
+      if (n <= max) break ;
+      max = n ;
+      out = (oa_prefix *) realloc(out,max * sizeof *out) ;
+      }
 
-  /* get start and end 32-bit address values of the address span */
-  strt4 = (q[0] << 24) + (q[1] << 16) + (q[2] << 8) + q[3];
-  if (!strt) {
-    /* this is the default route - in this case its not much use, so it's rejected, but not with an error value */
-    return(1) ;
+    printf("%s",inl) ;
+    for (i = 0 ; i < n ; ++i) {
+      for (a = 0, k = 0 ; k < ((out[i].family == 4) ? 4 : 16) ; ++k) a = (a << 8) | out[i].addr[k] ;
+      if (out[i].family == 4) fmt4(pfx,(u_int32_t) a,out[i].length) ;
+      else fmt6(pfx,a,out[i].length) ;
+      printf("%c%s",delim,pfx) ;
+      if (use_names && (asname = oa_asname(t,out[i].origin))) printf("%c%s",delim,asname) ;
+      else if (use_names) printf("%cAS%u",delim,out[i].origin) ;
+      else printf("%c%u",delim,out[i].origin) ;
+      }
+    printf("\n") ;
     }
-
-  size4 = 1 << (32 - msk) ;
-  sa = parse_aspath(asp);
-  if (!(sa->s_aspath_length)) return(1) ;
-  aptr = address4_insert(&addresses4,&strt4,&size4,msk);
-  aptr->origin_as = sa->s_ases[sa->s_aspath_length - 1] ;
-  return(1) ;
+  free(out) ;
 }
 
 
-/*--------------------------------------------------
- * chop
- * remove trailing aspath detritus from the aspath string
+/*--------------------------------------------------------------------------------------------------*/
+
+/*
+ * process_origin_list
+ * --origin-prefixes: each line, then the v4 and v6 address counts of
+ * the AS in field <fn> and the CIDR blocks it originates
  */
 
 void
-chop(char *s)
+process_origin_list(oa_table *t, char delim, int fn)
 {
-  int i = strlen(s) - 1 ;
-
-  while ((i >= 0)
-          && (isspace(s[i]) ||
-              (s[i] == '\n') ||
-              (s[i] == '\r') ||
-              (s[i] == 'i') ||
-              (s[i] == 'e') ||
-              (s[i] == '?'))) {
-    s[i--] = '\0';
-    }
-}
+  char inl[1026] ;
+  char field[1026] ;
+  char pfx[64] ;
+  char *vec[257] ;
+  int vec_len ;
+  char *cp ;
+  oa_prefix *out ;
+  size_t max = 4096 ;
+  size_t n, i ;
+  u_int32_t a4 ;
+  u_int128_t a6 ;
+  uint64_t addrs4 ;
+  uint64_t addrs6[2] ;
+  unsigned int asn ;
+  int mask ;
+  int k ;
 
+  out = (oa_prefix *) malloc(max * sizeof *out) ;
+  while (fgets(inl,1024,stdin)) {
+    if ((cp = strpbrk(inl,"\r\n"))) *cp = '\0' ;
+    n = strlen(inl) ;
+    vec_len = 0 ;
+    vec[++vec_len] = inl ;
+    cp = inl ;
+    while ((vec_len < 255) && (cp = strchr(cp,delim))) vec[++vec_len] = ++cp ;
+    vec[vec_len + 1] = inl + n + 1 ;
+
+    field[0] = '\0' ;
+    if ((fn >= 1) && (fn <= vec_len)) {
+      memcpy(field,vec[fn],vec[fn + 1] - vec[fn] - 1) ;
+      field[vec[fn + 1] - vec[fn] - 1] = '\0' ;
+      }
+    if (parse_field(field,&a4,&a6,&mask,&asn) != FIELD_ASN) asn = 0 ;
+
+    /* a large origin is fetched again once there is room */
+    for (;;) {
+      n = oa_origin_prefixes(t,asn,out,max,&addrs4,addrs6) ;
+      if (n <= max) break ;
+      max = n ;
+      out = (oa_prefix *) realloc(out,max * sizeof *out) ;
+      }
 
-/*--------------------------------------------------
- * substr
- * return TRUE is s1 is a substring of s2
- */
+    fmtu128(pfx,((u_int128_t) addrs6[0] << 64) | addrs6[1]) ;
+    printf("%s%c%llu%c%s",inl,delim,(unsigned long long) addrs4,delim,pfx) ;
+    for (i = 0 ; i < n ; ++i) {
+      for (a6 = 0, k = 0 ; k < ((out[i].family == 4) ? 4 : 16) ; ++k) a6 = (a6 << 8) | out[i].addr[k] ;
+      if (out[i].family == 4) fmt4(pfx,(u_int32_t) a6,out[i].length) ;
+      else fmt6(pfx,a6,out[i].length) ;
+      printf("%c%s",delim,pfx) ;
+      }
+    printf("\n") ;
+    }
+  free(out) ;
+}
 
-int substr(char *s1, char *s2)
-  {
-  int l = strlen(s1);
 
-  while ((s2 = strchr(s2, *s1))) {
-    if (!strncmp(s1,s2,l)) return(1) ;
-    if (!*(++s2)) return(0) ;
-    }
-  return(0) ;
-  }
+/*--------------------------------------------------------------------------------------------------*/
 
-char sv6[40] ;
+/*
+ * space_report_list
+ * --space-report: the v4 addresses and v6 /48s of every origin,
+ * largest first
+ */
 
-char *
-sprint6(u_int128_t *a)
+static int
+space_cmp(const void *a, const void *b)
 {
-  char * cp ;
+  const oa_space *sa = (const oa_space *) a ;
+  const oa_space *sb = (const oa_space *) b ;
 
-  cp = n6ta(a,0) ;
-  strcpy(sv6,cp) ;
-  free(cp) ;
-  return(sv6) ;
+  if (sa->addrs4 != sb->addrs4) return((sa->addrs4 > sb->addrs4) ? -1 : 1) ;
+  if (sa->addrs6[0] != sb->addrs6[0]) return((sa->addrs6[0] > sb->addrs6[0]) ? -1 : 1) ;
+  if (sa->addrs6[1] != sb->addrs6[1]) return((sa->addrs6[1] > sb->addrs6[1]) ? -1 : 1) ;
+  return((sa->origin < sb->origin) ? -1 : (sa->origin > sb->origin)) ;
 }
 
-unsigned int
-originas(char *f, char **p)
+void
+space_report_list(oa_table *t, char delim)
 {
-  v6addr x ;
-  unsigned int q[4] ;
-  unsigned int msk ;
-  unsigned int mask ;
-  unsigned int as  = 0 ;
-  unsigned int address ;
-  int i ;
-  char *cp ;
-  char *cp1 ;
-  unsigned long int hex[8] ;
-  int k ;
-  int shuffle = 8 ;
-  u_int128_t start ;
-  u_int32_t strt ;
-  int lmsk ;
-  unsigned long int lmask ;
-  static char prefix_str[1024] ;
-  
-  if ((cp1 = strchr(f,':'))) {
-    if ((cp1 = strchr(f,'/'))) {
-      if (sscanf(cp1,"/%d",&msk) != 1) return(0) ;
-      *cp1 = ':';
-      }
-    for (i = 0 ; i < 8 ; ++i) hex[i] = 0 ;
-    i = 0 ;
-    cp = f ;
-    while ((cp) && (*cp)) {
-      if (sscanf(cp,"%lx",&hex[i]) != 1) { cp = 0 ; return(0) ; }
-      if ((cp = strchr(cp,':'))) ++cp ;
-      ++i ;
-      if (cp && (*cp == ':')) { 
-        if (shuffle < 8) return(0) ;
-        shuffle = i ;
-        ++cp ;
-        if (*cp == ':')  cp = 0 ;
-        }
-      if (i > 8) return(0);
-      }
-    if (cp1) *cp1 = '/' ;
-    if (shuffle < 8) {
-      k = 7 ;
-      while (i > shuffle) {
-        hex[k] = hex[i-1] ;
-        hex[i-1] = 0 ;
-        --k ;
-        --i ;
-        }
-      }
-    x.lds[1] = ((hex[0] & 65535) << 48) + ((hex[1] & 65535) << 32)  + 
-        ((hex[2] & 65535) << 16) + (hex[3] & 65535) ;
-    x.lds[0] = ((hex[4] & 65535) << 48) + ((hex[5] & 65535) << 32)  + 
-        ((hex[6] & 65535) << 16) + (hex[7] & 65535) ;
-    start = x.llds ;
-    if (start == 0) return(0) ;
+  oa_space *sp ;
+  const char *asname ;
+  size_t n, i ;
+
+  n = oa_table_space(t,0,0) ;
+  sp = (oa_space *) malloc((n ? n : 1) * sizeof *sp) ;
+  n = oa_table_space(t,sp,n) ;
+  qsort(sp,n,sizeof *sp,space_cmp) ;
+  for (i = 0 ; i < n ; ++i) {
+    if (use_names && (asname = oa_asname(t,sp[i].origin))) printf("%s",asname) ;
+    else if (use_names) printf("AS%u",sp[i].origin) ;
+    else printf("%u",sp[i].origin) ;
+    /* a /48 is 2^80 addresses, 2^16 of the high word */
+    printf("%c%llu%c%llu\n",delim,(unsigned long long) sp[i].addrs4,delim,
+           (unsigned long long) (sp[i].addrs6[0] >> 16)) ;
+    }
+  free(sp) ;
+}
 
-    //    printf("line <%s>, searching for %s\n",f,n6ta(&start)) ;
 
-    as = find6_origin_as(&start,p) ;
-    return(as) ;
-    }
-  else if ((cp1 = strchr(f,'.'))) {
-    i = sscanf(f,"%d.%d.%d.%d/%d", &q[0], &q[1], &q[2], &q[3] ,&msk);
-    if (i < 4) return(0) ;
-    if (i < 5) msk = 24 ;
-    strt = ((q[0] & 255) << 24) + ((q[1] & 255) << 16) + ((q[2] & 255) << 8) + (q[3] & 255) ;
-    as = 0 ;
-    as = find4_origin_as(&strt,p) ;
-    return(as);
-    }
-  else if (isdigit(*f)) {
-    return(strtoul(f,0,10)) ;
-    }
-  else if ((toupper(*f) == 'A') && (toupper(*(f+1)) == 'S') && isdigit(*(f+2))) {
-    return(strtoul(f+2,0,10)) ;
-    }
-  return(0) ;
-  }
+/*--------------------------------------------------------------------------------------------------*/
+
+/*
+ * process_history_list
+ * as process_prefix_list, but against the history: the origin at the
+ * --at time, or else every change as time:origin separated by spaces
+ */
 
 void
-process_prefix_list(char delim, int *f, int fl, int showp)
+process_history_list(oa_history *h, oa_table *names, char delim, int *f, int fl)
 {
   char *inl ;
   char inll[1026] ;
   char *vec[256] ;
-  unsigned int asvec[256] ;
   int vec_len ;
   int fi ;
-  int vi ;
-  char sav ;
+  char sav = 0 ;
   char *cp ;
-  char *pfx ;
-  char *prefixes[256] ;
-  char *asname ;
+  const char *asname ;
+  size_t max = 64 ;
+  u_int32_t *when = (u_int32_t *) malloc(max * sizeof *when) ;
+  u_int32_t *origins = (u_int32_t *) malloc(max * sizeof *origins) ;
+  size_t n, i ;
 
   inl =&inll[0] ;
   *inl++ = ',';
-  
+
   while (fgets(inl,1024,stdin)) {
     if ((cp = strchr(inl,'\n'))) *cp = '\0';
     if ((cp = strchr(inl,'\r'))) *cp = '\0';
@@ -748,599 +806,238 @@ process_prefix_list(char delim, int *f, int fl, int showp)
     ++cp ;
     while ((vec_len < 255) && (cp = strchr(cp,delim))) {
       vec[++vec_len] = cp++ ;
-      }      
-    fi = 0 ;
-    vi = 0 ;
-    while (fi < fl) {
-      asvec[vi] = 0 ;
-      prefixes[vi] = 0 ;
-      if ((f[fi] <= vec_len) && (vec[f[fi]]) && (*(vec[f[fi]] + 1) != delim)) {
-        if (f[fi] < vec_len) {
-          sav = *(vec[f[fi] + 1]) ;
-          *(vec[f[fi]+1]) = '\0';
-          }
-        if ((asvec[vi] = originas(vec[f[fi]]+1,&pfx))) {
-          if (showp) prefixes[vi] = strdup(pfx) ;
-	  }
-        else if (showp) prefixes[vi] = "" ;
-
-        if (use_names) {
-          asname = find_as(asvec[vi]) ;
-          if (asname) {
-            printf("%c%s",delim,asname) ;
-	    }
-          else {
-            printf("%cAS%u",delim,asvec[vi]) ;
-	    }
-	  }
-        else
-          printf("%c%u",delim,asvec[vi]) ;
-        if (f[fi] < vec_len) {
-          *(vec[f[fi]+1]) = sav;
-          }
+      }
+    for (fi = 0 ; fi < fl ; ++fi) {
+      printf("%c",delim) ;
+      if ((f[fi] > vec_len) || !vec[f[fi]] || (*(vec[f[fi]] + 1) == delim)) {
+        if (history_at) printf("0") ;
+        continue ;
+        }
+      if (f[fi] < vec_len) {
+        sav = *(vec[f[fi] + 1]) ;
+        *(vec[f[fi]+1]) = '\0';
+        }
+      if (history_at) {
+        origins[0] = oa_history_lookup(h,vec[f[fi]]+1,history_when) ;
+        when[0] = history_when ;
+        n = 1 ;
         }
       else {
-        printf("%c%u",delim,0) ;
-        }    
-      ++fi ;
-      ++vi ;
-      }
-    if (showp) {
-      fi = 0 ;
-      while (fi < fl) {
-        if (prefixes[fi] && (*(prefixes[fi]))) { printf("%c%s",delim,prefixes[fi]) ; free(prefixes[fi]) ; }
-        else { printf("%c",delim) ; }
-	++fi ;
+        /* a long history is fetched again once there is room */
+        while ((n = oa_history_changes(h,vec[f[fi]]+1,when,origins,max)) > max) {
+          max = n ;
+          when = (u_int32_t *) realloc(when,max * sizeof *when) ;
+          origins = (u_int32_t *) realloc(origins,max * sizeof *origins) ;
+          }
+        }
+      for (i = 0 ; i < n ; ++i) {
+        if (!history_at) printf("%s%u:",(i ? " " : ""),when[i]) ;
+        if (use_names && (asname = oa_asname(names,origins[i]))) printf("%s",asname) ;
+        else if (use_names) printf("AS%u",origins[i]) ;
+        else printf("%u",origins[i]) ;
+        }
+      if (f[fi] < vec_len) {
+        *(vec[f[fi]+1]) = sav;
         }
       }
     printf("\n") ;
     fflush(stdout) ;
     }
+  free(when) ;
+  free(origins) ;
   }
 
 
+/*
+ * snapshot_time
+ * time of a --history argument: TIME=file, or the first run of 8 digits
+ * (a yyyymmdd date) in the file name. Return 0 if there is neither
+ */
 
-char pbuffer[256] ;
-
-char *
-print_v4_addr(struct addr4 *p)
+static int
+snapshot_time(char *arg, struct snapshot *sn)
 {
-  u_int32_t t ;
-  unsigned int q[4] ;
-  unsigned int asn ;
-  char ts[256] ;
-  char te[256] ;
-  char tz[24] ; 
-  
-  t = p->start ;
-  q[0] = (t >> 24) & 255 ;
-  q[1] = (t >> 16) & 255 ;
-  q[2] = (t >>  8) & 255 ;
-  q[3] = t & 255 ;
-  sprintf(ts,"%u.%u.%u.%u",q[0],q[1],q[2],q[3]) ;
-
-  t = p->end ;
-  q[0] = (t >> 24) & 255 ;
-  q[1] = (t >> 16) & 255 ;
-  q[2] = (t >>  8) & 255 ;
-  q[3] = t & 255 ;
-  sprintf(te,"%u.%u.%u.%u",q[0],q[1],q[2],q[3]) ;
-  asn = p->origin_as ;
-  q[3] = (unsigned int) p->size ;
-  sprintf(tz,"(%u)",q[3]) ;
-  sprintf(pbuffer,"%s - %s AS%u %s",ts,te,asn,tz) ;
-
-  return(pbuffer) ;
-} 
-
-
-void 
-print_addr4(avl_ptr adp, FILE *param, int depth)
-{
-  struct addr4 *ap ;
-  unsigned int q[4] ;
-  unsigned int size ;
+  char *cp ;
+  char *base ;
+  int digits = 0 ;
 
-  ap = (struct addr4 *) adp->payload ;
-  printf("%s\n",print_v4_addr(ap)) ;
+  for (cp = arg ; isdigit((unsigned char) *cp) ; ++cp) ;
+  if ((cp > arg) && (*cp == '=') && cp[1]) {
+    sn->when = (u_int32_t) strtoul(arg,0,10) ;
+    sn->file = cp + 1 ;
+    return(1) ;
+    }
+  sn->file = arg ;
+  base = ((cp = strrchr(arg,'/')) ? cp + 1 : arg) ;
+  for (cp = base ; *cp ; ++cp) {
+    if (!isdigit((unsigned char) *cp)) digits = 0 ;
+    else if (++digits == 8) {
+      if (isdigit((unsigned char) cp[1])) continue ;
+      sn->when = (u_int32_t) strtoul(cp - 7,0,10) ;
+      return(1) ;
+      }
+    }
+  return(0) ;
 }
 
-void 
-print_addr4_x(avl_ptr adp, FILE *param, int depth)
+static int
+snapshot_cmp(const void *a, const void *b)
 {
-  struct addr4 *ap ;
-  unsigned int q[4] ;
-  unsigned int size ;
+  const struct snapshot *sa = (const struct snapshot *) a ;
+  const struct snapshot *sb = (const struct snapshot *) b ;
 
-  ap = (struct addr4 *) adp->payload ;
-  printf("%s\n",print_v4_addr(ap)) ;
+  if (sa->when != sb->when) return((sa->when < sb->when) ? -1 : 1) ;
+  return((sa->argi < sb->argi) ? -1 : (sa->argi > sb->argi)) ;
 }
 
-void 
-print_addr6(avl_ptr adp, FILE *param, int depth)
-{
-  struct addr6 *ap ;
-
-  ap = (struct addr6 *) adp->payload ;
-  printf("AS%d %s - ",ap->origin_as,sprint6(&(ap->start))) ;
-  printf("%s\n",sprint6(&ap->end)) ;
-} 
+/*
+ * load_history
+ * build one table per snapshot time from all the files of that time,
+ * and fold them into a history in time order
+ */
 
-void 
-deaggregate4()
+static oa_history *
+load_history(void)
 {
-  struct addr4 *ap, *t, *xn, *xp, *app, *apnxt ;
-  u_int32_t start, end, size ;
-  struct avldata local;
-  struct addr4 address ;
-  enum AVLRES tmp ;
-
- 
-  local.payload = &address ;
-  ap = v4head ;
-  while (ap) {
-    app = 0 ;
-    if (ap->nxt) {
-      if (ap->end >= ap->nxt->start) {
-        if (ap->start < ap->nxt->start) {
-          /* shrink this to the leading part that is "exposed" */
-          /* record the overhang */
-          end = ap->end ;
-          size = end - start + 1 ;
-
-          /* now shrink this */
-          ap->end = ap->nxt->start - 1 ; 
-          ap->size = ap->end - ap->start + 1 ;
-
-          /* if there is "overhang" then find the corect insert place for the overhang, which is proir to the
-	  next entry with start >= the start of this remainder start */
-          if (end > ap->nxt->end) {
-            /* now generate a new item with start ap->nxt->end + 1 through to ap->end */
-            start = ap->nxt->end  + 1 ;
-            size = end - start + 1 ;
-            if (size > 0) {
-              if ((t = address4_insert(&addresses4,&start,&size,0))) {
-                if (avlinserted) {
-                  t->origin_as = ap->origin_as ;
-                  t->flags = 0 ;
-                  t->status = 2 ;
-                  t->address = ap->address ;
-                  t->mask = ap->mask ;
-                  xn = ap->nxt ;
-                  xp = xn->prv ;
-                  while ((xn) && ((xn->start < t->start) || ((xn->start == t->start) && (xn->size > t->size)))) { xp = xn ; xn = xn->nxt ; }
-                  t->prv = xp ;
-                  if (xp) xp->nxt = t ;
-                  t->nxt = xn ;
-                  if (xn) xn->prv = t ;
-		  }
-	        }
-	      }
-            }
-          }
-        else if (ap->start == ap->nxt->start) {
-          /* there is no leading part */
-          /* remove ap from the linked list */
-          char *addr ;
-
-          addr = ap->address ;
-          ap->status += 10 ;
-	  ap->nxt->prv = ap->prv ;
-          if (ap->prv) ap->prv->nxt = ap->nxt ;
-          else v4head = ap->nxt ;
-          end = ap->end ;
-
-          address.start = ap->start;
-          address.end = ap->end ;
-          address.size = ap->size ;
-          tmp = avlremove(&addresses4,&local,addr4_cmp) ;
-          if (tmp == ERROR) {
-            printf("Remove Error!\n") ;
-	    }
-          else {
-            app = ap ;
-	    }
-
-          /* if there is "overhang" then find the corect insert place for the overhang, which is proir to the
-	  next entry with start >= the start of this remainder start */
-          if (end > ap->nxt->end) {
-            /* now generate a new item with start ap->nxt->end + 1 through to ap->end */
-            start = ap->nxt->end  + 1 ;
-            size = end - start + 1 ;
-            if (size > 0) {
-              if ((t = address4_insert(&addresses4,&start,&size,0))) {
-                if (avlinserted) {
-                  t->origin_as = ap->origin_as ;
-                  t->flags = 0 ;
-                  t->status = 2 ;
-                  t->address = addr ;
-                  t->mask = ap->mask ;
-                  xn = ap->nxt ;
-                  xp = xn->prv ;
-                  while ((xn) && ((xn->start < t->start) || ((xn->start == t->start) && (xn->size > t->size)))) { xp = xn ; xn = xn->nxt ; }
-                  t->prv = xp ;
-                  if (xp) xp->nxt = t ;
-                  t->nxt = xn ;
-                  if (xn) xn->prv = t ;
-		  }
-	        }
-	      }
-            }
-	  }
-        }
-      }
-    ap = ap->nxt ;
-    if (app) { 
-      free(app) ; 
-      app = 0 ; 
+  oa_history *h = oa_history_new() ;
+  oa_table *t ;
+  const char *files[256] ;
+  size_t segs, changes, snaps, k ;
+  int i = 0, j ;
+
+  /* qsort is not stable - the comparison falls back on argument order */
+  qsort(snapshots,nsnapshots,sizeof snapshots[0],snapshot_cmp) ;
+  while (i < nsnapshots) {
+    t = oa_table_new(0) ;
+    for (j = i ; (j < nsnapshots) && (snapshots[j].when == snapshots[i].when) ; ++j)
+      files[j - i] = snapshots[j].file ;
+    if ((k = oa_table_load_files(t,files,j - i)) < (size_t) (j - i)) {
+      fprintf(stderr,"ERROR: Cannot open BGP dump: %s\n",files[k]) ;
+      exit(EXIT_FAILURE) ;
       }
-    }
-
-  
-  if (!show_prefix) {
-    ap = v4head ;
-    while (ap && ap->nxt) {
-      if ((ap->end +1 == ap->nxt->start) && (ap->origin_as == ap->nxt->origin_as)) {
-        app = ap->nxt ;
-        size = ap->size + app->size ;
-        end = app->end ;
-        apnxt = app->nxt ;
-
-        address.start = app->start;
-        address.end = app->end ;
-        address.size = app->size ;
-        tmp = avlremove(&addresses4,&local,addr4_cmp) ;
-        if (tmp == ERROR) {
-          printf("Remove Error!\n") ;
-	  }
-        else {
-          free(app) ;
-	  }
-      
-        ap->size = size ;
-        ap->end = end ;
-        ap->nxt = apnxt ;
-        if (apnxt) apnxt->prv = ap ;
-        }
-      else {
-        ap = ap->nxt ;
-        }
+    if (!oa_table_build(t)) {
+      fprintf(stderr,"ERROR: Cannot build table: out of memory\n") ;
+      exit(EXIT_FAILURE) ;
       }
+    oa_history_add(h,snapshots[i].when,t) ;
+    oa_table_free(t) ;
+    i = j ;
     }
+  oa_history_stats(h,&snaps,&segs,&changes) ;
+  fprintf(stderr,"history: %lu snapshots, %lu segments, %lu changes\n",
+          (unsigned long) snaps,(unsigned long) segs,(unsigned long) changes) ;
+  return(h) ;
 }
 
 
-void 
-deaggregate6()
-{
-  struct addr6 *ap, *t, *xn, *xp, *app, *apnxt ;
-  u_int128_t start, end, size ;
-  struct avldata local;
-  struct addr6 address ;
-  enum AVLRES tmp ;
+/*
+ * load_list
+ * build a table from the comma separated list of dumps <list>
+ */
 
- 
-  local.payload = &address ;
-  ap = v6head ;
-  while (ap) {
-    app = 0 ;
-    if (ap->nxt) {
-      if (ap->end >= ap->nxt->start) {
-        if (ap->start < ap->nxt->start) {
-          /* shrink this to the leading part that is "exposed" */
-          /* record the overhang */
-          end = ap->end ;
-          size = end ;
-          size -= start ;
-          size += 1 ;
-
-          /* now shrink this */
-          ap->end = ap->nxt->start - 1 ; 
-          ap->size = ap->end - ap->start + 1 ;
-
-          /* if there is "overhang" then find the corect insert place for the overhang, which is proir to the
-	  next entry with start >= the start of this remainder start */
-          if (end > ap->nxt->end) {
-            /* now generate a new item with start ap->nxt->end + 1 through to ap->end */
-            start = ap->nxt->end  ;
-            start += 1 ;
-            size = end ;
-            size  -= start ;
-            size += 1 ;
-            if (size > 0) {
-              if ((t = address6_insert(&addresses6,&start,&size,0))) {
-                if (avlinserted) {
-                  t->origin_as = ap->origin_as ;
-                  t->flags = 0 ;
-                  t->status = 2 ;
-                  t->address = ap->address ;
-                  t->mask = ap->mask ;
-                  xn = ap->nxt ;
-                  xp = xn->prv ;
-                  while ((xn) && ((xn->start < t->start) || ((xn->start == t->start) && (xn->size > t->size)))) { xp = xn ; xn = xn->nxt ; }
-                  t->prv = xp ;
-                  if (xp) xp->nxt = t ;
-                  t->nxt = xn ;
-                  if (xn) xn->prv = t ;
-		  }
-	        }
-	      }
-            }
-          }
-        else if (ap->start == ap->nxt->start) {
-          /* there is no leading part */
-          /* remove ap from the linked list */
-          ap->status += 10 ;
-	  ap->nxt->prv = ap->prv ;
-          if (ap->prv) ap->prv->nxt = ap->nxt ;
-          else v6head = ap->nxt ;
-          end = ap->end ;
-
-          address.start = ap->start;
-          address.end = ap->end ;
-          address.size = ap->size ;
-          tmp = avlremove(&addresses6,&local,addr6_cmp) ;
-          if (tmp == ERROR) {
-            printf("Remove Error 6!\n") ;
-	    }
-          else {
-            app = ap ;
-	    }
+static oa_table *
+load_list(char *list)
+{
+  oa_table *t = oa_table_new(0) ;
+  const char *files[256] ;
+  char *cp ;
+  size_t n = 0, k ;
 
-          /* if there is "overhang" then find the corect insert place for the overhang, which is proir to the
-	  next entry with start >= the start of this remainder start */
-          if (end > ap->nxt->end) {
-            /* now generate a new item with start ap->nxt->end + 1 through to ap->end */
-            start = ap->nxt->end  + 1 ;
-            size = end - start + 1 ;
-            if (size > 0) {
-              if ((t = address6_insert(&addresses6,&start,&size,0))) {
-                if (avlinserted) {
-                  t->origin_as = ap->origin_as ;
-                  t->flags = 0 ;
-                  t->status = 2 ;
-                  t->address = ap->address ;
-                  t->mask = ap->mask ;
-                  xn = ap->nxt ;
-                  xp = xn->prv ;
-                  while ((xn) && ((xn->start < t->start) || ((xn->start == t->start) && (xn->size > t->size)))) { xp = xn ; xn = xn->nxt ; }
-                  t->prv = xp ;
-                  if (xp) xp->nxt = t ;
-                  t->nxt = xn ;
-                  if (xn) xn->prv = t ;
-		  }
-	        }
-	      }
-            }
-	  }
-        }
-      }
-    ap = ap->nxt ;
-    if (app) { 
-      free(app) ; 
-      app = 0 ; 
-      }
+  for (cp = strtok(list,",") ; cp && (n < 256) ; cp = strtok(0,",")) files[n++] = cp ;
+  if ((k = oa_table_load_files(t,files,n)) < n) {
+    fprintf(stderr,"ERROR: Cannot open BGP dump: %s\n",files[k]) ;
+    exit(EXIT_FAILURE) ;
     }
-
-  if (!show_prefix) {
-    ap = v6head ;
-    while (ap && ap->nxt) {
-      if ((ap->end +1 == ap->nxt->start) && (ap->origin_as == ap->nxt->origin_as)) {
-        app = ap->nxt ;
-        size = ap->size ;
-        size += app->size ;
-        end = app->end ;
-        apnxt = app->nxt ;
-
-        address.start = app->start;
-        address.end = app->end ;
-        address.size = app->size ;
-        tmp = avlremove(&addresses6,&local,addr6_cmp) ;
-        if (tmp == ERROR) {
-          printf("Remove Error 61!\n") ;
-  	  }
-        else {
-          free(app) ;
-	  }
-      
-        ap->size = size ;
-        ap->end = end ;
-        ap->nxt = apnxt ;
-        if (apnxt) apnxt->prv = ap ;
-        }
-      else {
-        ap = ap->nxt ;
-        }
-      }
+  if (!oa_table_build(t)) {
+    fprintf(stderr,"ERROR: Cannot build table: out of memory\n") ;
+    exit(EXIT_FAILURE) ;
     }
+  return(t) ;
 }
 
+/*
+ * diff_lists
+ * write the origin changes between the tables of dump lists <from> and <to>
+ */
 
-void 
-link4(avl_ptr adp, FILE *param, int depth)
+static void
+diff_lists(char *from, char *to)
 {
-  struct addr4 *ap ;
-
-  ap = (struct addr4 *) adp->payload ;
-  ap->prv = aggregate4 ;
-  if (!v4head) { v4head = ap ; aggregate4 = ap ; }
-  else { aggregate4->nxt = ap ; }
-  ap->nxt = 0 ;
-  ap->flags = 0 ;
-  aggregate4 = ap ;
+  oa_table *ot = load_list(from) ;
+  oa_table *nt = load_list(to) ;
+  size_t n ;
+
+  if (!oa_table_diff(ot,nt,1,&n)) {
+    fprintf(stderr,"ERROR: Table diff failed\n") ;
+    exit(EXIT_FAILURE) ;
+    }
+  fprintf(stderr,"diff: %lu changed ranges\n",(unsigned long) n) ;
+  oa_table_free(ot) ;
+  oa_table_free(nt) ;
 }
 
 
-void 
-link6(avl_ptr adp, FILE *param, int depth)
+/*
+ * apply_updates
+ * the updater thread - apply each --updates file to live table <arg>
+ */
+
+static void *
+apply_updates(void *arg)
 {
-  struct addr6 *ap ;
-
-  ap = (struct addr6 *) adp->payload ;
-  ap->prv = aggregate6 ;
-  if (!v6head) { v6head = ap ; aggregate6 = ap ; }
-  else { aggregate6->nxt = ap ; }
-  ap->nxt = 0 ;
-  ap->flags = 0 ;
-  aggregate6 = ap ;
+  oa_table *t = (oa_table *) arg ;
+  int i ;
+
+  for (i = 0 ; i < nupdates ; ++i) {
+    if (oa_table_update(t,updates[i]) < 0)
+      fprintf(stderr,"ERROR: Cannot apply BGP updates: %s\n",updates[i]) ;
+    }
+  return(0) ;
 }
 
+static void
+update_stats(const oa_table *t)
+{
+  uint64_t msgs, ann, wd, ns, maxns ;
 
-int
-read_as_names(char *fname) {
-  FILE *f ;
-  char buffer[1024] ;
-  unsigned int asn, ash, asl ;
-  char *name ;
-  char *cp ;
-  struct avldata local ;
-  struct as_names sasn ;
-  struct as_names *sasnp ;
-  avl_ptr tmp ;
-
-  local.payload = &sasn ;
-  if (!(f = fopen(fname,"r"))) return(0) ;
-  while (fgets(buffer,1023,f)) {
-    buffer[strlen(buffer) - 1] = '\0';
-    if (*buffer == '#') continue ;
-    
-    if ((cp = strchr(buffer,'\t'))) {
-      name = (cp + 1) ;
-      *cp = '\0'; ;
-      }
-    else if ((cp = strchr(buffer,' '))) {
-      name = &buffer[8] ;
-      *cp = '\0'; ;
-      }
-    if (strchr(buffer,'.')) {
-      sscanf(buffer,"%d.%d",&ash,&asl) ;
-      asn = (ash << 16) + asl ;
-      }
-    else
-      asn = strtoul(buffer,0,10) ;
-
-    sasn.as = asn ;
-    avl_inserted = 0 ;
-    avlinsert(&asnames,&local,asn_cmp) ;
-    tmp = avl_inserted ;
-    if (avlinserted) {
-      sasnp = (struct as_names *) malloc(sizeof *sasnp) ;
-      sasnp->as = asn ;
-      sasnp->asname = strdup(name) ;
-      tmp->payload = sasnp ;
-      }
-    }
-  fclose(f) ;
-  return(1) ;
+  oa_update_stats(t,&msgs,&ann,&wd,&ns,&maxns) ;
+  fprintf(stderr,"updates: %llu messages, %llu announced, %llu withdrawn, %.2f us mean, %.2f us max\n",
+          (unsigned long long) msgs,(unsigned long long) ann,(unsigned long long) wd,
+          (msgs ? (ns / 1000.0) / msgs : 0.0),maxns / 1000.0) ;
 }
 
-/*--------------------------------------------------------------------------------------------------*/
 
 /*
- * read dumpfile
+ * page_stats
+ * --stats: the pages the lookup arrays of the table were put on
  */
 
-int
-read_dump(char *filename) 
+static void
+page_stats(const oa_table *t)
 {
-  FILE *fi ;
-  gzFile gfi ;
-  char inl[1025] ;
-  char pnl[1025] ;
-  char lastaddr[128] = "" ;
-  char *addr ;
-  char *aspath ;
-  char *cp ;
-  int parse_header = 0 ;
-  int pathoffset ;
-  int use_gz = 0 ;
-  char *rdf = "1" ;
-  char *pdf ;
-
-  if (strcasestr(filename, ".gz") != (char *)NULL) {
-    if (!(gfi = gzopen(filename,"r"))) return(0) ;
-    use_gz = 1 ;
-    }
-  else {
-    if (!(fi = fopen(filename,"r"))) return(0) ;
-    }
-  
-  while (rdf && (parse_header < 2)) {
-    if (use_gz) {
-      rdf = gzgets(gfi,inl,1024) ;
-      }
-    else {
-      rdf = fgets(inl,1024,fi) ;
-      }
-    if (!rdf) continue ;
-    if (parse_header) {
+  static const char *kind[] = { "base", "transparent huge", "explicit huge" } ;
+  size_t pagesize ;
+  int pages ;
 
-      //the last line of the header is
-      // "Network..Next Hop..Metric LocPrf Weight Path"
+  pages = oa_table_pages(t,&pagesize) ;
+  fprintf(stderr,"pages: %lu kB %s pages\n",(unsigned long) (pagesize >> 10),kind[pages]) ;
+}
 
-      if (substr("Prf",inl)) parse_header = 0 ;
-      continue ;
-      }
 
-    // if there is a header it starts with "show ip bgp"
-    if (!strncmp(inl,"show",4)) {
-      parse_header = 1 ;
-      continue ;
-      }
+/*
+ * output_close
+ * finish the compressed output stream as the command exits
+ */
 
-    // look for lines where the address is too long and the
-    // path field is offset
-    pathoffset = 0 ;
-    while (!isspace(inl[19 + pathoffset])) ++pathoffset ;
-
-    addr = &inl[3] ;
-    if ((cp = strchr(addr,' '))) *cp++ =  '\0';
-    chop(addr) ;
-
-    // a blank line means use the last address 
-    if (!*addr) { 
-      strcpy(addr,lastaddr) ; 
-      cp = addr + strlen(addr) + 1 ; 
-      } 
-    strcpy(lastaddr,addr) ;
-
-    if (strchr(addr,':')) {
-      if (!cp || (strlen(cp) < 35)) {
-        if (use_gz) {
-          pdf = gzgets(gfi,pnl,1024) ;
-          }
-        else {
-          pdf = fgets(pnl,1024,fi) ;
-          }
-        cp = pnl ;
-   
-        if (strlen(cp) < 60) {
-          if (use_gz) {
-            pdf = gzgets(gfi,pnl,1024) ;
-            }
-          else {
-            pdf = fgets(pnl,1024,fi) ;
-            }
-          }
-        aspath = &pnl[61] ;
-        }
-      else {
-        aspath = &inl[61] ;
-        }
-      if (*aspath == 'i') continue ;
-      }
-    else 
-      aspath = &inl[61 + pathoffset] ;
-
-    // look for the "best" (or selected) as path
-    if ((inl[1] != '>') || !*addr) continue ;
-    
-    chop(aspath) ;
-    add_addr(addr,aspath) ;
+static void
+output_close(void)
+{
+  fflush(stdout) ;
+  if (zout && !zout_close(zout)) {
+    fprintf(stderr,"ERROR: Cannot write compressed output\n") ;
+    _exit(EXIT_FAILURE) ;
     }
-  if (use_gz) { gzclose(gfi) ; }
-  else { fclose(fi) ; }
-  return(1) ;
+  zout = 0 ;
 }
 
 
@@ -1352,7 +1049,41 @@ read_dump(char *filename)
  
 void
 usage() {
-  printf("Usage: originas [-f fields] [-d delimiter]\n   originas -d , -f 2,3\n");
+  printf("Usage: originas [-m] [-n] [-f fields] [-d delimiter] [--sorted-input] [dumpfile ...]\n   originas -d , -f 2,3\n");
+  printf("   --sorted-input   input is (mostly) in ascending address order\n");
+  printf("   --export[=csv|binary] [--cidr]\n");
+  printf("                    write the deaggregated table to stdout, as minimal CIDR blocks with --cidr\n");
+  printf("   --diff OLD NEW   write the ranges whose origin changed between two tables, each\n");
+  printf("                    from a comma separated list of dumps: start,end,old,new\n");
+  printf("   --covering       add the announced prefixes covering the first field, most specific\n");
+  printf("                    first, as prefix,origin pairs\n");
+  printf("   --more-specific  add the announced prefixes inside the first field, as prefix,origin pairs\n");
+  printf("   --origin-prefixes\n");
+  printf("                    add the v4 and v6 address counts of the AS in the first field, and the\n");
+  printf("                    address space it originates as CIDR blocks\n");
+  printf("   --space-report   write the v4 addresses and v6 /48s of every origin, largest first\n");
+  printf("   --path           add the neighbour AS, path length and as path of each field\n");
+  printf("   --on-path AS     add 1 or 0 for each field as AS is or is not on its path\n");
+  printf("   --history [TIME=]dumpfile ... [--at TIME]\n");
+  printf("                    origin changes across dated dumps (TIME, or yyyymmdd in the file name),\n");
+  printf("                    or the origin as of TIME\n");
+  printf("   --binary-in      stdin is family byte and network order address records, stdout\n");
+  printf("                    is origin (4 bytes) and announced prefix length (1 byte) records\n");
+  printf("   --aggregate[=exact|hll] [--sum N]\n");
+  printf("                    lines, bytes and distinct addresses (and the sum of field N) per origin\n");
+  printf("                    of the first field, with exact or approximate distinct counts\n");
+  printf("   --updates FILE ... [--updates-first]\n");
+  printf("                    apply the MRT BGP4MP updates in FILE to the table while looking up,\n");
+  printf("                    or all of them before the first lookup\n");
+  printf("   --serve PATH|[HOST:]PORT\n");
+  printf("                    answer lookups on a unix socket or TCP, each line as the line and the\n");
+  printf("                    origin of its first field (-f, -m and -n apply), in the order sent\n");
+  printf("   --threads N [--numa]\n");
+  printf("                    --binary-in or --serve lookups on N threads, with --numa pinned across the\n");
+  printf("                    memory nodes and each node looking up in its own copy of the table\n");
+  printf("   --stats          write the page size the lookup arrays got to stderr\n");
+  printf("   --output-compress gzip|zstd\n");
+  printf("                    compress stdout on worker threads (output is written a block at a time)\n");
   exit(1) ;
   }
   
@@ -1361,18 +1092,23 @@ usage() {
 int
 main(int argc, char **argv)
 {
-  int argerr = 0 ;
-  int arg ;
-  char ch ;
+  int dflt = 0 ;
+  int ch ;
+  size_t i ;
   char *f1 ;
   char *f2 ;
   char delim = ',';
   int f[256] ;
   int fi = 0 ;
+  int lookups ;
+  oa_table *t ;
+  oa_history *h ;
+  pthread_t updater ;
+  struct servecfg scfg ;
 
   f[0] = 1 ;
   fi = 1 ;
-  while ((ch = getopt(argc,argv,"md:f:n")) != -1) {
+  while ((ch = getopt_long(argc,argv,"md:f:n",long_options,0)) != -1) {
     switch (ch) {
       case 'm':
         show_prefix = 1 ;
@@ -1393,6 +1129,89 @@ main(int argc, char **argv)
       case 'n':
         use_names = 1 ;
         break ;
+      case OPT_SORTED_INPUT:
+        sorted_input = 1 ;
+        break ;
+      case OPT_EXPORT:
+        if (export_format < 0) export_format = 0 ;
+        if (!optarg || !strcmp(optarg,"csv")) export_format &= ~OA_FMT_BINARY ;
+        else if (!strcmp(optarg,"binary")) export_format |= OA_FMT_BINARY ;
+        else usage() ;
+        break ;
+      case OPT_CIDR:
+        if (export_format < 0) export_format = 0 ;
+        export_format |= OA_FMT_CIDR ;
+        break ;
+      case OPT_HISTORY:
+        if ((nsnapshots == 256) || !snapshot_time(optarg,&snapshots[nsnapshots])) {
+          fprintf(stderr,"ERROR: No time for history dump: %s\n",optarg) ;
+          exit(EXIT_FAILURE) ;
+          }
+        snapshots[nsnapshots].argi = nsnapshots ;
+        ++nsnapshots ;
+        break ;
+      case OPT_PATH:
+        show_path = 1 ;
+        break ;
+      case OPT_ON_PATH:
+        if ((toupper(*optarg) == 'A') && (toupper(optarg[1]) == 'S')) optarg += 2 ;
+        on_path = strtoul(optarg,0,10) ;
+        break ;
+      case OPT_BINARY_IN:
+        binary_in = 1 ;
+        break ;
+      case OPT_AGGREGATE:
+        if (!optarg || !strcmp(optarg,"exact")) aggregate = AGGR_EXACT ;
+        else if (!strcmp(optarg,"hll")) aggregate = AGGR_HLL ;
+        else usage() ;
+        break ;
+      case OPT_SUM:
+        sum_field = atoi(optarg) ;
+        break ;
+      case OPT_OUTPUT_COMPRESS:
+        if ((output_compress = zout_method(optarg)) < 0) {
+          fprintf(stderr,"ERROR: Unknown or unsupported compression: %s\n",optarg) ;
+          exit(EXIT_FAILURE) ;
+          }
+        break ;
+      case OPT_UPDATES:
+        if (nupdates == 256) usage() ;
+        updates[nupdates++] = optarg ;
+        break ;
+      case OPT_COVERING:
+        nest_query = 1 ;
+        break ;
+      case OPT_MORE_SPECIFIC:
+        nest_query = 2 ;
+        break ;
+      case OPT_ORIGIN_PREFIXES:
+        origin_query = 1 ;
+        break ;
+      case OPT_SPACE_REPORT:
+        space_report = 1 ;
+        break ;
+      case OPT_STATS:
+        table_stats = 1 ;
+        break ;
+      case OPT_THREADS:
+        if (((lookup_threads = atoi(optarg)) < 1) || (lookup_threads > 256)) usage() ;
+        break ;
+      case OPT_NUMA:
+        numa_replicas = 1 ;
+        break ;
+      case OPT_SERVE:
+        serve_addr = optarg ;
+        break ;
+      case OPT_DIFF:
+        diff_tables = 1 ;
+        break ;
+      case OPT_UPDATES_FIRST:
+        updates_first = 1 ;
+        break ;
+      case OPT_AT:
+        history_at = 1 ;
+        history_when = (u_int32_t) strtoul(optarg,0,10) ;
+        break ;
       case '?':
       default:
         usage() ;
@@ -1400,46 +1219,138 @@ main(int argc, char **argv)
     }
   argc -= optind ;
   argv += optind  ;
-  if (!argc) {
-    if (!read_dump("bgp4.txt")) {
-      fprintf(stderr,"ERROR: Cannot open stats file: %s\n","bgp4.txt") ;
-      exit(EXIT_FAILURE) ;
-      } 
-    if (!read_dump("bgp6.txt")) {
-      fprintf(stderr,"ERROR: Cannot open stats file: %s\n","bgp6.txt") ;
+
+  /* a live table keeps neither prefixes nor paths, and is exported as built */
+  if (nupdates && (show_prefix || show_path || on_path || binary_in || (export_format >= 0) || nsnapshots ||
+                   nest_query || origin_query || space_report)) {
+    fprintf(stderr,"ERROR: --updates cannot be used with -m, --path, --on-path, --binary-in, --export, --history,\n"
+                   "       --covering, --more-specific, --origin-prefixes or --space-report\n") ;
+    exit(EXIT_FAILURE) ;
+    }
+
+  if ((lookup_threads || numa_replicas) && !binary_in && !serve_addr) {
+    fprintf(stderr,"ERROR: --threads and --numa are for --binary-in lookups and --serve\n") ;
+    exit(EXIT_FAILURE) ;
+    }
+  if (serve_addr && (binary_in || aggregate || nest_query || origin_query || space_report || show_path ||
+                     on_path || (export_format >= 0) || nsnapshots || diff_tables || output_compress)) {
+    fprintf(stderr,"ERROR: --serve answers lookups, and cannot be used with --binary-in, --aggregate, --covering,\n"
+                   "       --more-specific, --origin-prefixes, --space-report, --path, --on-path, --export,\n"
+                   "       --history, --diff or --output-compress\n") ;
+    exit(EXIT_FAILURE) ;
+    }
+
+  if (output_compress) {
+    if (!(zout = zout_open(1,output_compress))) {
+      fprintf(stderr,"ERROR: Cannot compress output\n") ;
       exit(EXIT_FAILURE) ;
       }
+    atexit(output_close) ;
     }
-  else {
-    for (arg = 0; arg < argc; arg++) {
-      //    printf("%d = %s\n", arg,argv[arg]) ;
-      if (!read_dump(argv[arg])) {
-        fprintf(stderr,"ERROR: Cannot open BGP dump: %s\n",argv[arg]) ;
-        exit(EXIT_FAILURE) ;
-        } 
-      }
+
+  if (diff_tables) {
+    if (argc != 2) usage() ;
+    diff_lists(argv[0],argv[1]) ;
+    return(0) ;
     }
 
+  if (nsnapshots) {
+    h = load_history() ;
+    t = oa_table_new(0) ;
+    if (use_names && !oa_table_load_names(t,"asn.txt")) {
+      fprintf(stderr,"ERROR: Cannot open ASN label file: %s\n","asn.txt") ;
+      exit(EXIT_FAILURE) ;
+      }
+    process_history_list(h,t,delim,f,fi) ;
+    oa_history_free(h) ;
+    oa_table_free(t) ;
+    return(0) ;
+    }
 
-  v4head = 0 ;
-  aggregate4 = 0 ;
-  avldepthfirst(addresses4,link4,0,0) ;
-  deaggregate4() ;
+  /* the announced prefix lengths come from the kept prefixes, and
+     field lookups answer prefixes that were announced from the hash */
+  lookups = !(binary_in || aggregate || nest_query || origin_query || space_report || (export_format >= 0)) ;
+  t = oa_table_new(((show_prefix || binary_in) ? OA_KEEP_PREFIX : 0) |
+                   (lookups ? OA_EXACT_INDEX : 0) |
+                   ((show_path || on_path) ? OA_KEEP_PATH : 0) |
+                   (nupdates ? OA_LIVE : 0) |
+                   (nest_query ? OA_KEEP_NEST : 0) |
+                   (origin_query ? OA_KEEP_ORIGIN : 0)) ;
+  if (!argc) {
+    argc = 2 ;
+    argv = (char **) default_dumps ;
+    dflt = 1 ;
+    }
+  if ((i = oa_table_load_files(t,(const char *const *) argv,argc)) < (size_t) argc) {
+    fprintf(stderr,"ERROR: Cannot open %s: %s\n",(dflt ? "stats file" : "BGP dump"),argv[i]) ;
+    exit(EXIT_FAILURE) ;
+    }
 
-  v6head = 0 ;
-  aggregate6 = 0 ;
-  avldepthfirst(addresses6,link6,0,0) ;
-  deaggregate6() ;
+  if (!oa_table_build(t)) {
+    fprintf(stderr,"ERROR: Cannot build table: out of memory\n") ;
+    exit(EXIT_FAILURE) ;
+    }
+  if (table_stats) page_stats(t) ;
 
-  // avldepthfirst(addresses6,print_addr6,0,0) ;
-  // exit(1) ;
+  if (export_format >= 0) {
+    if (!oa_table_export(t,1,export_format)) {
+      fprintf(stderr,"ERROR: Table export failed\n") ;
+      exit(EXIT_FAILURE) ;
+      }
+    oa_table_free(t) ;
+    return(0) ;
+    }
 
   if (use_names) {
-    if (!read_as_names("asn.txt")) {
+    if (!oa_table_load_names(t,"asn.txt")) {
       fprintf(stderr,"ERROR: Cannot open ASN label file: %s\n","asn.txt") ;
       exit(EXIT_FAILURE) ;
       }
 
     }
-  process_prefix_list(delim,f,fi,show_prefix) ;
+  if (nupdates) {
+    for (i = 0 ; i < (size_t) nupdates ; ++i) {
+      if (access(updates[i],R_OK) < 0) {
+        fprintf(stderr,"ERROR: Cannot open BGP updates: %s\n",updates[i]) ;
+        exit(EXIT_FAILURE) ;
+        }
+      }
+    pthread_create(&updater,0,apply_updates,t) ;
+    if (updates_first) pthread_join(updater,0) ;
+    }
+  if (serve_addr) {
+    scfg.addr = serve_addr ;
+    if (!(scfg.threads = lookup_threads) && ((scfg.threads = (int) sysconf(_SC_NPROCESSORS_ONLN)) < 1))
+      scfg.threads = 1 ;
+    scfg.numa = numa_replicas ;
+    scfg.delim = delim ;
+    scfg.field = f[0] ;
+    scfg.show_prefix = show_prefix ;
+    scfg.use_names = use_names ;
+    scfg.stats = table_stats ;
+    if (!serve(t,&scfg)) {
+      fprintf(stderr,"ERROR: Cannot serve on %s\n",serve_addr) ;
+      exit(EXIT_FAILURE) ;
+      }
+    }
+  else if (space_report) space_report_list(t,delim) ;
+  else if (binary_in && (lookup_threads || numa_replicas)) {
+    if (!process_binary_threads(t,(lookup_threads ? lookup_threads : oa_numa_nodes()),numa_replicas))
+      exit(EXIT_FAILURE) ;
+    }
+  else if (binary_in) {
+    if (!process_binary_list(t)) exit(EXIT_FAILURE) ;
+    }
+  else if (aggregate) process_aggregate_list(t,delim,f[0],sum_field) ;
+  else if (nest_query) process_nest_list(t,delim,f[0],(nest_query == 1)) ;
+  else if (origin_query) process_origin_list(t,delim,f[0]) ;
+  else process_prefix_list(t,delim,f,fi,show_prefix) ;
+
+  /* updates still coming from a pipe end with the command */
+  if (nupdates) {
+    update_stats(t) ;
+    if (!updates_first) return(0) ;
+    }
+  oa_table_free(t) ;
+  return(0) ;
 }
@@ -0,0 +1,515 @@
+/* originas.h
+
+   internal definitions shared by liboriginas and the originas command
+
+*/
+
+#ifndef ORIGINAS_H
+#define ORIGINAS_H
+
+#include <stdio.h>
+#include <sys/types.h>
+#include <zlib.h>
+#include "libavl.h"
+#include "liboriginas.h"
+
+typedef __uint128_t u_int128_t ;
+
+union v6add {
+  u_int16_t sds[8];
+  u_int32_t quad[4];
+  u_int64_t lds[2];
+  u_int128_t llds ;
+  };
+
+typedef union v6add v6addr ;
+
+/* the MurmurHash3 finaliser, which the hashes on ASs and prefixes share */
+
+static inline u_int64_t
+mix64(u_int64_t h)
+{
+  h ^= h >> 33 ;
+  h *= 0xff51afd7ed558ccdULL ;
+  h ^= h >> 33 ;
+  h *= 0xc4ceb9fe1a85ec53ULL ;
+  h ^= h >> 33 ;
+  return(h) ;
+}
+
+
+/* as paths are stored as a tree grown from the origin end, so paths
+   that share an origin and transit tail share those nodes. A path is
+   the index of its first (neighbour) AS node, and reads toward the
+   origin through <up>. Node 0 is the empty path */
+
+struct pathnode {
+  u_int32_t asn ;
+  u_int32_t up ;
+  u_int32_t origin_as ;
+  u_int32_t len ;
+  } ;
+
+struct addr4 {
+  u_int32_t  start ;
+  u_int32_t end ;
+  u_int32_t size ;
+  u_int32_t origin_as ;
+  u_int32_t path ;
+  struct addr4 *nxt ;
+  struct addr4 *prv ;
+
+  /* remove this */
+  int flags ;
+  char *address ;
+  int mask ;
+  int status ;
+  } ;
+
+struct addr6 {
+  u_int128_t start ;
+  u_int128_t end ;
+  u_int128_t size ;
+  u_int32_t origin_as ;
+  u_int32_t path ;
+  struct addr6 *nxt ;
+  struct addr6 *prv ;
+
+  int flags ;
+  char *address ;
+  int mask ;
+  int status ;
+  } ;
+
+
+/* announced prefixes of incremental tables, in B+-trees keyed on
+   start and then length, the order of the deaggregated list. v4 keys
+   are start << 8 | length */
+
+struct pfxval {
+  u_int32_t origin_as ;
+  u_int32_t path ;
+  } ;
+
+struct pfxkey6 {
+  u_int128_t start ;
+  u_int32_t mask ;
+  } ;
+
+#define PFXKEY6_LESS(a,b) (((a).start < (b).start) || (((a).start == (b).start) && ((a).mask < (b).mask)))
+
+#define BT_NAME   pfxtree4
+#define BT_KEY    u_int64_t
+#define BT_VAL    struct pfxval
+#define BT_LESS(a,b) ((a) < (b))
+#define BT_NODE   256
+#include "btree.h"
+
+#define BT_NAME   pfxtree6
+#define BT_KEY    struct pfxkey6
+#define BT_VAL    struct pfxval
+#define BT_LESS(a,b) PFXKEY6_LESS(a,b)
+#define BT_NODE   512
+#include "btree.h"
+
+/* the ranges of live tables, in B+-trees keyed on range start */
+
+struct rngval4 {
+  u_int32_t end ;
+  u_int32_t origin_as ;
+  } ;
+
+struct rngval6 {
+  u_int128_t end ;
+  u_int32_t origin_as ;
+  } ;
+
+#define BT_NAME   rngtree4
+#define BT_KEY    u_int32_t
+#define BT_VAL    struct rngval4
+#define BT_LESS(a,b) ((a) < (b))
+#define BT_NODE   256
+#include "btree.h"
+
+#define BT_NAME   rngtree6
+#define BT_KEY    u_int128_t
+#define BT_VAL    struct rngval6
+#define BT_LESS(a,b) ((a) < (b))
+#define BT_NODE   512
+#include "btree.h"
+
+
+struct as_names {
+  unsigned int as ;
+  char *asname ;
+  } ;
+
+
+/* announced prefixes as parsed, collected for the bulk build */
+
+struct pfx4 {
+  u_int64_t key ;           /* start << 8 | mask - sorts as addr4_cmp does */
+  u_int32_t origin_as ;
+  u_int32_t path ;
+  } ;
+
+struct pfx6 {
+  u_int128_t start ;
+  u_int32_t origin_as ;
+  u_int32_t path ;
+  u_int8_t mask ;
+  } ;
+
+struct pfxvec {
+  void *v ;
+  size_t n ;
+  size_t max ;
+  } ;
+
+/* the prefixes of one or more dump files, merged with the other runs
+   when the table is built */
+
+struct pfxrun {
+  struct pfxvec pv4 ;
+  struct pfxvec pv6 ;
+  int sorted ;
+  } ;
+
+
+/* the compiled, deaggregated table that lookups search */
+
+struct range4 {
+  u_int32_t start ;
+  u_int32_t end ;
+  u_int32_t origin_as ;
+  u_int32_t path ;
+  u_int32_t prov ;          /* first piece of the range (OA_KEEP_PREFIX) */
+  } ;
+
+struct range6 {
+  u_int128_t start ;
+  u_int128_t end ;
+  u_int32_t origin_as ;
+  u_int32_t path ;
+  u_int32_t prov ;
+  } ;
+
+/* where the addresses of a range were announced. Adjacent ranges with
+   the same origin are merged whatever the table keeps, so a table that
+   keeps prefixes also keeps the pieces each merged range was made from,
+   in address order: those of range i run from r[i].prov up to the prov
+   of the next range */
+
+struct prov4 {
+  u_int32_t start ;
+  u_int32_t end ;
+  u_int32_t origin_as ;
+  int mask ;
+  char *address ;
+  } ;
+
+struct prov6 {
+  u_int128_t start ;
+  u_int128_t end ;
+  u_int32_t origin_as ;
+  int mask ;
+  char *address ;
+  } ;
+
+
+/* the announced prefixes of OA_KEEP_NEST tables, in start then length
+   order, each with the index of the nearest prefix covering it */
+
+struct nest4 {
+  u_int32_t start ;
+  u_int32_t origin_as ;
+  u_int32_t parent ;
+  u_int8_t mask ;
+  } ;
+
+struct nest6 {
+  u_int128_t start ;
+  u_int32_t origin_as ;
+  u_int32_t parent ;
+  u_int8_t mask ;
+  } ;
+
+
+/* the announced prefixes of OA_EXACT_INDEX tables, hashed on start and
+   length. v4 keys are start << 8 | length, and start 0 is an empty slot */
+
+struct exact4 {
+  u_int64_t key ;
+  u_int32_t origin_as ;
+  u_int32_t path ;
+  } ;
+
+struct exact6 {
+  u_int128_t start ;
+  u_int32_t origin_as ;
+  u_int32_t path ;
+  u_int8_t mask ;
+  } ;
+
+
+/* the reverse index of OA_KEEP_ORIGIN tables, in CSR form: the ranges
+   of origin asn[i] are idx[off[i]] up to idx[off[i + 1]], in address
+   order */
+
+struct asindex {
+  u_int32_t *asn ;
+  u_int32_t *off ;
+  u_int32_t *idx ;
+  size_t n ;
+  } ;
+
+
+/* an array on huge pages, or malloc'd if there are none (hugemem.c) */
+
+struct hugemem {
+  void *p ;
+  size_t size ;             /* mapped length, if it is mapped */
+  int pages ;               /* OA_PAGES_ */
+  } ;
+
+
+/* storage for prefix strings, released with the table */
+
+struct strblk {
+  struct strblk *nxt ;
+  size_t used ;
+  char data[16384] ;
+  } ;
+
+
+/* an announcement as parsed from a dump, on its way into a table */
+
+struct loadrec {
+  u_int128_t start ;
+  char *path ;              /* path text, for tables that keep paths */
+  u_int32_t origin_as ;
+  u_int8_t family ;
+  u_int8_t mask ;
+  } ;
+
+
+/* a dump file being read a block at a time */
+
+struct dumpfile {
+  int fd ;
+  gzFile gz ;
+  char *buf ;
+  size_t size ;
+  size_t len ;
+  size_t pos ;
+  int eof ;
+  int lf ;
+  } ;
+
+
+/* everything a table owns - no state lives outside this */
+
+struct oa_table {
+  int flags ;
+  int built ;
+
+  struct pfxtree4 tree4 ;
+  struct pfxtree6 tree6 ;
+  avl_ptr asnames ;
+
+  struct pfxvec pv4 ;
+  struct pfxvec pv6 ;
+  struct pfxrun *runs ;
+  size_t nruns ;
+  size_t maxruns ;
+
+  struct addr4 *v4head ;
+  struct addr6 *v6head ;
+
+  struct range4 *r4 ;
+  size_t n4 ;
+  struct range6 *r6 ;
+  size_t n6 ;
+  struct hugemem r4mem ;
+  struct hugemem r6mem ;
+  struct prov4 *p4 ;
+  size_t np4 ;
+  struct prov6 *p6 ;
+  size_t np6 ;
+
+  struct nest4 *nest4 ;
+  size_t nnest4 ;
+  struct nest6 *nest6 ;
+  size_t nnest6 ;
+
+  struct asindex as4 ;
+  struct asindex as6 ;
+
+  struct exact4 *ex4 ;
+  char **exaddr4 ;          /* prefix text of each slot (OA_KEEP_PREFIX) */
+  size_t exsize4 ;
+  struct exact6 *ex6 ;
+  char **exaddr6 ;
+  size_t exsize6 ;
+  struct hugemem ex4mem ;
+  struct hugemem ex6mem ;
+
+  struct pathnode *paths ;
+  size_t npaths ;
+  size_t maxpaths ;
+  u_int32_t *pathhash ;
+  size_t hashsize ;
+  u_int32_t lastpath ;
+  char lastpathtext[1025] ;
+
+  struct strblk *strings ;
+
+  struct live *live ;       /* the range trees of an OA_LIVE table (update.c) */
+  const struct oa_table *master ; /* the table a replica shares all else with (numa.c) */
+  } ;
+
+
+/* parse_field results */
+
+#define FIELD_NONE  0
+#define FIELD_ASN   1
+#define FIELD_V4    4
+#define FIELD_V6    6
+
+extern int oa_nthreads(size_t, size_t) ;
+extern void *huge_alloc(struct hugemem *, size_t) ;
+extern void *huge_move(struct hugemem *, void *, size_t) ;
+extern void huge_free(struct hugemem *) ;
+extern size_t huge_pagesize(const struct hugemem *) ;
+extern void replica_free(oa_table *) ;
+extern int oa_radixsort(void *, size_t, size_t, const int *, int) ;
+
+/* oa_radixsort key byte <i>, least significant first, of the native
+   <size> byte integer at offset <off> in a record */
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define RADIX_KEY(off,size,i) ((off) + (size) - 1 - (i))
+#else
+#define RADIX_KEY(off,size,i) ((off) + (i))
+#endif
+extern int fmt4(char *, u_int32_t, int) ;
+extern int fmt6(char *, u_int128_t, int) ;
+extern int fmtu128(char *, u_int128_t) ;
+extern int cidr4(u_int32_t, u_int32_t) ;
+extern int cidr6(u_int128_t, u_int128_t) ;
+extern char *n4ta(u_int32_t *, int) ;
+extern char *n6ta(u_int128_t *, int) ;
+extern const char *scan_byte(const char *, const char *, int) ;
+extern const char *scan_space(const char *, const char *) ;
+extern int dump_open(struct dumpfile *, const char *) ;
+extern char *dump_line(struct dumpfile *, size_t *) ;
+extern void dump_close(struct dumpfile *) ;
+extern char *dump_block(struct dumpfile *, size_t *) ;
+extern int parse_prefix(char *, struct loadrec *) ;
+extern void add_prefix(oa_table *, struct loadrec *) ;
+extern int pfx4_sort(struct pfxvec *) ;
+extern int pfx6_sort(struct pfxvec *) ;
+extern struct pfxrun *run_add(oa_table *) ;
+extern void run_close(oa_table *) ;
+extern u_int32_t parse_aspath(oa_table *, char *) ;
+extern u_int32_t aspath_origin(char *) ;
+extern void free_aspaths(oa_table *) ;
+extern unsigned int find4_origin_as(const oa_table *, oa_cursor *, u_int32_t *, char **, u_int32_t *) ;
+extern unsigned int find6_origin_as(const oa_table *, oa_cursor *, u_int128_t *, char **, u_int32_t *) ;
+extern int parse_field(char *, u_int32_t *, u_int128_t *, int *, unsigned int *) ;
+extern unsigned int originas(const oa_table *, oa_cursor *, char *, char **, u_int32_t *) ;
+extern void nest4_build(oa_table *) ;
+extern void nest6_build(oa_table *) ;
+extern void prefix4_put(oa_prefix *, u_int32_t, int, u_int32_t) ;
+extern void prefix6_put(oa_prefix *, u_int128_t, int, u_int32_t) ;
+extern void asindex_build(oa_table *) ;
+extern void exact4_build(oa_table *) ;
+extern void exact6_build(oa_table *) ;
+extern void exact_free(oa_table *) ;
+extern int exact4_origin(const oa_table *, u_int32_t, int, unsigned int *, char **, u_int32_t *) ;
+extern int exact6_origin(const oa_table *, u_int128_t, int, unsigned int *, char **, u_int32_t *) ;
+extern void asindex_free(oa_table *) ;
+
+/* an open addressed hash on origin AS (asindex.c), of entries <width>
+   bytes wide that each begin with their struct originkey */
+
+struct originkey {
+  u_int32_t origin ;
+  int used ;
+  } ;
+
+struct originhash {
+  char *ent ;
+  size_t width ;
+  size_t nent ;
+  size_t size ;
+  } ;
+
+#define ORIGINHASH_ENT(oh,i) ((struct originkey *) ((oh)->ent + (i) * (oh)->width))
+
+extern int originhash_init(struct originhash *, size_t) ;
+extern void *originhash_entry(struct originhash *, u_int32_t) ;
+extern void **originhash_sorted(const struct originhash *) ;
+extern void originhash_free(struct originhash *) ;
+extern void live_build(oa_table *) ;
+extern void live_free(oa_table *) ;
+extern unsigned int live4_origin(const oa_table *, u_int32_t) ;
+extern unsigned int live6_origin(const oa_table *, u_int128_t) ;
+
+/* compressed output for the originas command (zout.c) */
+
+#define ZOUT_GZIP   1
+#define ZOUT_ZSTD   2
+
+struct zout ;
+
+extern int zout_method(const char *) ;
+extern struct zout *zout_open(int, int) ;
+extern int zout_close(struct zout *) ;
+
+/* per-origin totals for the originas command (aggregate.c) */
+
+#define AGGR_EXACT  1
+#define AGGR_HLL    2
+
+struct aggr ;
+
+extern struct aggr *aggr_new(int) ;
+extern void aggr_add(struct aggr *, u_int32_t, size_t, int, u_int128_t, double) ;
+extern void aggr_print(struct aggr *, FILE *, const oa_table *, char, int) ;
+extern void aggr_free(struct aggr *) ;
+
+/* the work stealing pool of the query server (pool.c). A task is run
+   on worker <id>, and may spawn the parts it splits off onto that
+   worker's deque */
+
+struct pool ;
+
+struct pooltask {
+  void (*run)(struct pool *, int, struct pooltask *) ;
+  struct pooltask *nxt ;    /* the queue of new tasks */
+  } ;
+
+extern struct pool *pool_new(int, const oa_table *, int) ;
+extern int pool_replicas(const struct pool *) ;
+extern const oa_table *pool_table(const struct pool *, int) ;
+extern void pool_submit(struct pool *, struct pooltask *, int) ;
+extern void pool_spawn(struct pool *, int, struct pooltask *) ;
+extern void pool_free(struct pool *) ;
+
+/* the query server of the originas command (serve.c) */
+
+struct servecfg {
+  const char *addr ;        /* a unix socket path, or [host:]port */
+  int threads ;
+  int numa ;
+  char delim ;
+  int field ;
+  int show_prefix ;
+  int use_names ;
+  int stats ;
+  } ;
+
+extern int serve(const oa_table *, const struct servecfg *) ;
+
+#endif
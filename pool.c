@@ -0,0 +1,301 @@
+/* pool.c
+
+   a work stealing thread pool for the query server
+
+   Each worker keeps a deque of tasks. A task may split itself while it
+   runs, pushing the part it leaves for later onto the bottom of its own
+   worker's deque. Tasks made outside the pool arrive on one of two
+   queues, urgent or bulk, and a worker takes its next task
+
+     urgent    from the urgent queue first, so a request that has just
+               come in waits for no more than the task in hand
+     own       from the bottom of its own deque - the last part it left,
+               and so the next in order
+     stolen    from the top of another worker's deque - the oldest and
+               so the largest part left there
+     bulk      from the bulk queue, once the work already begun is
+               all taken
+
+   and sleeps when there are none anywhere. The deques are locked rather
+   than lock free: a task is a few thousand lookups, so the lock is
+   never what a worker waits on.
+
+   With numa set the workers are pinned across the memory nodes, and the
+   first on each node replicates the table there for the rest (numa.c).
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/types.h>
+#include "originas.h"
+
+#define POOL_MAXNODES 64
+
+
+struct deque {
+  pthread_mutex_t lock ;
+  struct pooltask **v ;
+  size_t size ;             /* a power of 2 */
+  size_t top ;              /* the oldest task */
+  size_t bottom ;           /* past the newest */
+  } ;
+
+struct poolworker {
+  struct pool *pool ;
+  const oa_table *t ;       /* the table, or the replica of this node */
+  struct deque dq ;
+  int id ;
+  int node ;
+  pthread_t tid ;
+  } ;
+
+struct pool {
+  struct poolworker *w ;
+  int nworkers ;
+  int nodes ;
+  oa_table *replica[POOL_MAXNODES] ;
+
+  pthread_mutex_t lock ;    /* the queues of new tasks, and sleeping */
+  pthread_cond_t cv ;
+  struct pooltask *head[2] ; /* bulk, urgent */
+  struct pooltask *tail[2] ;
+  size_t pending ;          /* tasks queued anywhere */
+  int sleepers ;
+  int quit ;
+  pthread_barrier_t ready ;
+  } ;
+
+
+static void
+deque_push(struct deque *dq, struct pooltask *pt)
+{
+  struct pooltask **v ;
+  size_t i, n ;
+
+  pthread_mutex_lock(&dq->lock) ;
+  if ((n = dq->bottom - dq->top) == dq->size) {
+    v = (struct pooltask **) malloc(2 * dq->size * sizeof *v) ;
+    for (i = 0 ; i < n ; ++i) v[i] = dq->v[(dq->top + i) & (dq->size - 1)] ;
+    free(dq->v) ;
+    dq->v = v ;
+    dq->size *= 2 ;
+    dq->top = 0 ;
+    dq->bottom = n ;
+    }
+  dq->v[dq->bottom++ & (dq->size - 1)] = pt ;
+  pthread_mutex_unlock(&dq->lock) ;
+}
+
+/* the newest task (own) or the oldest (stolen), or 0 */
+
+static struct pooltask *
+deque_take(struct deque *dq, int steal)
+{
+  struct pooltask *pt = 0 ;
+
+  pthread_mutex_lock(&dq->lock) ;
+  if (dq->bottom != dq->top)
+    pt = (steal ? dq->v[dq->top++ & (dq->size - 1)] : dq->v[--dq->bottom & (dq->size - 1)]) ;
+  pthread_mutex_unlock(&dq->lock) ;
+  return(pt) ;
+}
+
+
+/* count a task in, waking a worker to look for it - before it is
+   queued, so pending is never less than the tasks there are */
+
+static void
+pool_wake(struct pool *p)
+{
+  pthread_mutex_lock(&p->lock) ;
+  ++p->pending ;
+  if (p->sleepers) pthread_cond_signal(&p->cv) ;
+  pthread_mutex_unlock(&p->lock) ;
+}
+
+/* the first task on new task queue <q>, or 0. The pool is locked */
+
+static struct pooltask *
+queue_take(struct pool *p, int q)
+{
+  struct pooltask *pt ;
+
+  if ((pt = p->head[q])) {
+    if (!(p->head[q] = pt->nxt)) p->tail[q] = 0 ;
+    --p->pending ;
+    }
+  return(pt) ;
+}
+
+/* the next task for worker <w>, sleeping until there is one. 0 once
+   the pool is closing */
+
+static struct pooltask *
+pool_next(struct poolworker *w)
+{
+  struct pool *p = w->pool ;
+  struct pooltask *pt ;
+  int i ;
+
+  for (;;) {
+    pthread_mutex_lock(&p->lock) ;
+    while (!p->pending && !p->quit) {
+      ++p->sleepers ;
+      pthread_cond_wait(&p->cv,&p->lock) ;
+      --p->sleepers ;
+      }
+    if (p->quit) {
+      pthread_mutex_unlock(&p->lock) ;
+      return(0) ;
+      }
+    pt = queue_take(p,1) ;
+    pthread_mutex_unlock(&p->lock) ;
+    if (pt) return(pt) ;
+
+    /* the victims are tried from the next worker round */
+    pt = deque_take(&w->dq,0) ;
+    for (i = 1 ; !pt && (i < p->nworkers) ; ++i) pt = deque_take(&p->w[(w->id + i) % p->nworkers].dq,1) ;
+    pthread_mutex_lock(&p->lock) ;
+    if (pt) --p->pending ;
+    else pt = queue_take(p,0) ;
+    pthread_mutex_unlock(&p->lock) ;
+    if (pt) return(pt) ;
+
+    /* pending counts a task another worker is taking as well - wait
+       for it to be taken rather than sleep */
+    sched_yield() ;
+    }
+}
+
+static void *
+pool_worker(void *arg)
+{
+  struct poolworker *w = (struct poolworker *) arg ;
+  struct pool *p = w->pool ;
+  struct pooltask *pt ;
+
+  if (p->nodes > 1) {
+    oa_numa_bind(w->node) ;
+    if (w->id < p->nodes) p->replica[w->node] = oa_table_replica(w->t) ;
+    }
+  pthread_barrier_wait(&p->ready) ;
+  if ((p->nodes > 1) && p->replica[w->node]) w->t = p->replica[w->node] ;
+
+  while ((pt = pool_next(w))) pt->run(p,w->id,pt) ;
+  return(0) ;
+}
+
+
+/*--------------------------------------------------
+ * pool_new
+ * start <nworkers> workers looking up in <t>, or with <numa> set in
+ * the replica of their node. Return the pool, or 0
+ */
+
+struct pool *
+pool_new(int nworkers, const oa_table *t, int numa)
+{
+  struct pool *p ;
+  int k ;
+
+  if (!(p = (struct pool *) calloc(1,sizeof *p))) return(0) ;
+  p->nworkers = nworkers ;
+  if (numa && ((p->nodes = oa_numa_nodes()) > POOL_MAXNODES)) p->nodes = POOL_MAXNODES ;
+  p->w = (struct poolworker *) calloc(nworkers,sizeof *p->w) ;
+  pthread_mutex_init(&p->lock,0) ;
+  pthread_cond_init(&p->cv,0) ;
+  pthread_barrier_init(&p->ready,0,nworkers + 1) ;
+  for (k = 0 ; k < nworkers ; ++k) {
+    p->w[k].pool = p ;
+    p->w[k].t = t ;
+    p->w[k].id = k ;
+    p->w[k].node = (p->nodes ? k % p->nodes : 0) ;
+    pthread_mutex_init(&p->w[k].dq.lock,0) ;
+    p->w[k].dq.size = 64 ;
+    p->w[k].dq.v = (struct pooltask **) malloc(p->w[k].dq.size * sizeof *p->w[k].dq.v) ;
+    pthread_create(&p->w[k].tid,0,pool_worker,&p->w[k]) ;
+    }
+  pthread_barrier_wait(&p->ready) ;
+  return(p) ;
+}
+
+/* the number of node replicas the workers search */
+
+int
+pool_replicas(const struct pool *p)
+{
+  int k, n = 0 ;
+
+  for (k = 0 ; k < p->nodes ; ++k) if (p->replica[k]) ++n ;
+  return(n) ;
+}
+
+/* the table worker <id> looks up in */
+
+const oa_table *
+pool_table(const struct pool *p, int id)
+{
+  return(p->w[id].t) ;
+}
+
+
+/*--------------------------------------------------
+ * pool_submit, pool_spawn
+ * queue task <pt> - from outside the pool behind the other new tasks
+ * on the urgent or the bulk queue, or from a task running on worker
+ * <id> on that worker's deque
+ */
+
+void
+pool_submit(struct pool *p, struct pooltask *pt, int urgent)
+{
+  int q = (urgent ? 1 : 0) ;
+
+  pt->nxt = 0 ;
+  pthread_mutex_lock(&p->lock) ;
+  if (p->tail[q]) p->tail[q]->nxt = pt ;
+  else p->head[q] = pt ;
+  p->tail[q] = pt ;
+  ++p->pending ;
+  if (p->sleepers) pthread_cond_signal(&p->cv) ;
+  pthread_mutex_unlock(&p->lock) ;
+}
+
+void
+pool_spawn(struct pool *p, int id, struct pooltask *pt)
+{
+  pool_wake(p) ;
+  deque_push(&p->w[id].dq,pt) ;
+}
+
+
+/*--------------------------------------------------
+ * pool_free
+ * stop the workers once they finish the tasks in hand - any still
+ * queued are dropped - and release the pool and its replicas
+ */
+
+void
+pool_free(struct pool *p)
+{
+  int k ;
+
+  pthread_mutex_lock(&p->lock) ;
+  p->quit = 1 ;
+  pthread_cond_broadcast(&p->cv) ;
+  pthread_mutex_unlock(&p->lock) ;
+  for (k = 0 ; k < p->nworkers ; ++k) {
+    pthread_join(p->w[k].tid,0) ;
+    pthread_mutex_destroy(&p->w[k].dq.lock) ;
+    free(p->w[k].dq.v) ;
+    }
+  for (k = 0 ; k < p->nodes ; ++k) oa_table_free(p->replica[k]) ;
+  pthread_barrier_destroy(&p->ready) ;
+  pthread_cond_destroy(&p->cv) ;
+  pthread_mutex_destroy(&p->lock) ;
+  free(p->w) ;
+  free(p) ;
+}
@@ -0,0 +1,191 @@
+/* radixsort.c
+
+   parallel LSD radix sort of fixed width records
+
+   Records are sorted on a list of key bytes given as offsets into the
+   record, least significant byte first. Where a key is a native integer
+   its bytes lie in the host's byte order - RADIX_KEY in originas.h
+   gives their offsets on either. Every pass is a stable counting
+   sort, so records with equal keys keep their input order - the table
+   loader depends on this for its first-one-wins rule.
+
+   Each pass splits the records into one slice per thread: the threads
+   count their own slice, the counts are turned into per thread bucket
+   offsets, and then every thread scatters its slice. Passes in which
+   all records fall into one bucket are skipped.
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include "originas.h"
+
+#define RADIX_MAXTHREADS 64
+#define RADIX_MINSLICE   65536
+
+struct radixpass {
+  const unsigned char *src ;
+  unsigned char *dst ;
+  size_t width ;
+  int off ;
+  size_t lo ;
+  size_t hi ;
+  size_t count[256] ;
+  } ;
+
+
+/*--------------------------------------------------
+ * oa_nthreads
+ * number of worker threads to use for <n> items of work,
+ * at most one per online cpu
+ */
+
+int
+oa_nthreads(size_t n, size_t minslice)
+{
+  long ncpu = sysconf(_SC_NPROCESSORS_ONLN) ;
+  size_t nt ;
+
+  if (ncpu < 1) ncpu = 1 ;
+  nt = (minslice ? n / minslice : n) ;
+  if (nt > (size_t) ncpu) nt = ncpu ;
+  if (nt > RADIX_MAXTHREADS) nt = RADIX_MAXTHREADS ;
+  if (nt < 1) nt = 1 ;
+  return((int) nt) ;
+}
+
+static void *
+radix_count(void *arg)
+{
+  struct radixpass *rp = (struct radixpass *) arg ;
+  const unsigned char *p = rp->src + (rp->lo * rp->width) + rp->off ;
+  size_t i ;
+
+  memset(rp->count,0,sizeof rp->count) ;
+  for (i = rp->lo ; i < rp->hi ; ++i) {
+    ++rp->count[*p] ;
+    p += rp->width ;
+    }
+  return(0) ;
+}
+
+static void *
+radix_scatter(void *arg)
+{
+  struct radixpass *rp = (struct radixpass *) arg ;
+  const unsigned char *p = rp->src + (rp->lo * rp->width) ;
+  size_t w = rp->width ;
+  size_t i ;
+
+  switch (w) {
+    /* constant sizes let the compiler inline the copies */
+    case 16:
+      for (i = rp->lo ; i < rp->hi ; ++i, p += 16) memcpy(rp->dst + (16 * rp->count[p[rp->off]]++),p,16) ;
+      break ;
+    case 32:
+      for (i = rp->lo ; i < rp->hi ; ++i, p += 32) memcpy(rp->dst + (32 * rp->count[p[rp->off]]++),p,32) ;
+      break ;
+    default:
+      for (i = rp->lo ; i < rp->hi ; ++i, p += w) memcpy(rp->dst + (w * rp->count[p[rp->off]]++),p,w) ;
+    }
+  return(0) ;
+}
+
+static void
+radix_run(struct radixpass *rp, int nt, void *(*f)(void *))
+{
+  pthread_t tid[RADIX_MAXTHREADS] ;
+  int i ;
+
+  if (nt == 1) {
+    (*f)(&rp[0]) ;
+    return ;
+    }
+  for (i = 1 ; i < nt ; ++i) {
+    if (pthread_create(&tid[i],0,f,&rp[i])) {
+      tid[i] = 0 ;
+      (*f)(&rp[i]) ;
+      }
+    }
+  (*f)(&rp[0]) ;
+  for (i = 1 ; i < nt ; ++i) {
+    if (tid[i]) pthread_join(tid[i],0) ;
+    }
+}
+
+
+/*--------------------------------------------------
+ * oa_radixsort
+ * sort <n> records of <width> bytes at <base> on the <nkey> key
+ * byte offsets in <keys>, least significant first
+ * return 0 if no scratch memory could be had
+ */
+
+int
+oa_radixsort(void *base, size_t n, size_t width, const int *keys, int nkey)
+{
+  struct radixpass *rp ;
+  unsigned char *src = (unsigned char *) base ;
+  unsigned char *dst ;
+  unsigned char *tmp ;
+  size_t total[256] ;
+  size_t offset ;
+  size_t slice ;
+  int nt ;
+  int k, b, i ;
+
+  if (n < 2) return(1) ;
+  if (!(dst = (unsigned char *) malloc(n * width))) return(0) ;
+  nt = oa_nthreads(n,RADIX_MINSLICE) ;
+  if (!(rp = (struct radixpass *) malloc(nt * sizeof *rp))) {
+    free(dst) ;
+    return(0) ;
+    }
+  slice = (n + nt - 1) / nt ;
+
+  for (k = 0 ; k < nkey ; ++k) {
+    for (i = 0 ; i < nt ; ++i) {
+      rp[i].src = src ;
+      rp[i].dst = dst ;
+      rp[i].width = width ;
+      rp[i].off = keys[k] ;
+      rp[i].lo = (i * slice < n) ? i * slice : n ;
+      rp[i].hi = ((i + 1) * slice < n) ? (i + 1) * slice : n ;
+      }
+    radix_run(rp,nt,radix_count) ;
+
+    /* skip a pass that would not move anything */
+    for (b = 0 ; b < 256 ; ++b) {
+      total[b] = 0 ;
+      for (i = 0 ; i < nt ; ++i) total[b] += rp[i].count[b] ;
+      }
+    for (b = 0 ; (b < 256) && (total[b] != n) ; ++b) ;
+    if (b < 256) continue ;
+
+    /* bucket b of thread i starts after all lower buckets, and after
+       bucket b of every lower numbered thread */
+    offset = 0 ;
+    for (b = 0 ; b < 256 ; ++b) {
+      for (i = 0 ; i < nt ; ++i) {
+        size_t c = rp[i].count[b] ;
+        rp[i].count[b] = offset ;
+        offset += c ;
+        }
+      }
+    radix_run(rp,nt,radix_scatter) ;
+    tmp = src ;
+    src = dst ;
+    dst = tmp ;
+    }
+
+  if (src != (unsigned char *) base) {
+    memcpy(base,src,n * width) ;
+    dst = src ;
+    }
+  free(dst) ;
+  free(rp) ;
+  return(1) ;
+}
@@ -0,0 +1,511 @@
+/* serve.c
+
+   the query server of the originas command
+
+   originas --serve ADDR listens on a unix socket (any ADDR that is not
+   a port or host:port) or on TCP, and answers each line a client sends
+   as the plain lookup mode would: the line, then the origin of its
+   field (with -m, the announced prefix as well). Answers come back in
+   the order of the lines, and a client may send one line and wait, or
+   stream millions.
+
+     reader     one thread for each connection, cutting its input into
+                jobs of whole lines - as much as each read brings in -
+                and handing each job to the pool (pool.c) as one task -
+                urgent if nothing else of the connection is in flight,
+                so a query waits behind no batch's later jobs
+     workers    a job of more than SERVE_CHUNK lines splits itself in
+                halves as it runs, down to single chunks, and idle
+                workers steal the halves left waiting, so a large batch
+                spreads over the pool while a new request is picked up
+                as soon as the chunk in hand is done
+     writer     one thread for each connection, writing each chunk out
+                once it and all the chunks before it are looked up
+
+   A connection keeps no more than SERVE_BACKLOG bytes of input in
+   flight - the reader stops reading until the writer catches up - and
+   none of its lines may be longer.
+
+*/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "originas.h"
+
+#define SERVE_CHUNK   4096          /* lines looked up as one piece */
+#define SERVE_READ    (1 << 20)     /* bytes read at a time */
+#define SERVE_BACKLOG (16 << 20)    /* bytes of input in flight on a connection */
+#define SERVE_SMALL   (64 << 10)    /* jobs no larger are copied out of the read buffer */
+
+
+struct chunk {
+  char *out ;
+  size_t len ;
+  size_t max ;
+  int done ;
+  } ;
+
+/* the lines of one read, cut into chunks: chunk i is the bytes from
+   cut[i] up to cut[i + 1] */
+
+struct job {
+  struct conn *c ;
+  char *buf ;
+  size_t len ;
+  size_t *cut ;
+  size_t nchunks ;
+  struct chunk *ch ;
+  size_t flushed ;          /* chunks written */
+  struct job *nxt ;
+  } ;
+
+struct conn {
+  int fd ;
+  struct server *sv ;
+  pthread_mutex_t lock ;
+  pthread_cond_t cv ;       /* a chunk done, a job written, or the reader done */
+  struct job *head ;        /* jobs not yet written, in order */
+  struct job *tail ;
+  size_t inflight ;
+  int eof ;
+  int dead ;                /* the client is gone */
+  } ;
+
+struct server {
+  const struct servecfg *cfg ;
+  struct pool *pool ;
+  } ;
+
+/* the chunks <lo> up to <hi> of a job */
+
+struct rangetask {
+  struct pooltask pt ;
+  struct job *j ;
+  size_t lo ;
+  size_t hi ;
+  } ;
+
+
+/* room for <n> more bytes of output in <ch> */
+
+static char *
+chunk_room(struct chunk *ch, size_t n)
+{
+  if (ch->len + n > ch->max) {
+    while (ch->len + n > ch->max) ch->max = (ch->max ? 2 * ch->max : 4096) ;
+    ch->out = (char *) realloc(ch->out,ch->max) ;
+    }
+  return(ch->out + ch->len) ;
+}
+
+/* answer the line <l> of <n> bytes into <ch> */
+
+static void
+serve_line(const struct servecfg *cfg, const oa_table *t, const char *l, size_t n, struct chunk *ch)
+{
+  char field[1026] ;
+  char num[16] ;
+  const char *fp, *fe, *end ;
+  const char *asname ;
+  char *pfx = 0 ;
+  char *op ;
+  size_t flen = 0, alen, plen ;
+  unsigned int as = 0 ;
+  int k ;
+
+  if (n && (l[n - 1] == '\r')) --n ;
+  end = l + n ;
+
+  /* field <cfg->field>, up to the next delimiter */
+  for (fp = l, k = 1 ; fp && (k < cfg->field) ; ++k) {
+    if ((fp = (const char *) memchr(fp,cfg->delim,end - fp))) ++fp ;
+    }
+  if (fp) {
+    if (!(fe = (const char *) memchr(fp,cfg->delim,end - fp))) fe = end ;
+    if ((flen = fe - fp) > 1024) flen = 1024 ;
+    memcpy(field,fp,flen) ;
+    }
+  field[flen] = '\0' ;
+  if (flen) as = originas(t,0,field,&pfx,0) ;
+
+  if (!cfg->use_names || !(asname = oa_asname(t,as))) {
+    snprintf(num,sizeof num,(cfg->use_names ? "AS%u" : "%u"),as) ;
+    asname = num ;
+    }
+  alen = strlen(asname) ;
+  plen = ((cfg->show_prefix && pfx) ? strlen(pfx) : 0) ;
+
+  op = chunk_room(ch,n + alen + plen + 3) ;
+  memcpy(op,l,n) ;
+  op += n ;
+  *op++ = cfg->delim ;
+  memcpy(op,asname,alen) ;
+  op += alen ;
+  if (cfg->show_prefix) {
+    *op++ = cfg->delim ;
+    memcpy(op,pfx,plen) ;
+    op += plen ;
+    }
+  *op++ = '\n' ;
+  ch->len = op - ch->out ;
+}
+
+
+/* the pool task - split off the upper half while there is more than one
+   chunk, then look up the one that is left */
+
+static void
+range_run(struct pool *p, int id, struct pooltask *pt)
+{
+  struct rangetask *rt = (struct rangetask *) pt ;
+  struct rangetask *half ;
+  struct job *j = rt->j ;
+  struct conn *c = j->c ;
+  struct chunk *ch ;
+  const oa_table *t = pool_table(p,id) ;
+  const char *l, *e, *nl ;
+  size_t mid ;
+
+  while (rt->hi - rt->lo > 1) {
+    mid = rt->lo + (rt->hi - rt->lo) / 2 ;
+    half = (struct rangetask *) malloc(sizeof *half) ;
+    half->pt.run = range_run ;
+    half->j = j ;
+    half->lo = mid ;
+    half->hi = rt->hi ;
+    pool_spawn(p,id,&half->pt) ;
+    rt->hi = mid ;
+    }
+
+  ch = &j->ch[rt->lo] ;
+  l = j->buf + j->cut[rt->lo] ;
+  e = j->buf + j->cut[rt->lo + 1] ;
+  chunk_room(ch,(e - l) + (e - l) / 2) ;
+  while (l < e) {
+    nl = (const char *) memchr(l,'\n',e - l) ;
+    serve_line(c->sv->cfg,t,l,(nl ? nl : e) - l,ch) ;
+    l = (nl ? nl + 1 : e) ;
+    }
+  free(rt) ;
+
+  pthread_mutex_lock(&c->lock) ;
+  ch->done = 1 ;
+  pthread_cond_broadcast(&c->cv) ;
+  pthread_mutex_unlock(&c->lock) ;
+}
+
+
+/* queue the <len> bytes of whole lines in <buf> (which the job takes)
+   on connection <c> */
+
+static void
+job_submit(struct conn *c, char *buf, size_t len)
+{
+  struct job *j = (struct job *) calloc(1,sizeof *j) ;
+  struct rangetask *rt ;
+  size_t max = 16 ;
+  size_t lines = 0 ;
+  const char *cp = buf, *end = buf + len ;
+  int urgent ;
+
+  j->c = c ;
+  j->buf = buf ;
+  j->len = len ;
+  j->cut = (size_t *) malloc(max * sizeof *j->cut) ;
+  while (cp < end) {
+    if (!(lines++ % SERVE_CHUNK)) {
+      if (j->nchunks + 2 > max) j->cut = (size_t *) realloc(j->cut,(max *= 2) * sizeof *j->cut) ;
+      j->cut[j->nchunks++] = cp - buf ;
+      }
+    if (!(cp = (const char *) memchr(cp,'\n',end - cp))) break ;
+    ++cp ;
+    }
+  j->cut[j->nchunks] = len ;
+  j->ch = (struct chunk *) calloc(j->nchunks,sizeof *j->ch) ;
+
+  /* a connection with nothing else in flight is waiting on this job,
+     and one with work under way is streaming a batch */
+  pthread_mutex_lock(&c->lock) ;
+  urgent = !c->head ;
+  if (c->tail) c->tail->nxt = j ;
+  else c->head = j ;
+  c->tail = j ;
+  c->inflight += len ;
+  pthread_mutex_unlock(&c->lock) ;
+
+  rt = (struct rangetask *) malloc(sizeof *rt) ;
+  rt->pt.run = range_run ;
+  rt->j = j ;
+  rt->lo = 0 ;
+  rt->hi = j->nchunks ;
+  pool_submit(c->sv->pool,&rt->pt,urgent) ;
+}
+
+
+/* reader - a job for each read that ends a line, and one for a last
+   line with no newline. A line longer than SERVE_BACKLOG is no query:
+   reading stops there, and the connection is closed once the answers
+   to the lines before it are written */
+
+static void *
+conn_reader(void *arg)
+{
+  struct conn *c = (struct conn *) arg ;
+  size_t max = SERVE_READ ;
+  char *buf = (char *) malloc(max) ;
+  char *nbuf ;
+  char *nl ;
+  size_t have = 0, n ;
+  ssize_t r ;
+
+  for (;;) {
+    pthread_mutex_lock(&c->lock) ;
+    while ((c->inflight > SERVE_BACKLOG) && !c->dead) pthread_cond_wait(&c->cv,&c->lock) ;
+    r = c->dead ;
+    pthread_mutex_unlock(&c->lock) ;
+    if (r) break ;
+
+    if ((r = read(c->fd,buf + have,max - have)) < 0) {
+      if (errno == EINTR) continue ;
+      break ;
+      }
+    if (!r) {
+      if (have) {
+        job_submit(c,buf,have) ;
+        buf = 0 ;
+        }
+      break ;
+      }
+    have += r ;
+    if (!(nl = (char *) memrchr(buf,'\n',have))) {
+      if ((have >= SERVE_BACKLOG) || ((have == max) && !(nbuf = (char *) realloc(buf,2 * max)))) {
+        shutdown(c->fd,SHUT_RD) ;
+        break ;
+        }
+      if (have == max) {
+        buf = nbuf ;
+        max *= 2 ;
+        }
+      continue ;
+      }
+
+    /* a small job is copied out, and a large one takes the buffer */
+    n = nl + 1 - buf ;
+    if (n <= SERVE_SMALL) {
+      nbuf = (char *) malloc(n) ;
+      memcpy(nbuf,buf,n) ;
+      job_submit(c,nbuf,n) ;
+      memmove(buf,buf + n,have - n) ;
+      }
+    else {
+      nbuf = buf ;
+      max = ((have - n > SERVE_READ) ? 2 * (have - n) : SERVE_READ) ;
+      buf = (char *) malloc(max) ;
+      memcpy(buf,nbuf + n,have - n) ;
+      job_submit(c,nbuf,n) ;
+      }
+    have -= n ;
+    }
+  free(buf) ;
+
+  pthread_mutex_lock(&c->lock) ;
+  c->eof = 1 ;
+  pthread_cond_broadcast(&c->cv) ;
+  pthread_mutex_unlock(&c->lock) ;
+  return(0) ;
+}
+
+
+static int
+send_all(int fd, const char *p, size_t n)
+{
+  ssize_t w ;
+
+  while (n) {
+    if ((w = send(fd,p,n,MSG_NOSIGNAL)) < 0) {
+      if (errno == EINTR) continue ;
+      return(0) ;
+      }
+    p += w ;
+    n -= w ;
+    }
+  return(1) ;
+}
+
+/* writer - each chunk in order once it is done, then the connection
+   is closed and released once the reader is done too */
+
+static void *
+conn_writer(void *arg)
+{
+  struct conn *c = (struct conn *) arg ;
+  struct chunk *ch ;
+  struct job *j ;
+  int ok ;
+
+  pthread_mutex_lock(&c->lock) ;
+  for (;;) {
+    if (!(j = c->head)) {
+      if (c->eof) break ;
+      pthread_cond_wait(&c->cv,&c->lock) ;
+      continue ;
+      }
+    if (j->flushed == j->nchunks) {
+      if (!(c->head = j->nxt)) c->tail = 0 ;
+      c->inflight -= j->len ;
+      pthread_cond_broadcast(&c->cv) ;
+      free(j->buf) ;
+      free(j->cut) ;
+      free(j->ch) ;
+      free(j) ;
+      continue ;
+      }
+    ch = &j->ch[j->flushed] ;
+    if (!ch->done) {
+      pthread_cond_wait(&c->cv,&c->lock) ;
+      continue ;
+      }
+
+    /* once the client is gone the rest is looked up and dropped */
+    ok = c->dead ;
+    pthread_mutex_unlock(&c->lock) ;
+    ok = (ok || send_all(c->fd,ch->out,ch->len)) ;
+    free(ch->out) ;
+    pthread_mutex_lock(&c->lock) ;
+    ++j->flushed ;
+    if (!ok) {
+      c->dead = 1 ;
+      shutdown(c->fd,SHUT_RDWR) ;
+      pthread_cond_broadcast(&c->cv) ;
+      }
+    }
+  pthread_mutex_unlock(&c->lock) ;
+
+  close(c->fd) ;
+  pthread_cond_destroy(&c->cv) ;
+  pthread_mutex_destroy(&c->lock) ;
+  free(c) ;
+  return(0) ;
+}
+
+
+/* a socket listening on <addr>, or -1 */
+
+static int
+serve_listen(const char *addr)
+{
+  struct sockaddr_un sun ;
+  struct addrinfo hints, *ai, *a ;
+  struct stat st ;
+  char host[256] ;
+  const char *port, *cp ;
+  int fd = -1 ;
+  int one = 1 ;
+
+  /* a port, or host:port ([v6]:port), is TCP and anything else a path */
+  for (cp = addr ; *cp && (*cp >= '0') && (*cp <= '9') ; ++cp) ;
+  if (*cp && !strchr(addr,':')) {
+    if (strlen(addr) >= sizeof sun.sun_path) return(-1) ;
+    if (!stat(addr,&st) && S_ISSOCK(st.st_mode)) unlink(addr) ;
+    memset(&sun,0,sizeof sun) ;
+    sun.sun_family = AF_UNIX ;
+    strcpy(sun.sun_path,addr) ;
+    if ((fd = socket(AF_UNIX,SOCK_STREAM,0)) < 0) return(-1) ;
+    if ((bind(fd,(struct sockaddr *) &sun,sizeof sun) < 0) || (listen(fd,128) < 0)) {
+      close(fd) ;
+      return(-1) ;
+      }
+    return(fd) ;
+    }
+
+  host[0] = '\0' ;
+  port = addr ;
+  if ((cp = strrchr(addr,':'))) {
+    port = cp + 1 ;
+    if ((*addr == '[') && (cp > addr) && (cp[-1] == ']')) ++addr, --cp ;
+    if ((size_t) (cp - addr) >= sizeof host) return(-1) ;
+    memcpy(host,addr,cp - addr) ;
+    host[cp - addr] = '\0' ;
+    }
+  memset(&hints,0,sizeof hints) ;
+  hints.ai_family = AF_UNSPEC ;
+  hints.ai_socktype = SOCK_STREAM ;
+  hints.ai_flags = AI_PASSIVE ;
+  if (getaddrinfo((host[0] ? host : 0),port,&hints,&ai)) return(-1) ;
+  for (a = ai ; a ; a = a->ai_next) {
+    if ((fd = socket(a->ai_family,a->ai_socktype,a->ai_protocol)) < 0) continue ;
+    setsockopt(fd,SOL_SOCKET,SO_REUSEADDR,&one,sizeof one) ;
+    if (!bind(fd,a->ai_addr,a->ai_addrlen) && !listen(fd,128)) break ;
+    close(fd) ;
+    fd = -1 ;
+    }
+  freeaddrinfo(ai) ;
+  return(fd) ;
+}
+
+
+/*--------------------------------------------------
+ * serve
+ * answer the connections to <cfg->addr> on a pool of <cfg->threads>
+ * workers, for as long as the command runs. Return 0 if there is no
+ * listening there, or accepting fails
+ */
+
+int
+serve(const oa_table *t, const struct servecfg *cfg)
+{
+  struct server sv ;
+  struct conn *c ;
+  pthread_attr_t attr ;
+  pthread_t tid ;
+  int lfd, fd ;
+  int one = 1 ;
+
+  if ((lfd = serve_listen(cfg->addr)) < 0) return(0) ;
+  sv.cfg = cfg ;
+  if (!(sv.pool = pool_new(cfg->threads,t,cfg->numa))) {
+    close(lfd) ;
+    return(0) ;
+    }
+  if (cfg->stats)
+    fprintf(stderr,"serve: %s, %d threads, %d replicas\n",cfg->addr,cfg->threads,pool_replicas(sv.pool)) ;
+
+  pthread_attr_init(&attr) ;
+  pthread_attr_setdetachstate(&attr,PTHREAD_CREATE_DETACHED) ;
+  for (;;) {
+    if ((fd = accept(lfd,0,0)) < 0) {
+      if ((errno == EINTR) || (errno == ECONNABORTED)) continue ;
+      if ((errno == EMFILE) || (errno == ENFILE) || (errno == ENOBUFS) || (errno == ENOMEM)) {
+        usleep(10000) ;
+        continue ;
+        }
+      break ;
+      }
+
+    /* one line requests are answered at once, not held for more */
+    setsockopt(fd,IPPROTO_TCP,TCP_NODELAY,&one,sizeof one) ;
+    c = (struct conn *) calloc(1,sizeof *c) ;
+    c->fd = fd ;
+    c->sv = &sv ;
+    pthread_mutex_init(&c->lock,0) ;
+    pthread_cond_init(&c->cv,0) ;
+    pthread_create(&tid,&attr,conn_reader,c) ;
+    pthread_create(&tid,&attr,conn_writer,c) ;
+    }
+  pthread_attr_destroy(&attr) ;
+  close(lfd) ;
+  pool_free(sv.pool) ;
+  return(0) ;
+}
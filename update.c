@@ -0,0 +1,885 @@
+/* update.c
+
+   live updates of a resident table from MRT BGP4MP update files
+
+   A table made with OA_LIVE loads its dumps through the prefix trees,
+   as an incremental table does, and keeps them once it is built. Its
+   deaggregated ranges are also kept in B+-trees keyed on range start,
+   and lookups search those trees instead of the compiled arrays.
+
+   oa_table_update() reads the BGP UPDATE messages of an MRT file (RFC
+   6396 BGP4MP and BGP4MP_ET records, gzipped or not, or a named pipe)
+   and applies each withdrawn and announced prefix to the prefix trees.
+   A changed prefix only redraws the ranges of its own address span:
+   the most specific prefix covering each address of the span is found
+   from the prefix tree, the span's old ranges are cut out of the range
+   tree, and the new ones are put in their place, merged with their
+   neighbours where the origins match. Nothing else in the table is
+   touched, so an update costs a few tree searches - microseconds - and
+   not a rebuild.
+
+   Lookups take the table's read lock, and the updater its write lock
+   for one UPDATE message at a time, so lookups carry on between
+   messages and never see half of one.
+
+   The updates are taken as one feed: an announcement replaces the
+   origin the prefix had, and a withdrawal removes the prefix, whatever
+   peer either came from. Replay the updates of one peer, or of a route
+   server's best paths, to follow that view of the table. An announced
+   path is read as dump paths are - it ends at its first AS set - and a
+   path with no origin withdraws the prefix.
+
+*/
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <zlib.h>
+#include <sys/types.h>
+#include "originas.h"
+
+/* MRT record types and BGP4MP subtypes */
+
+#define MRT_MAXLEN          (1 << 24)   /* longest record believed */
+
+#define MRT_BGP4MP          16
+#define MRT_BGP4MP_ET       17
+#define BGP4MP_MESSAGE      1
+#define BGP4MP_MESSAGE_AS4  4
+#define BGP4MP_MESSAGE_LOCAL      6
+#define BGP4MP_MESSAGE_AS4_LOCAL  7
+
+#define BGP_UPDATE          2
+
+/* path attributes */
+
+#define ATTR_AS_PATH        2
+#define ATTR_MP_REACH       14
+#define ATTR_MP_UNREACH     15
+#define ATTR_AS4_PATH       17
+
+#define AS_SET              1
+#define AS_SEQUENCE         2
+#define AS_TRANS            23456
+
+#define AFI_IPV4            1
+#define AFI_IPV6            2
+#define SAFI_UNICAST        1
+
+
+/* a run of addresses with one origin, drawn for a span */
+
+struct piece4 {
+  u_int32_t start ;
+  u_int32_t end ;
+  u_int32_t origin_as ;
+  } ;
+
+struct piece6 {
+  u_int128_t start ;
+  u_int128_t end ;
+  u_int32_t origin_as ;
+  } ;
+
+struct live {
+  pthread_rwlock_t lock ;
+  struct rngtree4 r4 ;
+  struct rngtree6 r6 ;
+
+  struct piece4 *pc4 ;      /* the pieces of the span being redrawn */
+  size_t npc4 ;
+  size_t maxpc4 ;
+  struct piece6 *pc6 ;
+  size_t npc6 ;
+  size_t maxpc6 ;
+
+  u_int64_t messages ;
+  u_int64_t announced ;
+  u_int64_t withdrawn ;
+  u_int64_t nsec ;
+  u_int64_t maxnsec ;
+  } ;
+
+
+static u_int32_t
+get16(const u_int8_t *b)
+{
+  return(((u_int32_t) b[0] << 8) | b[1]) ;
+}
+
+static u_int32_t
+get32(const u_int8_t *b)
+{
+  return(((u_int32_t) b[0] << 24) | ((u_int32_t) b[1] << 16) | ((u_int32_t) b[2] << 8) | b[3]) ;
+}
+
+
+/*--------------------------------------------------
+ * live_build
+ * put the compiled ranges of a just built OA_LIVE table into its
+ * range trees
+ */
+
+void
+live_build(oa_table *t)
+{
+  struct live *lv ;
+  pthread_rwlockattr_t attr ;
+  struct rngval4 *v4 ;
+  struct rngval6 *v6 ;
+  size_t i ;
+  int inserted ;
+
+  t->live = lv = (struct live *) calloc(1,sizeof *lv) ;
+
+  /* glibc's locks let a steady run of readers hold off the updater */
+  pthread_rwlockattr_init(&attr) ;
+#ifdef __GLIBC__
+  pthread_rwlockattr_setkind_np(&attr,PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP) ;
+#endif
+  pthread_rwlock_init(&lv->lock,&attr) ;
+  pthread_rwlockattr_destroy(&attr) ;
+  for (i = 0 ; i < t->n4 ; ++i) {
+    v4 = rngtree4_insert(&lv->r4,t->r4[i].start,&inserted) ;
+    v4->end = t->r4[i].end ;
+    v4->origin_as = t->r4[i].origin_as ;
+    }
+  for (i = 0 ; i < t->n6 ; ++i) {
+    v6 = rngtree6_insert(&lv->r6,t->r6[i].start,&inserted) ;
+    v6->end = t->r6[i].end ;
+    v6->origin_as = t->r6[i].origin_as ;
+    }
+}
+
+void
+live_free(oa_table *t)
+{
+  struct live *lv = t->live ;
+
+  if (!lv) return ;
+  rngtree4_free(&lv->r4) ;
+  rngtree6_free(&lv->r6) ;
+  pthread_rwlock_destroy(&lv->lock) ;
+  free(lv->pc4) ;
+  free(lv->pc6) ;
+  free(lv) ;
+  t->live = 0 ;
+}
+
+
+/*--------------------------------------------------
+ * rng4_prev, rng6_prev
+ * the range tree entry with the greatest start not above <a>, as a
+ * leaf and slot, or 0 if there is none
+ */
+
+static struct rngtree4_leaf *
+rng4_prev(const struct rngtree4 *rt, u_int32_t a, int *pos)
+{
+  struct rngtree4_leaf *lf ;
+  int i ;
+
+  if (!(lf = rngtree4_seek(rt,a,&i))) return(0) ;
+  if ((i < lf->n) && (lf->key[i] == a)) {
+    *pos = i ;
+    return(lf) ;
+    }
+  if (!i) {
+    if (!(lf = lf->prev) || !lf->n) return(0) ;
+    i = lf->n ;
+    }
+  *pos = i - 1 ;
+  return(lf) ;
+}
+
+static struct rngtree6_leaf *
+rng6_prev(const struct rngtree6 *rt, u_int128_t a, int *pos)
+{
+  struct rngtree6_leaf *lf ;
+  int i ;
+
+  if (!(lf = rngtree6_seek(rt,a,&i))) return(0) ;
+  if ((i < lf->n) && (lf->key[i] == a)) {
+    *pos = i ;
+    return(lf) ;
+    }
+  if (!i) {
+    if (!(lf = lf->prev) || !lf->n) return(0) ;
+    i = lf->n ;
+    }
+  *pos = i - 1 ;
+  return(lf) ;
+}
+
+/* the first entry with a start of <a> or more, as a leaf and slot */
+
+static struct rngtree4_leaf *
+rng4_next(const struct rngtree4 *rt, u_int32_t a, int *pos)
+{
+  struct rngtree4_leaf *lf = rngtree4_seek(rt,a,pos) ;
+
+  while (lf && (*pos == lf->n)) {
+    lf = lf->next ;
+    *pos = 0 ;
+    }
+  return(lf) ;
+}
+
+static struct rngtree6_leaf *
+rng6_next(const struct rngtree6 *rt, u_int128_t a, int *pos)
+{
+  struct rngtree6_leaf *lf = rngtree6_seek(rt,a,pos) ;
+
+  while (lf && (*pos == lf->n)) {
+    lf = lf->next ;
+    *pos = 0 ;
+    }
+  return(lf) ;
+}
+
+
+/*--------------------------------------------------
+ * live4_origin, live6_origin
+ * the origin of address <a> in a live table, 0 if it is not announced
+ */
+
+unsigned int
+live4_origin(const oa_table *t, u_int32_t a)
+{
+  struct live *lv = t->live ;
+  const struct rngtree4_leaf *lf ;
+  unsigned int as = 0 ;
+  int i ;
+
+  pthread_rwlock_rdlock(&lv->lock) ;
+  if ((lf = rng4_prev(&lv->r4,a,&i)) && (lf->val[i].end >= a)) as = lf->val[i].origin_as ;
+  pthread_rwlock_unlock(&lv->lock) ;
+  return(as) ;
+}
+
+unsigned int
+live6_origin(const oa_table *t, u_int128_t a)
+{
+  struct live *lv = t->live ;
+  const struct rngtree6_leaf *lf ;
+  unsigned int as = 0 ;
+  int i ;
+
+  pthread_rwlock_rdlock(&lv->lock) ;
+  if ((lf = rng6_prev(&lv->r6,a,&i)) && (lf->val[i].end >= a)) as = lf->val[i].origin_as ;
+  pthread_rwlock_unlock(&lv->lock) ;
+  return(as) ;
+}
+
+
+/*--------------------------------------------------
+ * piece4_add, piece6_add
+ * add addresses <start> to <end> with origin <origin> to the pieces of
+ * the span, extending the last piece if it is adjacent with the same
+ * origin. Unannounced addresses are not drawn
+ */
+
+static void
+piece4_add(struct live *lv, u_int32_t start, u_int32_t end, u_int32_t origin)
+{
+  struct piece4 *pc ;
+
+  if (!origin) return ;
+  if (lv->npc4 && (lv->pc4[lv->npc4 - 1].end + 1 == start) && (lv->pc4[lv->npc4 - 1].origin_as == origin)) {
+    lv->pc4[lv->npc4 - 1].end = end ;
+    return ;
+    }
+  if (lv->npc4 == lv->maxpc4) {
+    lv->maxpc4 = (lv->maxpc4 ? 2 * lv->maxpc4 : 64) ;
+    lv->pc4 = (struct piece4 *) realloc(lv->pc4,lv->maxpc4 * sizeof *lv->pc4) ;
+    }
+  pc = &lv->pc4[lv->npc4++] ;
+  pc->start = start ;
+  pc->end = end ;
+  pc->origin_as = origin ;
+}
+
+static void
+piece6_add(struct live *lv, u_int128_t start, u_int128_t end, u_int32_t origin)
+{
+  struct piece6 *pc ;
+
+  if (!origin) return ;
+  if (lv->npc6 && (lv->pc6[lv->npc6 - 1].end + 1 == start) && (lv->pc6[lv->npc6 - 1].origin_as == origin)) {
+    lv->pc6[lv->npc6 - 1].end = end ;
+    return ;
+    }
+  if (lv->npc6 == lv->maxpc6) {
+    lv->maxpc6 = (lv->maxpc6 ? 2 * lv->maxpc6 : 64) ;
+    lv->pc6 = (struct piece6 *) realloc(lv->pc6,lv->maxpc6 * sizeof *lv->pc6) ;
+    }
+  pc = &lv->pc6[lv->npc6++] ;
+  pc->start = start ;
+  pc->end = end ;
+  pc->origin_as = origin ;
+}
+
+
+/*--------------------------------------------------
+ * draw4, draw6
+ * draw the span <s> to <e> of prefix length <m> from the prefix tree:
+ * each address takes the origin of the most specific prefix covering
+ * it. The prefixes inside the span come out of the tree in start then
+ * length order, so they nest, and a stack of the open prefixes (at most
+ * one per length) gives the origin between them
+ */
+
+static void
+draw4(oa_table *t, u_int32_t s, u_int32_t e, int m)
+{
+  struct live *lv = t->live ;
+  const struct pfxtree4_leaf *lf ;
+  const struct pfxval *pv ;
+  u_int64_t stend[34] ;
+  u_int32_t storg[34] ;
+  u_int64_t pos = s ;
+  u_int64_t qs, qe ;
+  u_int32_t base = 0 ;
+  int sp = 0 ;
+  int i, k ;
+
+  /* the span's own origin - the prefix, or the nearest one covering it */
+  for (k = m ; k > 0 ; --k) {
+    if ((pv = pfxtree4_find(&t->tree4,((u_int64_t) (s & ~(u_int32_t) ((((u_int64_t) 1) << (32 - k)) - 1)) << 8) | k))) {
+      base = pv->origin_as ;
+      break ;
+      }
+    }
+  stend[sp] = e ;
+  storg[sp++] = base ;
+
+  lv->npc4 = 0 ;
+  lf = ((m < 32) ? pfxtree4_seek(&t->tree4,((u_int64_t) s << 8) | (m + 1),&i) : 0) ;
+  for ( ; lf ; lf = lf->next, i = 0) {
+    for ( ; i < lf->n ; ++i) {
+      if ((qs = lf->key[i] >> 8) > e) goto drawn ;
+      qe = qs + ((u_int64_t) 1 << (32 - (lf->key[i] & 255))) - 1 ;
+      while (stend[sp - 1] < qs) {
+        if (pos <= stend[sp - 1]) {
+          piece4_add(lv,(u_int32_t) pos,(u_int32_t) stend[sp - 1],storg[sp - 1]) ;
+          pos = stend[sp - 1] + 1 ;
+          }
+        --sp ;
+        }
+      if (qs > pos) piece4_add(lv,(u_int32_t) pos,(u_int32_t) (qs - 1),storg[sp - 1]) ;
+      pos = qs ;
+      stend[sp] = qe ;
+      storg[sp++] = lf->val[i].origin_as ;
+      }
+    }
+ drawn:
+  while (sp--) {
+    if (pos > stend[sp]) continue ;
+    piece4_add(lv,(u_int32_t) pos,(u_int32_t) stend[sp],storg[sp]) ;
+    pos = stend[sp] + 1 ;
+    }
+}
+
+static void
+draw6(oa_table *t, u_int128_t s, u_int128_t e, int m)
+{
+  struct live *lv = t->live ;
+  const struct pfxtree6_leaf *lf ;
+  const struct pfxval *pv ;
+  struct pfxkey6 k6 ;
+  u_int128_t stend[130] ;
+  u_int32_t storg[130] ;
+  u_int128_t pos = s ;
+  u_int128_t qs, qe ;
+  u_int32_t base = 0 ;
+  int sp = 0 ;
+  int i, k ;
+
+  for (k = m ; k > 0 ; --k) {
+    k6.start = s & ~((k < 128) ? (((u_int128_t) 1 << (128 - k)) - 1) : 0) ;
+    k6.mask = k ;
+    if ((pv = pfxtree6_find(&t->tree6,k6))) {
+      base = pv->origin_as ;
+      break ;
+      }
+    }
+  stend[sp] = e ;
+  storg[sp++] = base ;
+
+  lv->npc6 = 0 ;
+  k6.start = s ;
+  k6.mask = m + 1 ;
+  lf = ((m < 128) ? pfxtree6_seek(&t->tree6,k6,&i) : 0) ;
+  for ( ; lf ; lf = lf->next, i = 0) {
+    for ( ; i < lf->n ; ++i) {
+      if ((qs = lf->key[i].start) > e) goto drawn ;
+      qe = qs + (((lf->key[i].mask < 128) ? ((u_int128_t) 1 << (128 - lf->key[i].mask)) : 1) - 1) ;
+      while (stend[sp - 1] < qs) {
+        if (pos <= stend[sp - 1]) {
+          piece6_add(lv,pos,stend[sp - 1],storg[sp - 1]) ;
+          pos = stend[sp - 1] + 1 ;
+          }
+        --sp ;
+        }
+      if (qs > pos) piece6_add(lv,pos,qs - 1,storg[sp - 1]) ;
+      pos = qs ;
+      stend[sp] = qe ;
+      storg[sp++] = lf->val[i].origin_as ;
+      }
+    }
+ drawn:
+  /* the span may end at the top of the address space, so stop at its
+     end rather than step past it */
+  while (sp--) {
+    if (pos > stend[sp]) continue ;
+    piece6_add(lv,pos,stend[sp],storg[sp]) ;
+    if (stend[sp] == e) break ;
+    pos = stend[sp] + 1 ;
+    }
+}
+
+
+/*--------------------------------------------------
+ * splice4, splice6
+ * replace the ranges of span <s> to <e> with the drawn pieces. A range
+ * reaching into the span from either side is cut at its edge, and a
+ * piece at either edge is merged with the range beyond it if they have
+ * the same origin, so the ranges stay as a fresh build would make them
+ */
+
+static void
+splice4(struct live *lv, u_int32_t s, u_int32_t e)
+{
+  struct rngtree4_leaf *lf ;
+  struct rngval4 *v, old ;
+  struct rngval4 tail ;
+  struct piece4 *pc ;
+  u_int32_t ts = 0 ;
+  size_t j ;
+  int i, inserted ;
+
+  tail.origin_as = 0 ;
+
+  /* a range from before the span */
+  if ((lf = rng4_prev(&lv->r4,s,&i)) && (lf->key[i] < s) && (lf->val[i].end >= s)) {
+    if (lf->val[i].end > e) {
+      ts = e + 1 ;
+      tail = lf->val[i] ;
+      }
+    lf->val[i].end = s - 1 ;
+    }
+
+  /* ranges in the span, the last of which may run on past it */
+  while ((lf = rng4_next(&lv->r4,s,&i)) && (lf->key[i] <= e)) {
+    rngtree4_remove(&lv->r4,lf->key[i],&old) ;
+    if (old.end > e) {
+      ts = e + 1 ;
+      tail = old ;
+      }
+    }
+  if (tail.origin_as) {
+    v = rngtree4_insert(&lv->r4,ts,&inserted) ;
+    *v = tail ;
+    }
+
+  for (j = 0 ; j < lv->npc4 ; ++j) {
+    pc = &lv->pc4[j] ;
+    if ((pc->end == e) && (e != ~(u_int32_t) 0) && (v = rngtree4_find(&lv->r4,e + 1)) &&
+        (v->origin_as == pc->origin_as)) {
+      pc->end = v->end ;
+      rngtree4_remove(&lv->r4,e + 1,0) ;
+      }
+    if ((pc->start == s) && s && (lf = rng4_prev(&lv->r4,s - 1,&i)) &&
+        (lf->val[i].end == s - 1) && (lf->val[i].origin_as == pc->origin_as)) {
+      lf->val[i].end = pc->end ;
+      continue ;
+      }
+    v = rngtree4_insert(&lv->r4,pc->start,&inserted) ;
+    v->end = pc->end ;
+    v->origin_as = pc->origin_as ;
+    }
+}
+
+static void
+splice6(struct live *lv, u_int128_t s, u_int128_t e)
+{
+  struct rngtree6_leaf *lf ;
+  struct rngval6 *v, old ;
+  struct rngval6 tail ;
+  struct piece6 *pc ;
+  u_int128_t ts = 0 ;
+  size_t j ;
+  int i, inserted ;
+
+  tail.origin_as = 0 ;
+
+  if ((lf = rng6_prev(&lv->r6,s,&i)) && (lf->key[i] < s) && (lf->val[i].end >= s)) {
+    if (lf->val[i].end > e) {
+      ts = e + 1 ;
+      tail = lf->val[i] ;
+      }
+    lf->val[i].end = s - 1 ;
+    }
+
+  while ((lf = rng6_next(&lv->r6,s,&i)) && (lf->key[i] <= e)) {
+    rngtree6_remove(&lv->r6,lf->key[i],&old) ;
+    if (old.end > e) {
+      ts = e + 1 ;
+      tail = old ;
+      }
+    }
+  if (tail.origin_as) {
+    v = rngtree6_insert(&lv->r6,ts,&inserted) ;
+    *v = tail ;
+    }
+
+  for (j = 0 ; j < lv->npc6 ; ++j) {
+    pc = &lv->pc6[j] ;
+    if ((pc->end == e) && (e != ~(u_int128_t) 0) && (v = rngtree6_find(&lv->r6,e + 1)) &&
+        (v->origin_as == pc->origin_as)) {
+      pc->end = v->end ;
+      rngtree6_remove(&lv->r6,e + 1,0) ;
+      }
+    if ((pc->start == s) && s && (lf = rng6_prev(&lv->r6,s - 1,&i)) &&
+        (lf->val[i].end == s - 1) && (lf->val[i].origin_as == pc->origin_as)) {
+      lf->val[i].end = pc->end ;
+      continue ;
+      }
+    v = rngtree6_insert(&lv->r6,pc->start,&inserted) ;
+    v->end = pc->end ;
+    v->origin_as = pc->origin_as ;
+    }
+}
+
+
+/*--------------------------------------------------
+ * apply4, apply6
+ * announce prefix <start>/<mask> with origin <origin>, or withdraw it
+ * if the origin is 0, and redraw its span if that changed anything
+ */
+
+static void
+apply4(oa_table *t, u_int32_t start, int mask, u_int32_t origin)
+{
+  struct pfxval *pv ;
+  u_int64_t key ;
+  u_int32_t end ;
+  int inserted ;
+
+  if ((mask < 1) || (mask > 32)) return ;
+  if (mask < 32) start &= ~(u_int32_t) ((((u_int64_t) 1) << (32 - mask)) - 1) ;
+
+  /* as in dumps, a prefix at address 0 is taken for the default route */
+  if (!start) return ;
+  key = ((u_int64_t) start << 8) | mask ;
+  if (origin) {
+    ++t->live->announced ;
+    pv = pfxtree4_insert(&t->tree4,key,&inserted) ;
+    if (!inserted && (pv->origin_as == origin)) return ;
+    pv->origin_as = origin ;
+    pv->path = 0 ;
+    }
+  else {
+    ++t->live->withdrawn ;
+    if (!pfxtree4_remove(&t->tree4,key,0)) return ;
+    }
+
+  end = start + (u_int32_t) ((((u_int64_t) 1) << (32 - mask)) - 1) ;
+  draw4(t,start,end,mask) ;
+  splice4(t->live,start,end) ;
+}
+
+static void
+apply6(oa_table *t, u_int128_t start, int mask, u_int32_t origin)
+{
+  struct pfxval *pv ;
+  struct pfxkey6 k6 ;
+  u_int128_t size ;
+  int inserted ;
+
+  if ((mask < 1) || (mask > 128)) return ;
+  size = ((mask < 128) ? ((u_int128_t) 1 << (128 - mask)) : 1) ;
+  if (!(k6.start = start & ~(size - 1))) return ;
+  k6.mask = mask ;
+  if (origin) {
+    ++t->live->announced ;
+    pv = pfxtree6_insert(&t->tree6,k6,&inserted) ;
+    if (!inserted && (pv->origin_as == origin)) return ;
+    pv->origin_as = origin ;
+    pv->path = 0 ;
+    }
+  else {
+    ++t->live->withdrawn ;
+    if (!pfxtree6_remove(&t->tree6,k6,0)) return ;
+    }
+
+  draw6(t,k6.start,k6.start + (size - 1),mask) ;
+  splice6(t->live,k6.start,k6.start + (size - 1)) ;
+}
+
+
+/*--------------------------------------------------
+ * apply_nlri
+ * apply each prefix of NLRI field <b> of <len> bytes, of address
+ * family <afi>, with origin <origin> (0 to withdraw). Return 0 if the
+ * field is malformed
+ */
+
+static int
+apply_nlri(oa_table *t, int afi, const u_int8_t *b, size_t len, u_int32_t origin)
+{
+  u_int8_t a[16] ;
+  u_int128_t a6 ;
+  int bits, bytes, i ;
+
+  while (len) {
+    bits = *b++ ;
+    --len ;
+    bytes = (bits + 7) / 8 ;
+    if ((bits > ((afi == AFI_IPV4) ? 32 : 128)) || ((size_t) bytes > len)) return(0) ;
+    memset(a,0,sizeof a) ;
+    memcpy(a,b,bytes) ;
+    b += bytes ;
+    len -= bytes ;
+
+    if (afi == AFI_IPV4) apply4(t,get32(a),bits,origin) ;
+    else {
+      for (a6 = 0, i = 0 ; i < 16 ; ++i) a6 = (a6 << 8) | a[i] ;
+      apply6(t,a6,bits,origin) ;
+      }
+    }
+  return(1) ;
+}
+
+
+/*--------------------------------------------------
+ * path_origin
+ * the origin of AS_PATH attribute <b> of <len> bytes with <asize> byte
+ * AS numbers: the last AS before the first AS set, 0 if there is none.
+ * Confederation segments are skipped
+ */
+
+static u_int32_t
+path_origin(const u_int8_t *b, size_t len, int asize)
+{
+  u_int32_t origin = 0 ;
+  size_t seg ;
+  int n, i ;
+
+  while (len >= 2) {
+    n = b[1] ;
+    seg = 2 + ((size_t) n * asize) ;
+    if (seg > len) return(0) ;
+    if (b[0] == AS_SET) break ;
+    if ((b[0] == AS_SEQUENCE) && n) {
+      i = 2 + ((n - 1) * asize) ;
+      origin = ((asize == 4) ? get32(b + i) : get16(b + i)) ;
+      }
+    b += seg ;
+    len -= seg ;
+    }
+  return(origin) ;
+}
+
+
+/*--------------------------------------------------
+ * apply_update
+ * apply BGP UPDATE message body <b> of <len> bytes: withdrawals first,
+ * then announcements. Return 0 if the message is malformed
+ */
+
+static int
+apply_update(oa_table *t, const u_int8_t *b, size_t len, int asize)
+{
+  const u_int8_t *wd, *attr, *nlri, *a ;
+  const u_int8_t *mpr = 0 ;
+  const u_int8_t *mpu = 0 ;
+  size_t wlen, alen, nlen, l, hl ;
+  size_t mprlen = 0, mpulen = 0 ;
+  int mprafi = 0, mpuafi = 0 ;
+  u_int32_t origin = 0, origin4 = 0 ;
+  int as4path = 0 ;
+
+  if (len < 4) return(0) ;
+  wlen = get16(b) ;
+  wd = b + 2 ;
+  if (4 + wlen > len) return(0) ;
+  alen = get16(b + 2 + wlen) ;
+  attr = b + 4 + wlen ;
+  if (4 + wlen + alen > len) return(0) ;
+  nlri = attr + alen ;
+  nlen = len - (4 + wlen + alen) ;
+
+  for (a = attr ; a < attr + alen ; a += hl + l) {
+    if (attr + alen - a < 3) return(0) ;
+    if (a[0] & 0x10) {
+      if (attr + alen - a < 4) return(0) ;
+      l = get16(a + 2) ;
+      hl = 4 ;
+      }
+    else {
+      l = a[2] ;
+      hl = 3 ;
+      }
+    if ((size_t) (attr + alen - a) < hl + l) return(0) ;
+
+    switch (a[1]) {
+      case ATTR_AS_PATH:
+        origin = path_origin(a + hl,l,asize) ;
+        break ;
+      case ATTR_AS4_PATH:
+        origin4 = path_origin(a + hl,l,4) ;
+        as4path = 1 ;
+        break ;
+      case ATTR_MP_REACH:
+        /* afi, safi, next hop, a reserved byte and then the prefixes */
+        if ((l < 5) || (l < 5 + (size_t) a[hl + 3]) || (a[hl + 2] != SAFI_UNICAST)) break ;
+        mprafi = get16(a + hl) ;
+        mpr = a + hl + 5 + a[hl + 3] ;
+        mprlen = l - (5 + a[hl + 3]) ;
+        break ;
+      case ATTR_MP_UNREACH:
+        if ((l < 3) || (a[hl + 2] != SAFI_UNICAST)) break ;
+        mpuafi = get16(a + hl) ;
+        mpu = a + hl + 3 ;
+        mpulen = l - 3 ;
+        break ;
+      }
+    }
+
+  /* a 2 byte path stands AS_TRANS in for 4 byte ASs, which AS4_PATH holds */
+  if ((asize == 2) && as4path && (!origin || (origin == AS_TRANS))) origin = origin4 ;
+
+  if (!apply_nlri(t,AFI_IPV4,wd,wlen,0)) return(0) ;
+  if (mpu && ((mpuafi == AFI_IPV4) || (mpuafi == AFI_IPV6)) && !apply_nlri(t,mpuafi,mpu,mpulen,0))
+    return(0) ;
+  if (!apply_nlri(t,AFI_IPV4,nlri,nlen,origin)) return(0) ;
+  if (mpr && ((mprafi == AFI_IPV4) || (mprafi == AFI_IPV6)) && !apply_nlri(t,mprafi,mpr,mprlen,origin))
+    return(0) ;
+  return(1) ;
+}
+
+
+/*--------------------------------------------------
+ * apply_message
+ * apply BGP4MP message record <b> of <len> bytes of <subtype>, if it
+ * holds an UPDATE, under the table's write lock. Return 0 if the
+ * record is malformed
+ */
+
+static int
+apply_message(oa_table *t, const u_int8_t *b, size_t len, int subtype)
+{
+  struct live *lv = t->live ;
+  struct timespec t0, t1 ;
+  size_t hl, blen ;
+  u_int64_t ns ;
+  int asize, ok ;
+
+  asize = (((subtype == BGP4MP_MESSAGE_AS4) || (subtype == BGP4MP_MESSAGE_AS4_LOCAL)) ? 4 : 2) ;
+
+  /* peer and local AS, interface, afi and the peer and local addresses */
+  hl = (2 * asize) + 4 ;
+  if (len < hl) return(0) ;
+  hl += 2 * ((get16(b + (2 * asize) + 2) == AFI_IPV6) ? 16 : 4) ;
+
+  /* the BGP message: marker, length, type */
+  if (len < hl + 19) return(0) ;
+  blen = get16(b + hl + 16) ;
+  if ((blen < 19) || (hl + blen > len)) return(0) ;
+  if (b[hl + 18] != BGP_UPDATE) return(1) ;
+
+  pthread_rwlock_wrlock(&lv->lock) ;
+  clock_gettime(CLOCK_MONOTONIC,&t0) ;
+  ok = apply_update(t,b + hl + 19,blen - 19,asize) ;
+  clock_gettime(CLOCK_MONOTONIC,&t1) ;
+  ns = ((u_int64_t) (t1.tv_sec - t0.tv_sec) * 1000000000) + t1.tv_nsec - t0.tv_nsec ;
+  ++lv->messages ;
+  lv->nsec += ns ;
+  if (ns > lv->maxnsec) lv->maxnsec = ns ;
+  pthread_rwlock_unlock(&lv->lock) ;
+  return(ok) ;
+}
+
+
+/*--------------------------------------------------
+ * oa_table_update
+ * apply the BGP4MP UPDATE messages of MRT file <fname> to live table
+ * <t>, reading until the file (or pipe) ends. Other records are
+ * skipped. Return the number of records read, or -1 if the table is
+ * not live, the file cannot be opened or a record is malformed
+ */
+
+long
+oa_table_update(oa_table *t, const char *fname)
+{
+  gzFile gz ;
+  u_int8_t hdr[12] ;
+  u_int8_t *buf = 0 ;
+  size_t size = 0 ;
+  size_t len ;
+  long n = 0 ;
+  int type, subtype ;
+  int off ;
+
+  if (!t->live) return(-1) ;
+  if (!(gz = gzopen(fname,"rb"))) return(-1) ;
+  while (gzread(gz,hdr,sizeof hdr) == sizeof hdr) {
+    type = get16(hdr + 4) ;
+    subtype = get16(hdr + 6) ;
+    len = get32(hdr + 8) ;
+    if (len > MRT_MAXLEN) {
+      n = -1 ;
+      break ;
+      }
+    if (len > size) {
+      size = ((len > 65536) ? len : 65536) ;
+      buf = (u_int8_t *) realloc(buf,size) ;
+      }
+    if (gzread(gz,buf,len) != (int) len) {
+      n = -1 ;
+      break ;
+      }
+    ++n ;
+
+    /* extended timestamp records carry microseconds ahead of the message */
+    if ((type != MRT_BGP4MP) && (type != MRT_BGP4MP_ET)) continue ;
+    off = ((type == MRT_BGP4MP_ET) ? 4 : 0) ;
+    if ((subtype != BGP4MP_MESSAGE) && (subtype != BGP4MP_MESSAGE_AS4) &&
+        (subtype != BGP4MP_MESSAGE_LOCAL) && (subtype != BGP4MP_MESSAGE_AS4_LOCAL)) continue ;
+    if (((size_t) off > len) || !apply_message(t,buf + off,len - off,subtype)) {
+      n = -1 ;
+      break ;
+      }
+    }
+  free(buf) ;
+  gzclose(gz) ;
+  return(n) ;
+}
+
+
+/*--------------------------------------------------
+ * oa_update_stats
+ * the UPDATE messages applied to a live table, the prefixes they
+ * announced and withdrew, and the total and longest time taken to
+ * apply a message, in nanoseconds
+ */
+
+void
+oa_update_stats(const oa_table *t, uint64_t *messages, uint64_t *announced, uint64_t *withdrawn,
+                uint64_t *nsec, uint64_t *maxnsec)
+{
+  struct live *lv = t->live ;
+
+  *messages = *announced = *withdrawn = *nsec = *maxnsec = 0 ;
+  if (!lv) return ;
+  pthread_rwlock_rdlock(&lv->lock) ;
+  *messages = lv->messages ;
+  *announced = lv->announced ;
+  *withdrawn = lv->withdrawn ;
+  *nsec = lv->nsec ;
+  *maxnsec = lv->maxnsec ;
+  pthread_rwlock_unlock(&lv->lock) ;
+}
@@ -0,0 +1,313 @@
+/* zout.c
+
+   compressed output for the originas command
+
+   zout_open() puts a pipe in place of an output descriptor, so stdio
+   and plain write()s to it carry on as before, and compresses what
+   comes out of the pipe on worker threads
+
+     reader     cuts the output into blocks of ZOUT_BLOCK bytes
+     workers    each compress whole blocks on their own
+     writer     writes the compressed blocks out in the order they were cut
+
+   Each block is compressed as a stream of its own - a gzip member, or a
+   zstd frame - and a run of those is itself a valid stream, so no
+   compressor ever needs another block's state. Blocks are held in a ring
+   of ZOUT_DEPTH slots: the reader waits for the writer to free a slot,
+   so no more than that many blocks are ever in memory.
+
+   The workers sleep on a condition variable rather than spin, as the
+   output of a lookup run may trickle out for as long as its input does.
+
+   zstd output needs libzstd: build with -DHAVE_ZSTD and -lzstd.
+
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <zlib.h>
+#include <sys/types.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include "originas.h"
+
+#define ZOUT_BLOCK    (1 << 20)     /* bytes of output per block */
+#define ZOUT_WORKERS  8             /* most compressor threads */
+#define ZOUT_DEPTH    (2 * ZOUT_WORKERS)
+
+
+struct zblk {
+  char *in ;
+  size_t inlen ;
+  char *out ;
+  size_t outlen ;
+  int done ;
+  } ;
+
+struct zout {
+  int fd ;                  /* where the compressed stream goes */
+  int rfd ;                 /* read end of the pipe */
+  int saved ;               /* the descriptor the pipe stands in for */
+  int method ;
+  int err ;
+  int eof ;
+
+  pthread_mutex_t lock ;
+  pthread_cond_t cv ;
+  struct zblk *ring[ZOUT_DEPTH] ;
+  size_t head ;             /* next block to write */
+  size_t next ;             /* next block to compress */
+  size_t tail ;             /* next block to cut */
+
+  pthread_t reader ;
+  pthread_t writer ;
+  pthread_t worker[ZOUT_WORKERS] ;
+  int nworkers ;
+  } ;
+
+
+/*--------------------------------------------------
+ * zout_method
+ * the ZOUT_ method named <name>, or -1 if there is no such method
+ * (or it was not built in)
+ */
+
+int
+zout_method(const char *name)
+{
+  if (!strcmp(name,"gzip")) return(ZOUT_GZIP) ;
+#ifdef HAVE_ZSTD
+  if (!strcmp(name,"zstd")) return(ZOUT_ZSTD) ;
+#endif
+  return(-1) ;
+}
+
+
+/* compress block <zb> as a stream of its own */
+
+static int
+compress_block(int method, struct zblk *zb)
+{
+  z_stream zs ;
+  size_t cap ;
+
+#ifndef HAVE_ZSTD
+  (void) method ;
+#else
+  if (method == ZOUT_ZSTD) {
+    cap = ZSTD_compressBound(zb->inlen) ;
+    if (!(zb->out = (char *) malloc(cap))) return(0) ;
+    zb->outlen = ZSTD_compress(zb->out,cap,zb->in,zb->inlen,3) ;
+    return(!ZSTD_isError(zb->outlen)) ;
+    }
+#endif
+
+  /* windowBits 15 + 16 writes a gzip header and trailer */
+  memset(&zs,0,sizeof zs) ;
+  if (deflateInit2(&zs,Z_DEFAULT_COMPRESSION,Z_DEFLATED,15 + 16,8,Z_DEFAULT_STRATEGY) != Z_OK)
+    return(0) ;
+  cap = deflateBound(&zs,zb->inlen) ;
+  if (!(zb->out = (char *) malloc(cap))) {
+    deflateEnd(&zs) ;
+    return(0) ;
+    }
+  zs.next_in = (Bytef *) zb->in ;
+  zs.avail_in = zb->inlen ;
+  zs.next_out = (Bytef *) zb->out ;
+  zs.avail_out = cap ;
+  if (deflate(&zs,Z_FINISH) != Z_STREAM_END) {
+    deflateEnd(&zs) ;
+    return(0) ;
+    }
+  zb->outlen = cap - zs.avail_out ;
+  deflateEnd(&zs) ;
+  return(1) ;
+}
+
+
+/* reader - cut the piped output into blocks, a full block at a time
+   unless the output ends */
+
+static void *
+zout_reader(void *arg)
+{
+  struct zout *z = (struct zout *) arg ;
+  struct zblk *zb ;
+  ssize_t r = 1 ;
+  int err = 0 ;
+
+  while (r > 0) {
+    zb = (struct zblk *) calloc(1,sizeof *zb) ;
+    zb->in = (char *) malloc(ZOUT_BLOCK) ;
+    while (zb->inlen < ZOUT_BLOCK) {
+      if ((r = read(z->rfd,zb->in + zb->inlen,ZOUT_BLOCK - zb->inlen)) < 0) {
+        if (errno == EINTR) continue ;
+        err = 1 ;
+        }
+      if (r <= 0) break ;
+      zb->inlen += r ;
+      }
+    if (!zb->inlen) {
+      free(zb->in) ;
+      free(zb) ;
+      break ;
+      }
+
+    pthread_mutex_lock(&z->lock) ;
+    while (z->tail - z->head == ZOUT_DEPTH) pthread_cond_wait(&z->cv,&z->lock) ;
+    z->ring[z->tail % ZOUT_DEPTH] = zb ;
+    ++z->tail ;
+    pthread_cond_broadcast(&z->cv) ;
+    pthread_mutex_unlock(&z->lock) ;
+    }
+
+  pthread_mutex_lock(&z->lock) ;
+  if (err) z->err = 1 ;
+  z->eof = 1 ;
+  pthread_cond_broadcast(&z->cv) ;
+  pthread_mutex_unlock(&z->lock) ;
+  return(0) ;
+}
+
+/* worker - compress the blocks in the order they were cut */
+
+static void *
+zout_worker(void *arg)
+{
+  struct zout *z = (struct zout *) arg ;
+  struct zblk *zb ;
+  int ok ;
+
+  pthread_mutex_lock(&z->lock) ;
+  for (;;) {
+    while ((z->next == z->tail) && !z->eof) pthread_cond_wait(&z->cv,&z->lock) ;
+    if (z->next == z->tail) break ;
+    zb = z->ring[z->next++ % ZOUT_DEPTH] ;
+    pthread_mutex_unlock(&z->lock) ;
+
+    ok = compress_block(z->method,zb) ;
+    free(zb->in) ;
+    zb->in = 0 ;
+
+    pthread_mutex_lock(&z->lock) ;
+    if (!ok) z->err = 1 ;
+    zb->done = 1 ;
+    pthread_cond_broadcast(&z->cv) ;
+    }
+  pthread_mutex_unlock(&z->lock) ;
+  return(0) ;
+}
+
+/* writer - write each block out once it and every block before it
+   are compressed */
+
+static void *
+zout_writer(void *arg)
+{
+  struct zout *z = (struct zout *) arg ;
+  struct zblk *zb ;
+  size_t off ;
+  ssize_t w ;
+  int err = 0 ;
+
+  pthread_mutex_lock(&z->lock) ;
+  for (;;) {
+    while (((z->head == z->tail) && !z->eof)
+            || ((z->head != z->tail) && !z->ring[z->head % ZOUT_DEPTH]->done))
+      pthread_cond_wait(&z->cv,&z->lock) ;
+    if (z->head == z->tail) break ;
+    zb = z->ring[z->head % ZOUT_DEPTH] ;
+    pthread_mutex_unlock(&z->lock) ;
+
+    for (off = 0 ; !err && (off < zb->outlen) ; ) {
+      if ((w = write(z->fd,zb->out + off,zb->outlen - off)) < 0) {
+        if (errno == EINTR) continue ;
+        err = 1 ;
+        }
+      else off += w ;
+      }
+    free(zb->out) ;
+    free(zb) ;
+
+    pthread_mutex_lock(&z->lock) ;
+    if (err) z->err = 1 ;
+    ++z->head ;
+    pthread_cond_broadcast(&z->cv) ;
+    }
+  pthread_mutex_unlock(&z->lock) ;
+  return(0) ;
+}
+
+
+/*--------------------------------------------------
+ * zout_open
+ * compress everything written to descriptor <fd> from now on with
+ * ZOUT_ method <method>, until zout_close(). Return 0 on failure
+ */
+
+struct zout *
+zout_open(int fd, int method)
+{
+  struct zout *z ;
+  int p[2] ;
+  int i ;
+
+  if (!(z = (struct zout *) calloc(1,sizeof *z))) return(0) ;
+  if (pipe(p) < 0) {
+    free(z) ;
+    return(0) ;
+    }
+  z->method = method ;
+  z->rfd = p[0] ;
+  z->saved = fd ;
+  if (((z->fd = dup(fd)) < 0) || (dup2(p[1],fd) < 0)) {
+    close(p[0]) ;
+    close(p[1]) ;
+    if (z->fd >= 0) close(z->fd) ;
+    free(z) ;
+    return(0) ;
+    }
+  close(p[1]) ;
+
+  pthread_mutex_init(&z->lock,0) ;
+  pthread_cond_init(&z->cv,0) ;
+  z->nworkers = oa_nthreads(ZOUT_WORKERS,0) ;
+  for (i = 0 ; i < z->nworkers ; ++i) pthread_create(&z->worker[i],0,zout_worker,z) ;
+  pthread_create(&z->writer,0,zout_writer,z) ;
+  pthread_create(&z->reader,0,zout_reader,z) ;
+  return(z) ;
+}
+
+
+/*--------------------------------------------------
+ * zout_close
+ * end the stream - anything buffered above the descriptor (stdout)
+ * must already be flushed - and put the descriptor back.
+ * Return 0 if the output could not be compressed or written
+ */
+
+int
+zout_close(struct zout *z)
+{
+  int ok ;
+  int i ;
+
+  /* the descriptor holds the last write end of the pipe */
+  close(z->saved) ;
+  pthread_join(z->reader,0) ;
+  for (i = 0 ; i < z->nworkers ; ++i) pthread_join(z->worker[i],0) ;
+  pthread_join(z->writer,0) ;
+
+  dup2(z->fd,z->saved) ;
+  close(z->fd) ;
+  close(z->rfd) ;
+  pthread_mutex_destroy(&z->lock) ;
+  pthread_cond_destroy(&z->cv) ;
+  ok = !z->err ;
+  free(z) ;
+  return(ok) ;
+}